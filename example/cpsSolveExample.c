@@ -0,0 +1,134 @@
+/*!
+ * \file cpsSolveExample.c
+ *
+ * \date 2026/10/18
+ * \brief This file contains an example of libcps, which solves a synthetic Lambertian sphere by \c cpsSolve() and checks the normals.
+ *
+ * It is plain C, so that it also checks that CpsApi.h is usable from C. It returns 0 on success, and is run by ctest.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "CpsApi.h"
+
+#define WIDTH 64
+#define HEIGHT 48
+#define NUMBER_OF_IMAGES 6
+
+int main(void)
+{
+    static const float lightDirections[NUMBER_OF_IMAGES*3] = {
+        0.0f, 0.0f, 1.0f,
+        0.5f, 0.0f, 0.866f,
+        -0.5f, 0.0f, 0.866f,
+        0.0f, 0.5f, 0.866f,
+        0.0f, -0.5f, 0.866f,
+        0.35f, 0.35f, 0.866f
+    };
+    static const float lightIntensities[NUMBER_OF_IMAGES] = { 1.0f, 0.9f, 1.1f, 1.0f, 0.8f, 1.2f };
+    static float images[NUMBER_OF_IMAGES][WIDTH*HEIGHT];
+    static float truth[WIDTH*HEIGHT*3];
+    static float normal[WIDTH*HEIGHT*3];
+    static float albedo[WIDTH*HEIGHT];
+    static float residual[WIDTH*HEIGHT];
+    static unsigned char mask[WIDTH*HEIGHT];
+    const float* pointers[NUMBER_OF_IMAGES];
+    const float radius = 20.0f;
+    const float rho = 200.0f;
+    CpsInput input;
+    CpsOutput output;
+    CpsStatus status;
+    float errorMax = 0.0f;
+    int numberOfPixels = 0;
+    int x, y, f, d;
+
+    /* render a sphere of albedo rho, whose pixels lit by all lights are in the mask. */
+    for(y = 0; y < HEIGHT; ++y)
+    {
+        for(x = 0; x < WIDTH; ++x)
+        {
+            int i = y*WIDTH + x;
+            float nx = (x - WIDTH/2 + 0.5f) / radius;
+            float ny = -(y - HEIGHT/2 + 0.5f) / radius;
+            float nz2 = 1.0f - nx*nx - ny*ny;
+            float nz = nz2 > 0.0f ? sqrtf(nz2) : 0.0f;
+            mask[i] = nz2 > 0.0f;
+            truth[3*i] = nx;
+            truth[3*i+1] = ny;
+            truth[3*i+2] = nz;
+            for(f = 0; f < NUMBER_OF_IMAGES; ++f)
+            {
+                const float* l = lightDirections + 3*f;
+                float shading = nx*l[0] + ny*l[1] + nz*l[2];
+                if( shading <= 0.0f )
+                {
+                    mask[i] = 0;
+                }
+                images[f][i] = mask[i] ? rho * lightIntensities[f] * shading : 0.0f;
+            }
+        }
+    }
+    for(f = 0; f < NUMBER_OF_IMAGES; ++f)
+    {
+        pointers[f] = images[f];
+    }
+
+    cpsInitInput(&input);
+    input.width = WIDTH;
+    input.height = HEIGHT;
+    input.channels = 1;
+    input.numberOfImages = NUMBER_OF_IMAGES;
+    input.images = pointers;
+    input.mask = mask;
+    input.lightDirections = lightDirections;
+    input.lightIntensities = lightIntensities;
+    output.normal = normal;
+    output.albedo = albedo;
+    output.residual = residual;
+
+    status = cpsSolve(&input, &output);
+    if( status != CPS_OK )
+    {
+        fprintf(stderr, "cpsSolve failed: %s\n", cpsStatusString(status));
+        return EXIT_FAILURE;
+    }
+    for(x = 0; x < WIDTH*HEIGHT; ++x)
+    {
+        if( !mask[x] )
+        {
+            continue;
+        }
+        ++numberOfPixels;
+        for(d = 0; d < 3; ++d)
+        {
+            errorMax = fmaxf(errorMax, fabsf(normal[3*x+d] - truth[3*x+d]));
+        }
+        errorMax = fmaxf(errorMax, fabsf(albedo[x] - rho) / rho);
+        errorMax = fmaxf(errorMax, residual[x] / rho);
+    }
+    printf("solved %d pixels of API version %d, max error %g\n", numberOfPixels, cpsApiVersion(), errorMax);
+    if( numberOfPixels == 0 || errorMax > 1e-3f )
+    {
+        return EXIT_FAILURE;
+    }
+
+    /* invalid inputs are reported by the status. */
+    input.reflectanceModel = "Unknown";
+    if( cpsSolve(&input, &output) != CPS_ERROR_UNKNOWN_REFLECTANCE_MODEL )
+    {
+        fprintf(stderr, "unknown reflectance model is not reported\n");
+        return EXIT_FAILURE;
+    }
+    input.reflectanceModel = NULL;
+    input.numberOfImages = 2;
+    if( cpsSolve(&input, &output) != CPS_ERROR_NOT_ENOUGH_IMAGES )
+    {
+        fprintf(stderr, "too few images are not reported\n");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,233 @@
+#ifndef __ASYNCWRITER_H__
+#define __ASYNCWRITER_H__
+
+/*!
+ * \file AsyncWriter.hpp
+ *
+ * \date 2026/10/18
+ * \brief This file contains an asynchronous writer, which encodes and writes output images on its own threads while computation continues.
+ *
+ */
+
+// STL
+#include <deque>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <utility>
+
+// Boost
+#include <boost/bind/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+// CImg
+#include <CImg.h>
+
+// internal headers
+#include "ImageFloat.hpp"
+
+/*!
+ * \class AsyncWriter
+ *
+ * \brief runs submitted write jobs on worker threads in submission order per thread, and reports completion of each job.
+ *
+ * The destructor waits until all submitted jobs are written, so that the process exits after all outputs are durable.
+ *
+ */
+class AsyncWriter
+{
+public:
+    //--------------------------------------------------------
+    //
+    //! \name Public Types
+    //@{
+    //--------------------------------------------------------
+    //! A write job, which returns \c false if it fails.
+    typedef boost::function<bool (void)> Job;
+    //@}
+
+    //--------------------------------------------------------
+    //
+    //! \name Constructors / Destructor / Instance Management
+    //@{
+    //--------------------------------------------------------
+    //! Destructor, which waits all jobs.
+    ~AsyncWriter()
+    {
+        wait();
+    }
+    //! Default constructor, which starts \c numberOfThreads worker threads.
+    AsyncWriter(
+        const int numberOfThreads = 1
+    ):
+        flagStop_(false),
+        numberOfPending_(0),
+        numberOfFailed_(0)
+    {
+        for(int t = 0; t < numberOfThreads; ++t)
+        {
+            threads_.create_thread( boost::bind(&AsyncWriter::run, this) );
+        }
+    }
+    //@}
+
+    //! submits \c job named \c name, and returns immediately.
+    void submit(
+        const Job& job,
+        const std::string& name
+    )
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        queue_.push_back( std::make_pair(job, name) );
+        ++numberOfPending_;
+        condJob_.notify_one();
+    }
+
+    //! waits until all submitted jobs are done, stops the worker threads, and returns the number of failed jobs.
+    int wait(void)
+    {
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            while( numberOfPending_ > 0 )
+            {
+                condDone_.wait(lock);
+            }
+            flagStop_ = true;
+            condJob_.notify_all();
+        }
+        threads_.join_all();
+
+        return numberOfFailed_;
+    }
+
+    //! returns the number of submitted jobs not done yet.
+    int numberOfPending(void)
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        return numberOfPending_;
+    }
+
+    //! waits until all submitted jobs are done, and keeps the worker threads alive.
+    void flush(void)
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        while( numberOfPending_ > 0 )
+        {
+            condDone_.wait(lock);
+        }
+    }
+
+private:
+    //! takes jobs from the queue and runs them until \c wait() is called.
+    void run(void)
+    {
+        while( true )
+        {
+            std::pair<Job, std::string> job;
+            {
+                boost::mutex::scoped_lock lock(mutex_);
+                while( queue_.empty() && !flagStop_ )
+                {
+                    condJob_.wait(lock);
+                }
+                if( queue_.empty() )
+                {
+                    return;
+                }
+                job = queue_.front();
+                queue_.pop_front();
+            }
+
+            boost::posix_time::ptime timeStart = boost::posix_time::microsec_clock::local_time();
+            bool flagSuccess = job.first();
+            boost::posix_time::time_duration duration = boost::posix_time::microsec_clock::local_time() - timeStart;
+
+            boost::mutex::scoped_lock lock(mutex_);
+            std::cout << "[AsyncWriter] " << (flagSuccess ? "wrote " : "FAILED to write ") << job.second << " in " << duration.total_milliseconds() << " ms" << std::endl;
+            if( !flagSuccess )
+            {
+                ++numberOfFailed_;
+            }
+            --numberOfPending_;
+            condDone_.notify_all();
+        }
+    }
+
+    //! Queue of jobs and their names.
+    std::deque< std::pair<Job, std::string> > queue_;
+    //! Worker threads.
+    boost::thread_group threads_;
+    //! Mutex guarding all members.
+    boost::mutex mutex_;
+    //! Notified when a job is submitted or the writer stops.
+    boost::condition_variable condJob_;
+    //! Notified when a job is done.
+    boost::condition_variable condDone_;
+    //! Flag to stop worker threads.
+    bool flagStop_;
+    //! The number of submitted but unfinished jobs.
+    int numberOfPending_;
+    //! The number of failed jobs.
+    int numberOfFailed_;
+};
+
+/*!
+ * \class ImageWriteJob
+ *
+ * \brief is a write job of an image, which owns the image buffer until it is written.
+ *
+ */
+template <typename DataType = float>
+struct ImageWriteJob
+{
+    ImageWriteJob(
+        const boost::shared_ptr< cimg_library::CImg<DataType> >& img_,
+        const std::string& strSave_,
+        const std::vector<std::string>& formats_,
+        const DataType scale_,
+        const DataType offset_,
+        const ImageRegion& region_
+    ):
+        img(img_),
+        strSave(strSave_),
+        formats(formats_),
+        scale(scale_),
+        offset(offset_),
+        region(region_)
+    {}
+    bool operator()(void) const
+    {
+        return saveImageFormats( *img, strSave, formats, scale, offset, region );
+    }
+    boost::shared_ptr< cimg_library::CImg<DataType> > img;
+    std::string strSave;
+    std::vector<std::string> formats;
+    DataType scale;
+    DataType offset;
+    ImageRegion region;
+};
+
+//! submits \c img to \c writer to save it in each of \c formats. \c img is swapped into the job and left empty, i.e., the writer takes its ownership. RAW also stores \c region of a cropped image.
+template <typename DataType>
+inline void submitImage(
+    AsyncWriter& writer,
+    cimg_library::CImg<DataType>& img,
+    const std::string& strSave,
+    const std::vector<std::string>& formats,
+    const DataType scale = (DataType)1,
+    const DataType offset = (DataType)0,
+    const ImageRegion& region = ImageRegion()
+)
+{
+    boost::shared_ptr< cimg_library::CImg<DataType> > ptr( new cimg_library::CImg<DataType>() );
+    ptr->swap( img );
+    writer.submit(
+        ImageWriteJob<DataType>( ptr, strSave, formats, scale, offset, region ),
+        strSave
+    );
+}
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef __CHROMATICITY_H__
+#define __CHROMATICITY_H__
+
+/*!
+ * \file Chromaticity.hpp
+ *
+ * \date 2026/10/18
+ * \brief This file contains the chromaticity-aware color solve, which solves the geometry of a pixel once and its albedo per color channel.
+ *
+ * A colored Lambertian pixel observes I_c = rho_c n^T L in each channel c, i.e., all channels share the normal n and differ only by the albedo rho_c.
+ * The geometry is solved once on the luminance Y, the mean of the channels, instead of once per channel, so that S is p x 3 instead of pc x 3.
+ * Given the unit normal n and the shading s = n^T L (or n^T L_p of near lights) of a pixel, the albedo of each channel is its least squares fit rho_c = (I_c . s) / (s . s) over the valid samples.
+ *
+ */
+
+// STL
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+// Eigen
+#include <Eigen/Core>
+
+// internal headers
+#include "DataStructure.hpp"
+
+namespace CPS
+{
+
+//! returns the luminance \c Y (p x f) of \c I (pc x f), i.e., the mean of its color channels, which weights all channels equally.
+template <typename DataType>
+inline Eigen::Matrix<DataType, -1, -1> computeLuminance(
+    const Eigen::Matrix<DataType, -1, -1>& I,
+    const int numberOfPixels,
+    const int color
+)
+{
+    Eigen::Matrix<DataType, -1, -1> Y = I.topRows( numberOfPixels );
+    for(int c = 1; c < color; ++c)
+    {
+        Y += I.middleRows( c*numberOfPixels, numberOfPixels );
+    }
+    Y /= (DataType)color;
+
+    return Y;
+}
+
+//! estimates the albedo \c R (1 x pc) of each color channel of the pixels observed in \c I, given the shading predicted by \c shading (1 x f) of each pixel, e.g., \c PredictorLambertian of the unit normals. Invalid samples of \c validity, if given, are excluded.
+template <typename DataType, typename Shading>
+inline Eigen::Matrix<DataType, -1, -1> estimateSurfaceAlbedoShading(
+    const Eigen::Matrix<DataType, -1, -1>& I,
+    const Shading& shading,
+    const int numberOfPixels,
+    const int color,
+    const ValidityMask* validity = NULL
+)
+{
+    Eigen::Matrix<DataType, -1, -1> R = Eigen::Matrix<DataType, -1, -1>::Zero( 1, I.rows() );
+    bool flagValidity = ( validity != NULL && validity->numberOfPixels() > 0 );
+    int numberOfImages = I.cols();
+    DataType tol = std::numeric_limits<DataType>::epsilon();
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        Shading shadingLocal( shading );
+        Eigen::Matrix<DataType, -1, -1> s( 1, numberOfImages );
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+        for(int p = 0; p < numberOfPixels; ++p)
+        { // p means "p"ixel
+            shadingLocal( p, s );
+            if( flagValidity )
+            {
+                for(int f = 0; f < numberOfImages; ++f)
+                { // f means "f"rame
+                    if( !validity->isValid(p, f) )
+                    {
+                        s(0,f) = (DataType)0;
+                    }
+                }
+            }
+            DataType sumSquare = s.squaredNorm();
+            if( sumSquare <= tol )
+            {
+                continue;
+            }
+            for(int c = 0; c < color; ++c)
+            { // c means "c"olor
+                int i = c*numberOfPixels+p;
+                R(i) = std::max( I.row(i).dot( s.row(0) ) / sumSquare, (DataType)0 );
+            }
+        }
+    }
+
+    return R;
+}
+
+/*!
+ * \class PredictorChromaticity
+ *
+ * \brief predicts observation of a pixel by the albedo of each color channel times the shading of the pixel, i.e., the result of the chromaticity-aware color solve.
+ *
+ */
+template <typename DataType, typename Shading>
+class PredictorChromaticity
+{
+public:
+    PredictorChromaticity(
+        const Shading& shading,
+        const Eigen::Matrix<DataType, -1, -1>& R,
+        const int numberOfPixels,
+        const int color
+    ):
+        shading_(shading),
+        R_(R),
+        numberOfPixels_(numberOfPixels),
+        color_(color)
+    {}
+    //! predicts observation \c obs (color x f) of pixel \c p.
+    void operator()(
+        const int p,
+        Eigen::Matrix<DataType, -1, -1>& obs
+    )
+    {
+        s_.resize( 1, obs.cols() );
+        shading_( p, s_ );
+        for(int c = 0; c < color_; ++c)
+        {
+            obs.row(c).noalias() = R_(c*numberOfPixels_+p) * s_;
+        }
+    }
+private:
+    Shading shading_;
+    const Eigen::Matrix<DataType, -1, -1>& R_;
+    int numberOfPixels_;
+    int color_;
+    Eigen::Matrix<DataType, -1, -1> s_;
+};
+
+} // end of namespace CPS
+
+#endif
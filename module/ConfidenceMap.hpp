@@ -0,0 +1,118 @@
+#ifndef __CONFIDENCEMAP_H__
+#define __CONFIDENCEMAP_H__
+
+/*!
+ * \file ConfidenceMap.hpp
+ *
+ * \date 2026/10/18
+ * \brief This file contains the per-pixel confidence map of the solved surface, which is built from by-products of the solve instead of another pass over the observations.
+ *
+ * The confidence map (p x 3) has 3 channels of each pixel;
+ * - the number of active lights, i.e., the valid samples solving the pixel
+ * - the reciprocal condition number of the light matrix of the active lights, i.e., sqrt(lambda_min / lambda_max) of its normal matrix, which is 1 for orthogonal lights of equal intensity and 0 for degenerate lights
+ * - the normalized residual, i.e., the RMS residual over the active lights and all channels divided by the RMS observation of the same samples
+ *
+ */
+
+// STL
+#include <vector>
+#include <string>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+// Eigen
+#include <Eigen/Core>
+#include <Eigen/Eigenvalues>
+
+// internal headers
+#include "DataStructure.hpp"
+
+namespace CPS
+{
+
+//! returns the reciprocal condition number of a light matrix given its normal matrix \c M (3 x 3), i.e., sqrt(lambda_min / lambda_max) of \c M, or 0 if \c M is singular.
+template <typename DataType>
+inline DataType computeReciprocalCondition(
+    const Eigen::Matrix<DataType, 3, 3>& M
+)
+{
+    Eigen::SelfAdjointEigenSolver< Eigen::Matrix<DataType, 3, 3> > eigen;
+    eigen.computeDirect( M, Eigen::EigenvaluesOnly );
+    DataType lambdaMax = eigen.eigenvalues()(2);
+    DataType lambdaMin = eigen.eigenvalues()(0);
+    if( !( lambdaMax > (DataType)0 ) || !( lambdaMin > (DataType)0 ) )
+    {
+        return (DataType)0;
+    }
+    return std::sqrt( lambdaMin / lambdaMax );
+}
+
+//! returns \c true if the normal matrix \c M (3 x 3) of \c numberOfValid valid samples is solvable, i.e., at least 3 samples are valid and its determinant is not below a small fraction of its scale, i.e., the cube of its trace. All solvers share this test, so that they agree on which pixels are set to zero.
+template <typename DataType>
+inline bool isSolvable(
+    const Eigen::Matrix<DataType, 3, 3>& M,
+    const int numberOfValid
+)
+{
+    const DataType tolDeterminant = std::numeric_limits<DataType>::epsilon() * (DataType)16;
+    DataType trace = M.trace();
+    return numberOfValid >= 3 && M.determinant() > tolDeterminant * trace * trace * trace;
+}
+
+//! builds the confidence map (p x 3) of \c numberOfPixels pixels given the reciprocal condition numbers \c conditioning of the first p rows of S, the valid samples \c validity of \c numberOfImages lights, if given, and RMS residual \c rmsResidual and RMS observation \c rmsObservation of each row (pc) of I.
+template <typename DataType>
+inline Eigen::Matrix<DataType, -1, -1> buildConfidence(
+    const Eigen::Matrix<DataType, -1, 1>& conditioning,
+    const ValidityMask* validity,
+    const int numberOfImages,
+    const Eigen::Matrix<DataType, -1, 1>& rmsResidual,
+    const Eigen::Matrix<DataType, -1, 1>& rmsObservation,
+    const int numberOfPixels,
+    const int color
+)
+{
+    Eigen::Matrix<DataType, -1, -1> confidence( numberOfPixels, 3 );
+    bool flagValidity = ( validity != NULL && validity->numberOfPixels() > 0 );
+
+    for(int p = 0; p < numberOfPixels; ++p)
+    { // p means "p"ixel
+        double sumSquareResidual = 0.0;
+        double sumSquareObservation = 0.0;
+        for(int c = 0; c < color; ++c)
+        { // c means "c"olor
+            int i = c*numberOfPixels+p;
+            sumSquareResidual += (double)rmsResidual(i) * rmsResidual(i);
+            sumSquareObservation += (double)rmsObservation(i) * rmsObservation(i);
+        }
+        confidence(p,0) = (DataType)( flagValidity ? validity->numberOfValid(p) : numberOfImages );
+        confidence(p,1) = conditioning(p);
+        confidence(p,2) = sumSquareObservation > 0.0 ? (DataType)std::sqrt( sumSquareResidual / sumSquareObservation ) : (DataType)0;
+    }
+
+    return confidence;
+}
+
+//! returns the formats of \c formats storing floating point values, i.e., all but PNG, or NPY if none, in which the confidence map is written.
+inline std::vector<std::string> confidenceFormats(
+    const std::vector<std::string>& formats
+)
+{
+    std::vector<std::string> formatsFloat;
+    for(size_t n = 0; n < formats.size(); ++n)
+    {
+        if( formats[n] != "PNG" )
+        {
+            formatsFloat.push_back( formats[n] );
+        }
+    }
+    if( formatsFloat.empty() )
+    {
+        formatsFloat.push_back( "NPY" );
+    }
+    return formatsFloat;
+}
+
+} // end of namespace CPS
+
+#endif
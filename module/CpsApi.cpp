@@ -0,0 +1,186 @@
+/*!
+ * \file CpsApi.cpp
+ *
+ * \date 2026/10/18
+ * \brief This file contains the implementation of the C API of libcps declared in CpsApi.h.
+ *
+ */
+
+// STL
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <new>
+#include <exception>
+
+// Eigen
+#include <Eigen/Core>
+
+// internal headers
+#include "CpsApi.h"
+#include "SurfaceSolver.hpp"
+
+int cpsApiVersion(void)
+{
+    return CPS_API_VERSION;
+}
+
+void cpsInitInput(CpsInput* input)
+{
+    if( input == NULL )
+    {
+        return;
+    }
+    input->width = 0;
+    input->height = 0;
+    input->channels = 0;
+    input->numberOfImages = 0;
+    input->images = NULL;
+    input->mask = NULL;
+    input->lightDirections = NULL;
+    input->lightIntensities = NULL;
+    input->reflectanceModel = NULL;
+}
+
+CpsStatus cpsSolve(const CpsInput* input, CpsOutput* output)
+{
+    typedef float DataType;
+    typedef Eigen::Matrix<DataType, -1, -1> Matrix;
+
+    if( input == NULL || output == NULL ||
+        input->width <= 0 || input->height <= 0 ||
+        (input->channels != 1 && input->channels != 3) ||
+        input->images == NULL || input->lightDirections == NULL )
+    {
+        return CPS_ERROR_INVALID_ARGUMENT;
+    }
+    if( input->numberOfImages < 3 )
+    {
+        return CPS_ERROR_NOT_ENOUGH_IMAGES;
+    }
+    for(int f = 0; f < input->numberOfImages; ++f)
+    {
+        if( input->images[f] == NULL )
+        {
+            return CPS_ERROR_INVALID_ARGUMENT;
+        }
+    }
+
+    try
+    {
+        std::string strReflection( input->reflectanceModel != NULL ? input->reflectanceModel : "Lambertian" );
+        boost::shared_ptr< CPS::ReflectanceModel<DataType> > model = CPS::createReflectanceModel<DataType>( strReflection );
+        if( !model )
+        {
+            return CPS_ERROR_UNKNOWN_REFLECTANCE_MODEL;
+        }
+
+        int width = input->width;
+        int color = input->channels;
+        int numberOfImages = input->numberOfImages;
+        int sizeFrame = width * input->height;
+
+        std::vector<int> indexOfPixels;
+        indexOfPixels.reserve( sizeFrame );
+        for(int i = 0; i < sizeFrame; ++i)
+        {
+            if( input->mask == NULL || input->mask[i] != 0 )
+            {
+                indexOfPixels.push_back( i );
+            }
+        }
+        int numberOfPixels = indexOfPixels.size();
+
+        // build observation matrix and light source matrix from the buffers.
+        Matrix I( numberOfPixels*color, numberOfImages );
+        for(int f = 0; f < numberOfImages; ++f)
+        { // f means "f"rame
+            const float* ptrImage = input->images[f];
+            for(int p = 0; p < numberOfPixels; ++p)
+            { // p means "p"ixel
+                for(int c = 0; c < color; ++c)
+                { // c means "c"olor
+                    I(c*numberOfPixels+p, f) = ptrImage[indexOfPixels[p]*color+c];
+                }
+            }
+        }
+        Matrix L( 3, numberOfImages );
+        for(int f = 0; f < numberOfImages; ++f)
+        {
+            DataType intensity = input->lightIntensities != NULL ? input->lightIntensities[f] : (DataType)1;
+            for(int d = 0; d < 3; ++d)
+            { // d means "d"imension
+                L(d, f) = intensity * input->lightDirections[3*f+d];
+            }
+        }
+
+        Matrix S, R, N, Theta;
+        CPS::ResidualStatistics<DataType> stats;
+        CPS::solveSurface( I, L, *model, numberOfPixels, color, S, R, N, Theta, stats );
+
+        if( output->normal != NULL )
+        {
+            std::fill( output->normal, output->normal + 3*sizeFrame, 0.0f );
+        }
+        if( output->albedo != NULL )
+        {
+            std::fill( output->albedo, output->albedo + color*sizeFrame, 0.0f );
+        }
+        if( output->residual != NULL )
+        {
+            std::fill( output->residual, output->residual + color*sizeFrame, 0.0f );
+        }
+        for(int p = 0; p < numberOfPixels; ++p)
+        {
+            int index = indexOfPixels[p];
+            if( output->normal != NULL )
+            {
+                for(int d = 0; d < 3; ++d)
+                {
+                    output->normal[3*index+d] = N(p, d);
+                }
+            }
+            for(int c = 0; c < color; ++c)
+            {
+                if( output->albedo != NULL )
+                {
+                    output->albedo[color*index+c] = R(c*numberOfPixels+p);
+                }
+                if( output->residual != NULL )
+                {
+                    output->residual[color*index+c] = stats.rmsPixel()(c*numberOfPixels+p);
+                }
+            }
+        }
+    }
+    catch( const std::bad_alloc& )
+    {
+        return CPS_ERROR_OUT_OF_MEMORY;
+    }
+    catch( const std::exception& )
+    {
+        return CPS_ERROR_INTERNAL;
+    }
+
+    return CPS_OK;
+}
+
+const char* cpsStatusString(CpsStatus status)
+{
+    switch( status )
+    {
+    case CPS_OK:
+        return "success";
+    case CPS_ERROR_INVALID_ARGUMENT:
+        return "invalid argument";
+    case CPS_ERROR_NOT_ENOUGH_IMAGES:
+        return "at least 3 images are required";
+    case CPS_ERROR_UNKNOWN_REFLECTANCE_MODEL:
+        return "unknown reflectance model";
+    case CPS_ERROR_OUT_OF_MEMORY:
+        return "out of memory";
+    case CPS_ERROR_INTERNAL:
+        return "internal error";
+    }
+    return "unknown status";
+}
@@ -0,0 +1,93 @@
+#ifndef __CPSAPI_H__
+#define __CPSAPI_H__
+
+/*!
+ * \file CpsApi.h
+ *
+ * \date 2026/10/18
+ * \brief This file contains the C API of libcps, which solves calibrated photometric stereo from image buffers on memory, without files or processes.
+ *
+ * The API is plain C, so that it is callable from C, C++ and other languages, and its structures only grow at their end.
+ * All images are interleaved (row-major, height x width x channels) 32-bit float buffers.
+ * The light directions are in the frame of x to the right, y to the top, and z towards the camera.
+ *
+ * \code
+ * CpsInput input;
+ * cpsInitInput(&input);
+ * input.width = width; input.height = height; input.channels = 3;
+ * input.numberOfImages = F; input.images = images; input.lightDirections = directions;
+ * CpsOutput output = { normal, albedo, NULL };
+ * if( cpsSolve(&input, &output) != CPS_OK ) { ... }
+ * \endcode
+ *
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! The version of the API, which is incremented when fields are added.
+#define CPS_API_VERSION 1
+
+//! Status codes returned by \c cpsSolve().
+typedef enum
+{
+    CPS_OK = 0,
+    CPS_ERROR_INVALID_ARGUMENT = 1,
+    CPS_ERROR_NOT_ENOUGH_IMAGES = 2,
+    CPS_ERROR_UNKNOWN_REFLECTANCE_MODEL = 3,
+    CPS_ERROR_OUT_OF_MEMORY = 4,
+    CPS_ERROR_INTERNAL = 5
+} CpsStatus;
+
+//! Input of \c cpsSolve(), which is only read.
+typedef struct
+{
+    //! Image width.
+    int width;
+    //! Image height.
+    int height;
+    //! The number of color channels of each image, 1 or 3.
+    int channels;
+    //! The number of images, i.e., lights, at least 3.
+    int numberOfImages;
+    //! \c numberOfImages pointers to images of (height x width x channels).
+    const float* const* images;
+    //! Mask of (height x width), where non-zero pixels are solved, or NULL to solve all pixels.
+    const unsigned char* mask;
+    //! Light directions of (numberOfImages x 3).
+    const float* lightDirections;
+    //! Light intensities of (numberOfImages), or NULL for 1.
+    const float* lightIntensities;
+    //! Reflectance model, e.g., "Lambertian" or "Cook-Torrance", or NULL for "Lambertian".
+    const char* reflectanceModel;
+} CpsInput;
+
+//! Output of \c cpsSolve(), whose buffers are allocated by the caller. Any of them can be NULL. Pixels out of the mask are set to 0.
+typedef struct
+{
+    //! Surface normal of (height x width x 3).
+    float* normal;
+    //! Surface albedo of (height x width x channels).
+    float* albedo;
+    //! RMS reprojection error over all lights of (height x width x channels).
+    float* residual;
+} CpsOutput;
+
+//! returns \c CPS_API_VERSION of the library, which can differ from the header.
+int cpsApiVersion(void);
+
+//! initializes all fields of \c input to 0 or NULL.
+void cpsInitInput(CpsInput* input);
+
+//! solves surface normal, albedo and reprojection error of \c input into the buffers of \c output. It is thread safe, and prints nothing.
+CpsStatus cpsSolve(const CpsInput* input, CpsOutput* output);
+
+//! returns the description of \c status.
+const char* cpsStatusString(CpsStatus status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
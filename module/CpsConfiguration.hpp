@@ -8,35 +8,66 @@
  * \date 2014/05/16
  * \brief This file contains configuration loader for calibrated photometric stereo.
  *
+ * The xml file is parsed and validated by Xerces-C through the code generated by CodeSynthesis XSD, if \c WITH_XSD is defined.
+ * Its contents are cached in a plain text file (xml filename + ".cache"), which is loaded without any xml parser
+ * as long as the size and the modification time of the xml file, in nanoseconds, are unchanged.
+ * The cache is written to a temporary file and renamed over the cache, so that concurrent readers never load a partially written one.
+ *
  */
 
 // STL
 #include <vector>
 #include <string>
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <limits>
 #include <cassert>
+#include <cstdlib>
+
+// POSIX
+#include <sys/stat.h>
+
+// Boost
+#include <boost/filesystem.hpp>
 
 // internal headers
+#include "utilString.hpp"
 #include "DataStructure.hpp"
 
+#ifdef WITH_XSD
 #include "configurationCPS.hxx"
 
 //! returns configuration of calibrated photometric stereo.
-CPS::CpsConfig loadConfiguration(
-    const std::string strFile
+//! Each parse initializes and terminates Xerces-C unless \c flagInitialize is \c false, in which case the caller keeps it initialized, e.g., a daemon parsing on several threads, whose concurrent initializations would race.
+inline CPS::CpsConfig loadConfiguration(
+    const std::string strFile,
+    const bool flagInitialize = true
 )
 {
     CPS::CpsConfig cpsConfig;
     try
     {
         std::cout << "Load configuration from " << strFile << std::endl;
-        std::auto_ptr<CalibratedPhotometricStereoType> _config(CalibratedPhotometricStereo(strFile));
-        CalibratedPhotometricStereoType config( *_config );
+        xml_schema::flags flags = flagInitialize ? 0 : xml_schema::flags::dont_initialize;
+        CalibratedPhotometricStereoType config( *CalibratedPhotometricStereo(strFile, flags) );
 
         // loads directory name for outputs.
         cpsConfig.strDirOutput( config.DirectoryOutput() );
         // loads name of reflection model.
         cpsConfig.strReflection( config.ReflectanceModel() );
+        // loads formats of output images, PNG only if not specified.
+        if( config.OutputFormat() )
+        {
+            std::vector<std::string> outputFormat;
+            OutputFormatList formatList = config.OutputFormat().get();
+            for(OutputFormatList::const_iterator it = formatList.begin(); it != formatList.end(); ++it)
+            {
+                outputFormat.push_back( *it );
+            }
+            cpsConfig.outputFormat( outputFormat );
+        }
 
         // loads all observation information.
         ObservationType observationAll = config.Observation();
@@ -47,18 +78,53 @@ CPS::CpsConfig loadConfiguration(
         {
             cpsConfig.strImageMask( cpsConfig.obsAll().strDirObservation() + observationAll.ObservationMask().get() );
         }
+        // loads name of light table, which overrides light sources of each observation.
+        if( observationAll.LightTable() )
+        {
+            cpsConfig.strLightTable( cpsConfig.obsAll().strDirObservation() + observationAll.LightTable().get() );
+        }
+        // loads name of ambient image, which is subtracted from each observation.
+        if( observationAll.AmbientImage() )
+        {
+            cpsConfig.strImageAmbient( cpsConfig.obsAll().strDirObservation() + observationAll.AmbientImage().get() );
+        }
         // loads each observation information.
         ObservationType::ObservationSingle_sequence observationSingleSequence = observationAll.ObservationSingle();
         for(int n = 0; n < observationSingleSequence.size(); ++n)
         {
-            // loads name of image, light source direction, and light source intensity.
-            cpsConfig.addObservation(
-                CPS::ObservationSingle(
-                    cpsConfig.obsAll().strDirObservation() + observationSingleSequence[n].Image(),
-                    observationSingleSequence[n].LightDirection(),
-                    observationSingleSequence[n].LightIntensity()
-                )
+            // loads names of images of the other exposures and exposure times, if the observation is an exposure stack.
+            std::vector<std::string> strImageExposure;
+            std::vector<float> exposureTime;
+            if( observationSingleSequence[n].ExposureImage() )
+            {
+                StringList imageList = observationSingleSequence[n].ExposureImage().get();
+                for(StringList::const_iterator it = imageList.begin(); it != imageList.end(); ++it)
+                {
+                    strImageExposure.push_back( cpsConfig.obsAll().strDirObservation() + *it );
+                }
+            }
+            if( observationSingleSequence[n].ExposureTime() )
+            {
+                DecimalList timeList = observationSingleSequence[n].ExposureTime().get();
+                for(DecimalList::const_iterator it = timeList.begin(); it != timeList.end(); ++it)
+                {
+                    exposureTime.push_back( (float)*it );
+                }
+            }
+            // loads name of image, light source direction, and light source intensity, which can be omitted with a light table.
+            CPS::ObservationSingle obs(
+                cpsConfig.obsAll().strDirObservation() + observationSingleSequence[n].Image(),
+                observationSingleSequence[n].LightDirection() ? std::string( observationSingleSequence[n].LightDirection().get() ) : std::string(),
+                observationSingleSequence[n].LightIntensity() ? (float)observationSingleSequence[n].LightIntensity().get() : 1.0f,
+                strImageExposure,
+                exposureTime
             );
+            // loads name of flat field of the light.
+            if( observationSingleSequence[n].FlatField() )
+            {
+                obs.strImageFlat( cpsConfig.obsAll().strDirObservation() + observationSingleSequence[n].FlatField().get() );
+            }
+            cpsConfig.addObservation( obs );
         }
         // loads the number of color channels.
         cpsConfig.color( config.Observation().Color() );
@@ -70,10 +136,356 @@ CPS::CpsConfig loadConfiguration(
         std::cerr << e << std::endl;
     }
 
+    return cpsConfig;
+}
+#endif
+
+//! returns \c values separated by spaces, each of which has enough digits to be read back to the same float, e.g., exposure times.
+inline std::string toStringExact(
+    const std::vector<float>& values
+)
+{
+    std::stringstream ss;
+    ss << std::setprecision( std::numeric_limits<float>::max_digits10 );
+    for(size_t i = 0; i < values.size(); ++i)
+    {
+        ss << values[i] << " ";
+    }
+    return ss.str();
+}
+
+//! returns \c str without the prefix \c strDir, if \c str starts with \c strDir.
+inline std::string removeDirectory(
+    const std::string& str,
+    const std::string& strDir
+)
+{
+    if( !strDir.empty() && str.compare(0, strDir.size(), strDir) == 0 )
+    {
+        return str.substr(strDir.size());
+    }
+    return str;
+}
+
+//! returns \c str whose XML special characters are escaped.
+inline std::string escapeXml(
+    const std::string& str
+)
+{
+    std::string res;
+    for(size_t i = 0; i < str.size(); ++i)
+    {
+        switch( str[i] )
+        {
+        case '&': res += "&amp;"; break;
+        case '<': res += "&lt;"; break;
+        case '>': res += "&gt;"; break;
+        default: res += str[i]; break;
+        }
+    }
+    return res;
+}
+
+//! saves configuration of calibrated photometric stereo as an xml file, which follows configurationCPS.xsd.
+inline void saveConfiguration(
+    const CPS::CpsConfig& cpsConfig,
+    const std::string strFile
+)
+{
+    std::ofstream ofs( strFile.c_str() );
+    assert(
+        ofs.good() &&
+        "Cannot open the xml file to save configuration."
+    );
+    // light intensities are read back to the same floats.
+    ofs << std::setprecision( std::numeric_limits<float>::max_digits10 );
+    std::string strDir = cpsConfig.strDirObservation();
+
+    std::cout << "Save configuration to " << strFile << std::endl;
+    ofs << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>" << std::endl << std::endl;
+    ofs << "<CalibratedPhotometricStereo xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\" xsi:noNamespaceSchemaLocation=\"configurationCPS.xsd\">" << std::endl;
+    ofs << "\t<Observation>" << std::endl;
+    ofs << "\t\t<DirectoryObservation>" << escapeXml(strDir) << "</DirectoryObservation>" << std::endl;
+    if( !cpsConfig.strImageMask().empty() )
+    {
+        ofs << "\t\t<ObservationMask>" << escapeXml(removeDirectory(cpsConfig.strImageMask(), strDir)) << "</ObservationMask>" << std::endl;
+    }
+    if( !cpsConfig.strLightTable().empty() )
+    {
+        ofs << "\t\t<LightTable>" << escapeXml(removeDirectory(cpsConfig.strLightTable(), strDir)) << "</LightTable>" << std::endl;
+    }
+    if( !cpsConfig.strImageAmbient().empty() )
+    {
+        ofs << "\t\t<AmbientImage>" << escapeXml(removeDirectory(cpsConfig.strImageAmbient(), strDir)) << "</AmbientImage>" << std::endl;
+    }
+    for(int n = 0; n < cpsConfig.numberOfObservation(); ++n)
+    {
+        CPS::ObservationSingle obs = cpsConfig.observationSingle(n);
+        ofs << "\t\t<ObservationSingle>" << std::endl;
+        ofs << "\t\t\t<Image>" << escapeXml(removeDirectory(obs.strImage(), strDir)) << "</Image>" << std::endl;
+        if( obs.numberOfExposures() > 1 )
+        {
+            ofs << "\t\t\t<ExposureImage>";
+            for(int k = 1; k < obs.numberOfExposures(); ++k)
+            {
+                ofs << (k > 1 ? " " : "") << escapeXml(removeDirectory(obs.strImage(k), strDir));
+            }
+            ofs << "</ExposureImage>" << std::endl;
+        }
+        if( !obs.exposureTime().empty() )
+        {
+            ofs << "\t\t\t<ExposureTime>" << toStringExact(obs.exposureTime()) << "</ExposureTime>" << std::endl;
+        }
+        if( !obs.strImageFlat().empty() )
+        {
+            ofs << "\t\t\t<FlatField>" << escapeXml(removeDirectory(obs.strImageFlat(), strDir)) << "</FlatField>" << std::endl;
+        }
+        if( !obs.lightDirection().empty() )
+        {
+            ofs << "\t\t\t<LightDirection>" << obs.lightDirection() << "</LightDirection>" << std::endl;
+            ofs << "\t\t\t<LightIntensity>" << obs.lightIntensity() << "</LightIntensity>" << std::endl;
+        }
+        ofs << "\t\t</ObservationSingle>" << std::endl;
+    }
+    ofs << "\t\t<Color>" << cpsConfig.color() << "</Color>" << std::endl;
+    ofs << "\t</Observation>" << std::endl;
+    ofs << "\t<ReflectanceModel>" << cpsConfig.strReflection() << "</ReflectanceModel>" << std::endl;
+    ofs << "\t<DirectoryOutput>" << escapeXml(cpsConfig.strDirOutput()) << "</DirectoryOutput>" << std::endl;
+    ofs << "\t<OutputFormat>" << toString(cpsConfig.outputFormat()) << "</OutputFormat>" << std::endl;
+    ofs << "</CalibratedPhotometricStereo>" << std::endl;
+}
+
+//! returns a stamp of \c strFile, i.e., its size and modification time in nanoseconds, which changes when the file is edited, even twice within a second, or an empty string if it does not exist.
+inline std::string stampFile(
+    const std::string strFile
+)
+{
+    struct stat status;
+    if( stat( strFile.c_str(), &status ) != 0 )
+    {
+        return "";
+    }
+    return toString( (long long)status.st_size ) + " " + toString( (long long)status.st_mtim.tv_sec ) + "." + toString( (long long)status.st_mtim.tv_nsec );
+}
+
+//! saves configuration of calibrated photometric stereo as a plain text file, which is loaded by \c loadConfigurationText(). \c strStamp identifies the source xml file.
+inline bool saveConfigurationText(
+    const CPS::CpsConfig& cpsConfig,
+    const std::string strFile,
+    const std::string strStamp = ""
+)
+{
+    std::ofstream ofs( strFile.c_str() );
+    if( !ofs.good() )
+    {
+        return false;
+    }
+    // light intensities are read back to the same floats, so that the cache solves as the xml file.
+    ofs << std::setprecision( std::numeric_limits<float>::max_digits10 );
+    ofs << "CPSCONFIG 1" << std::endl;
+    ofs << "Stamp " << strStamp << std::endl;
+    ofs << "DirectoryObservation " << cpsConfig.strDirObservation() << std::endl;
+    ofs << "ObservationMask " << cpsConfig.strImageMask() << std::endl;
+    if( !cpsConfig.strLightTable().empty() )
+    {
+        ofs << "LightTable " << cpsConfig.strLightTable() << std::endl;
+    }
+    if( !cpsConfig.strImageAmbient().empty() )
+    {
+        ofs << "AmbientImage " << cpsConfig.strImageAmbient() << std::endl;
+    }
+    ofs << "Color " << cpsConfig.color() << std::endl;
+    ofs << "ReflectanceModel " << cpsConfig.strReflection() << std::endl;
+    ofs << "DirectoryOutput " << cpsConfig.strDirOutput() << std::endl;
+    ofs << "OutputFormat " << toString(cpsConfig.outputFormat()) << std::endl;
+    // each observation is a tab separated line of image, light direction and light intensity, followed by exposure times and images of the other exposures if it is an exposure stack, and a line of its flat field if given.
+    for(int n = 0; n < cpsConfig.numberOfObservation(); ++n)
+    {
+        CPS::ObservationSingle obs = cpsConfig.observationSingle(n);
+        ofs << "ObservationSingle " << obs.strImage() << "\t" << obs.lightDirection() << "\t" << obs.lightIntensity();
+        if( obs.numberOfExposures() > 1 || !obs.exposureTime().empty() )
+        {
+            ofs << "\t" << toStringExact(obs.exposureTime());
+            for(int k = 1; k < obs.numberOfExposures(); ++k)
+            {
+                ofs << "\t" << obs.strImage(k);
+            }
+        }
+        ofs << std::endl;
+        if( !obs.strImageFlat().empty() )
+        {
+            ofs << "FlatField " << obs.strImageFlat() << std::endl;
+        }
+    }
+    ofs << "End" << std::endl;
+    ofs.close();
+
+    return !ofs.fail();
+}
+
+//! reads configuration of calibrated photometric stereo in the plain text format of \c saveConfigurationText() from \c ifs until its "End" line. returns \c false if the text is invalid or its stamp differs from \c strStamp (unless \c strStamp is empty).
+inline bool readConfigurationText(
+    std::istream& ifs,
+    CPS::CpsConfig& cpsConfig,
+    const std::string strStamp = ""
+)
+{
+    std::string line;
+    if( !std::getline(ifs, line) || line != "CPSCONFIG 1" )
+    {
+        return false;
+    }
+
+    std::vector<CPS::ObservationSingle> observation;
+    std::vector<std::string> outputFormat;
+    bool flagEnd = false;
+    while( std::getline(ifs, line) )
+    {
+        std::string::size_type pos = line.find(' ');
+        std::string key = line.substr(0, pos);
+        std::string value = (pos == std::string::npos) ? "" : line.substr(pos+1);
+        if( key == "Stamp" )
+        {
+            if( !strStamp.empty() && value != strStamp )
+            {
+                return false;
+            }
+        }
+        else if( key == "DirectoryObservation" ) cpsConfig.strDirObservation( value );
+        else if( key == "ObservationMask" ) cpsConfig.strImageMask( value );
+        else if( key == "LightTable" ) cpsConfig.strLightTable( value );
+        else if( key == "AmbientImage" ) cpsConfig.strImageAmbient( value );
+        else if( key == "Color" ) cpsConfig.color( std::atoi(value.c_str()) );
+        else if( key == "ReflectanceModel" ) cpsConfig.strReflection( value );
+        else if( key == "DirectoryOutput" ) cpsConfig.strDirOutput( value );
+        else if( key == "OutputFormat" )
+        {
+            std::istringstream iss( value );
+            std::string strFormat;
+            while( iss >> strFormat )
+            {
+                outputFormat.push_back( strFormat );
+            }
+        }
+        else if( key == "ObservationSingle" )
+        {
+            std::string::size_type posDirection = value.find('\t');
+            std::string::size_type posIntensity = value.find('\t', posDirection+1);
+            if( posDirection == std::string::npos || posIntensity == std::string::npos )
+            {
+                return false;
+            }
+            std::vector<std::string> fields;
+            for(std::string::size_type pos = value.find('\t', posIntensity+1); pos != std::string::npos; )
+            {
+                std::string::size_type posNext = value.find('\t', pos+1);
+                fields.push_back( value.substr(pos+1, posNext == std::string::npos ? std::string::npos : posNext-pos-1) );
+                pos = posNext;
+            }
+            std::vector<float> exposureTime;
+            if( !fields.empty() )
+            {
+                if( !fields[0].empty() )
+                {
+                    exposureTime = str2vector<float>( fields[0] );
+                }
+                fields.erase( fields.begin() );
+            }
+            observation.push_back(
+                CPS::ObservationSingle(
+                    value.substr(0, posDirection),
+                    value.substr(posDirection+1, posIntensity-posDirection-1),
+                    (float)std::atof( value.c_str()+posIntensity+1 ),
+                    fields,
+                    exposureTime
+                )
+            );
+        }
+        else if( key == "FlatField" )
+        {
+            if( observation.empty() )
+            {
+                return false;
+            }
+            observation.back().strImageFlat( value );
+        }
+        else if( key == "End" )
+        {
+            flagEnd = true;
+            break;
+        }
+    }
+    cpsConfig.observation( observation );
+    cpsConfig.outputFormat( outputFormat );
+
+    return flagEnd;
+}
+
+//! loads configuration of calibrated photometric stereo from a plain text file saved by \c saveConfigurationText(). returns \c false if the file is invalid or its stamp differs from \c strStamp (unless \c strStamp is empty).
+inline bool loadConfigurationText(
+    const std::string strFile,
+    CPS::CpsConfig& cpsConfig,
+    const std::string strStamp = ""
+)
+{
+    std::ifstream ifs( strFile.c_str() );
+
+    return readConfigurationText( ifs, cpsConfig, strStamp );
+}
+
+//! returns configuration of calibrated photometric stereo, given either an xml file or a plain text file (.cps).
+//! The xml file is parsed and validated only if its cache (\c strFile + ".cache") does not exist or its stamp differs from that of the xml file, see \c stampFile(). \c flagInitialize is passed to \c loadConfiguration().
+inline CPS::CpsConfig loadConfigurationCached(
+    const std::string strFile,
+    const bool flagUseCache = true,
+    const bool flagInitialize = true
+)
+{
+    CPS::CpsConfig cpsConfig;
+    if( boost::filesystem::path(strFile).extension() == ".cps" )
+    {
+        std::cout << "Load configuration from " << strFile << std::endl;
+        if( !loadConfigurationText( strFile, cpsConfig ) )
+        {
+            std::cerr << "Invalid configuration file " << strFile << std::endl;
+        }
+        return cpsConfig;
+    }
+
+    std::string strFileCache = strFile + ".cache";
+    std::string strStamp = stampFile( strFile );
+    if( flagUseCache && !strStamp.empty() && loadConfigurationText( strFileCache, cpsConfig, strStamp ) )
+    {
+        std::cout << "Load configuration from " << strFileCache << std::endl;
+        return cpsConfig;
+    }
+
+#ifdef WITH_XSD
+    cpsConfig = loadConfiguration( strFile, flagInitialize );
+    if( flagUseCache && cpsConfig.numberOfObservation() > 0 )
+    {
+        // another process may load the cache while it is written, e.g., a daemon worker, which only sees the old or the new cache by the rename.
+        std::string strFileTemporary = strFileCache + boost::filesystem::unique_path( ".%%%%-%%%%-%%%%.tmp" ).string();
+        boost::system::error_code ec;
+        bool flagSaved = saveConfigurationText( cpsConfig, strFileTemporary, strStamp );
+        if( flagSaved )
+        {
+            boost::filesystem::rename( strFileTemporary, strFileCache, ec );
+        }
+        if( !flagSaved || ec )
+        {
+            boost::filesystem::remove( strFileTemporary, ec );
+        }
+    }
+#else
+    std::cerr << "No valid cache of " << strFile << ", and this build cannot parse xml files (WITH_XSD is not defined)." << std::endl;
+#endif
+
+    return cpsConfig;
 }
 
 //! shows loaded configuration of calibrated photometric stereo.
-void showConfiguration(
+inline void showConfiguration(
     const CPS::CpsConfig& cpsConfig
 )
 {
@@ -81,7 +493,16 @@ void showConfiguration(
     std::cout << "  Directory for input:  " << cpsConfig.strDirObservation() << std::endl;
     std::cout << "  Directory for output: " << cpsConfig.strDirOutput() << std::endl;
     std::cout << "  Reflectance model: " << cpsConfig.strReflection() << std::endl;
+    std::cout << "  Output format: " << toString(cpsConfig.outputFormat()) << std::endl;
     std::cout << "  Image mask: " << cpsConfig.strImageMask() << std::endl;
+    if( !cpsConfig.strLightTable().empty() )
+    {
+        std::cout << "  Light table: " << cpsConfig.strLightTable() << std::endl;
+    }
+    if( !cpsConfig.strImageAmbient().empty() )
+    {
+        std::cout << "  Ambient image: " << cpsConfig.strImageAmbient() << std::endl;
+    }
     std::cout << "  Total number of images is " << cpsConfig.numberOfObservation() << std::endl;
     std::cout << "  Number of color channel is " << cpsConfig.color() << std::endl;
     for(int n = 0; n < cpsConfig.numberOfObservation(); ++n)
@@ -90,6 +511,14 @@ void showConfiguration(
         std::cout << "      " << cpsConfig.observationSingle(n).strImage() << std::endl;
         std::cout << "      " << cpsConfig.observationSingle(n).lightDirection() << std::endl;
         std::cout << "      " << cpsConfig.observationSingle(n).lightIntensity() << std::endl;
+        for(int k = 1; k < cpsConfig.observationSingle(n).numberOfExposures(); ++k)
+        {
+            std::cout << "      " << cpsConfig.observationSingle(n).strImage(k) << " (exposure " << cpsConfig.observationSingle(n).exposureTime(k) << ")" << std::endl;
+        }
+        if( !cpsConfig.observationSingle(n).strImageFlat().empty() )
+        {
+            std::cout << "      " << cpsConfig.observationSingle(n).strImageFlat() << " (flat field)" << std::endl;
+        }
     }
 }
 
@@ -0,0 +1,479 @@
+#ifndef __CPSDAEMON_H__
+#define __CPSDAEMON_H__
+
+/*!
+ * \file CpsDaemon.hpp
+ *
+ * \date 2026/10/18
+ * \brief This file contains a daemon, which keeps workers, parsed configurations and the heap alive, and solves jobs received over a Unix domain socket.
+ *
+ * The protocol is line based. A client sends one of the following requests, and the daemon answers with lines ended by "DONE" or "ERROR".
+ * \code
+ * PING                              -> PONG
+ * SOLVE /path/to/config.xml         -> STAGE <name> <ms> ..., OUTPUT <file> ..., DONE <status> <ms>
+ * CPSCONFIG 1 ... End               -> same as SOLVE, given the lines of a .cps file (lights and image paths) inline
+ * SHUTDOWN                          -> BYE, and the daemon exits after running jobs
+ * \endcode
+ * Concurrent jobs share the memory limit, i.e., each job plans its memory within the limit divided by the number of workers, and jobs writing to the same DirectoryOutput run one after another.
+ * Requests are read on the event loop, and only jobs occupy the workers, so that idle connections do not block the jobs of others. SHUTDOWN closes the idle connections, and the others after their jobs.
+ * A connection can send several requests one after another, e.g.,
+ * \code
+ * printf 'SOLVE data/config/cat.xml\n' | socat - UNIX-CONNECT:/tmp/cps.sock
+ * \endcode
+ *
+ */
+
+// STL
+#include <map>
+#include <set>
+#include <algorithm>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <utility>
+#include <cstdio>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+// Boost
+#include <boost/asio.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#ifdef WITH_XSD
+#include <xercesc/util/PlatformUtils.hpp>
+#endif
+
+// internal headers
+#include "utilFile.hpp"
+#include "CpsConfiguration.hpp"
+#include "CpsPipeline.hpp"
+
+namespace CPS
+{
+
+/*!
+ * \class ConfigurationCache
+ *
+ * \brief keeps parsed configurations on memory, and parses a file again only if its size or modification time changes.
+ *
+ */
+class ConfigurationCache
+{
+public:
+    //! returns configuration of \c strFile, and sets \c flagHit if it is on memory. An xml file is parsed without initializing Xerces-C, which the owner keeps initialized, e.g., \c CpsDaemon.
+    CpsConfig get(
+        const std::string& strFile,
+        bool& flagHit
+    )
+    {
+        std::string strStamp = stampFile( strFile );
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            std::map< std::string, std::pair<std::string, CpsConfig> >::const_iterator it = cache_.find( strFile );
+            flagHit = ( it != cache_.end() && !strStamp.empty() && it->second.first == strStamp );
+            if( flagHit )
+            {
+                return it->second.second;
+            }
+        }
+
+        CpsConfig config = loadConfigurationCached( strFile, true, false );
+        if( config.numberOfObservation() > 0 )
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            cache_[strFile] = std::make_pair( strStamp, config );
+        }
+        return config;
+    }
+private:
+    //! Configurations and stamps of their files.
+    std::map< std::string, std::pair<std::string, CpsConfig> > cache_;
+    //! Mutex guarding \c cache_.
+    boost::mutex mutex_;
+};
+
+/*!
+ * \class CpsDaemon
+ *
+ * \brief accepts connections on a Unix domain socket, reads their requests on an event loop, and solves their jobs on a pool of worker threads.
+ *
+ */
+template <typename DataType = float>
+class CpsDaemon
+{
+public:
+    typedef boost::asio::local::stream_protocol Protocol;
+
+    //--------------------------------------------------------
+    //
+    //! \name Constructors / Destructor / Instance Management
+    //@{
+    //--------------------------------------------------------
+    //! Destructor.
+    ~CpsDaemon()
+    {
+        boost::system::error_code error;
+        acceptor_.close(error);
+        boost::filesystem::remove( strSocket_, error );
+#ifdef WITH_XSD
+        xercesc::XMLPlatformUtils::Terminate();
+#endif
+    }
+    //! Constructor, which listens on \c strSocket, and solves jobs by \c numberOfWorkers threads with \c option.
+    CpsDaemon(
+        const std::string& strSocket,
+        const int numberOfWorkers,
+        const PipelineOption& option
+    ):
+        strSocket_(strSocket),
+        numberOfWorkers_(numberOfWorkers),
+        option_(option),
+        workers_(numberOfWorkers),
+        flagStopped_(false),
+        acceptor_(ioService_)
+    {
+#ifdef __GLIBC__
+        // keep large matrices in the heap after they are freed, so that the next job reuses them instead of mapping new pages.
+        mallopt( M_MMAP_THRESHOLD, 1 << 30 );
+        mallopt( M_TRIM_THRESHOLD, -1 );
+#endif
+#ifdef WITH_XSD
+        // initialized once for all workers, whose xml parses do not initialize and terminate Xerces-C (see ConfigurationCache), since its reference count is not thread-safe.
+        xercesc::XMLPlatformUtils::Initialize();
+#endif
+        option_.flagDisplay = false;
+        // each of the concurrent jobs plans its memory within its share of the limit.
+        option_.memoryLimit = ( option_.memoryLimit > 0 ? option_.memoryLimit : readMemoryLimit() ) / std::max( numberOfWorkers_, 1 );
+
+        boost::system::error_code error;
+        boost::filesystem::remove( strSocket_, error );
+        acceptor_.open( Protocol() );
+        acceptor_.bind( Protocol::endpoint(strSocket_) );
+        acceptor_.listen();
+    }
+    //@}
+
+    //! runs until a client sends SHUTDOWN, and returns after all running jobs.
+    int run(void)
+    {
+        std::cout << "[CpsDaemon] listening on " << strSocket_ << " with " << numberOfWorkers_ << " worker(s) of " << formatMemorySize( option_.memoryLimit ) << " each" << std::endl;
+
+        accept();
+        ioService_.run();
+        // the event loop returns once SHUTDOWN has closed the acceptor and the idle connections, while jobs may still be running.
+        workers_.join();
+
+        std::cout << "[CpsDaemon] stopped" << std::endl;
+        return 0;
+    }
+
+private:
+    /*!
+     * \struct Connection
+     *
+     * \brief represents a connection, whose requests are read on the event loop, and whose jobs are solved by a worker, one at a time.
+     *
+     */
+    struct Connection
+    {
+        Connection(boost::asio::io_context& ioService): socket(ioService){}
+        //! Socket of the client.
+        Protocol::socket socket;
+        //! Received bytes, which are not read yet.
+        boost::asio::streambuf buffer;
+        //! Lines of an inline configuration until its "End" line, or empty.
+        std::string strConfig;
+        //! Time when the inline configuration started.
+        boost::posix_time::ptime timeStart;
+    };
+    typedef boost::shared_ptr<Connection> ConnectionPtr;
+
+    //! accepts the next connection.
+    void accept(void)
+    {
+        ConnectionPtr connection( new Connection(ioService_) );
+        acceptor_.async_accept(
+            connection->socket,
+            boost::bind(&CpsDaemon::onAccept, this, connection, boost::placeholders::_1)
+        );
+    }
+
+    //! reads the first request of the accepted \c connection, and accepts the next one.
+    void onAccept(
+        ConnectionPtr connection,
+        const boost::system::error_code& error
+    )
+    {
+        if( error )
+        {
+            return;
+        }
+        read( connection );
+        accept();
+    }
+
+    //! sends \c line to \c socket, ignoring errors of disconnected clients.
+    static void send(
+        Protocol::socket& socket,
+        const std::string& line
+    )
+    {
+        boost::system::error_code error;
+        boost::asio::write( socket, boost::asio::buffer(line + "\n"), error );
+    }
+
+    //! sends a stage and its time to \c socket.
+    static void sendStage(
+        Protocol::socket* socket,
+        const std::string& stage,
+        const double msec
+    )
+    {
+        char str[32];
+        std::sprintf(str, " %.3f", msec);
+        send( *socket, "STAGE " + stage + str );
+    }
+
+    //! sends a written output file to \c socket.
+    static void sendOutput(
+        Protocol::socket* socket,
+        const std::string& strFile
+    )
+    {
+        send( *socket, "OUTPUT " + strFile );
+    }
+
+    //! closes \c connection.
+    static void close(
+        ConnectionPtr connection
+    )
+    {
+        boost::system::error_code error;
+        connection->socket.shutdown( Protocol::socket::shutdown_both, error );
+        connection->socket.close( error );
+    }
+
+    //! waits for the next line of \c connection on the event loop, which keeps it idle, i.e., closed by SHUTDOWN, until the line arrives.
+    void read(
+        ConnectionPtr connection
+    )
+    {
+        if( flagStopped_ )
+        {
+            close( connection );
+            return;
+        }
+        idle_.insert( connection );
+        boost::asio::async_read_until(
+            connection->socket,
+            connection->buffer,
+            '\n',
+            boost::bind(&CpsDaemon::onRead, this, connection, boost::placeholders::_1)
+        );
+    }
+
+    //! answers a line of \c connection on the event loop, or passes its job to a worker, which reads the next line after the job.
+    void onRead(
+        ConnectionPtr connection,
+        const boost::system::error_code& error
+    )
+    {
+        idle_.erase( connection );
+        if( flagStopped_ || ( error && connection->buffer.size() == 0 ) )
+        {
+            if( !flagStopped_ && !connection->strConfig.empty() )
+            {
+                send( connection->socket, "ERROR invalid inline configuration" );
+            }
+            close( connection );
+            return;
+        }
+
+        std::istream is( &connection->buffer );
+        std::string line;
+        std::getline( is, line );
+        if( !line.empty() && line[line.size()-1] == '\r' )
+        {
+            line.erase( line.size()-1 );
+        }
+
+        if( !connection->strConfig.empty() )
+        {
+            // the lines of an inline configuration until its "End" line.
+            connection->strConfig += line + "\n";
+            if( line == "End" )
+            {
+                std::string strConfig;
+                strConfig.swap( connection->strConfig );
+                boost::asio::post( workers_, boost::bind(&CpsDaemon::solveText, this, connection, strConfig) );
+                return;
+            }
+        }
+        else if( line == "PING" )
+        {
+            send( connection->socket, "PONG" );
+        }
+        else if( line == "SHUTDOWN" )
+        {
+            send( connection->socket, "BYE" );
+            stop();
+            close( connection );
+            return;
+        }
+        else if( line.compare(0, 6, "SOLVE ") == 0 )
+        {
+            boost::asio::post( workers_, boost::bind(&CpsDaemon::solveFile, this, connection, line.substr(6), boost::posix_time::microsec_clock::local_time()) );
+            return;
+        }
+        else if( line == "CPSCONFIG 1" )
+        {
+            connection->timeStart = boost::posix_time::microsec_clock::local_time();
+            connection->strConfig = line + "\n";
+        }
+        else if( !line.empty() )
+        {
+            send( connection->socket, "ERROR unknown request " + line );
+        }
+        read( connection );
+    }
+
+    //! solves the configuration file \c strFile of \c connection on a worker, and reads its next line on the event loop.
+    void solveFile(
+        ConnectionPtr connection,
+        const std::string& strFile,
+        const boost::posix_time::ptime& timeStart
+    )
+    {
+        if( !UtilFile::checkFileExist(strFile) )
+        {
+            send( connection->socket, "ERROR no such file " + strFile );
+        }
+        else
+        {
+            bool flagHit;
+            CpsConfig config = cache_.get( strFile, flagHit );
+            send( connection->socket, std::string("CACHE ") + (flagHit ? "hit" : "miss") );
+            sendStage( &connection->socket, "config", (boost::posix_time::microsec_clock::local_time() - timeStart).total_microseconds() / 1000.0 );
+            solve( connection->socket, config, timeStart );
+        }
+        boost::asio::post( ioService_, boost::bind(&CpsDaemon::read, this, connection) );
+    }
+
+    //! solves the inline configuration \c strConfig of \c connection on a worker, and reads its next line on the event loop.
+    void solveText(
+        ConnectionPtr connection,
+        const std::string& strConfig
+    )
+    {
+        std::istringstream iss( strConfig );
+        CpsConfig config;
+        if( !readConfigurationText( iss, config ) )
+        {
+            send( connection->socket, "ERROR invalid inline configuration" );
+        }
+        else
+        {
+            sendStage( &connection->socket, "config", (boost::posix_time::microsec_clock::local_time() - connection->timeStart).total_microseconds() / 1000.0 );
+            solve( connection->socket, config, connection->timeStart );
+        }
+        boost::asio::post( ioService_, boost::bind(&CpsDaemon::read, this, connection) );
+    }
+
+    //! solves \c config, and streams its stages and outputs to \c socket.
+    void solve(
+        Protocol::socket& socket,
+        const CpsConfig& config,
+        const boost::posix_time::ptime& timeStart
+    )
+    {
+        if( config.numberOfObservation() < 3 )
+        {
+            send( socket, "ERROR configuration must have at least 3 observations" );
+            return;
+        }
+        // jobs writing to the same directory would overwrite each other's outputs.
+        boost::mutex::scoped_lock lockDirectory( mutexDirectory( config.strDirOutput() ) );
+        PipelineOption option( option_ );
+        option.reportStage = boost::bind(&CpsDaemon::sendStage, &socket, boost::placeholders::_1, boost::placeholders::_2);
+        option.reportOutput = boost::bind(&CpsDaemon::sendOutput, &socket, boost::placeholders::_1);
+        try
+        {
+            int status = runPhotometricStereo<DataType>( config, option );
+            char str[64];
+            std::sprintf(str, "DONE %d %.3f", status, (boost::posix_time::microsec_clock::local_time() - timeStart).total_microseconds() / 1000.0);
+            send( socket, str );
+        }
+        catch( const std::exception& e )
+        {
+            send( socket, std::string("ERROR ") + e.what() );
+        }
+    }
+
+    //! returns the mutex of output directory \c strDir, which is shared by the jobs writing to it.
+    boost::mutex& mutexDirectory(
+        const std::string& strDir
+    )
+    {
+        boost::system::error_code error;
+        boost::filesystem::path path = boost::filesystem::weakly_canonical( boost::filesystem::absolute( strDir ), error );
+        if( path.filename() == "." )
+        { // a directory with a trailing separator, which does not exist yet.
+            path = path.parent_path();
+        }
+        std::string strKey = path.string();
+
+        boost::mutex::scoped_lock lock( mutexDirectories_ );
+        boost::shared_ptr<boost::mutex>& mutex = directories_[strKey];
+        if( !mutex )
+        {
+            mutex.reset( new boost::mutex );
+        }
+        return *mutex;
+    }
+
+    //! stops accepting connections, and closes the idle ones. A connection running a job is closed after the job.
+    void stop(void)
+    {
+        flagStopped_ = true;
+        boost::system::error_code error;
+        acceptor_.close(error);
+        for(typename std::set<ConnectionPtr>::const_iterator it = idle_.begin(); it != idle_.end(); ++it)
+        {
+            close( *it );
+        }
+        idle_.clear();
+    }
+
+    //! Path of the socket.
+    std::string strSocket_;
+    //! The number of worker threads.
+    int numberOfWorkers_;
+    //! Options of each job.
+    PipelineOption option_;
+    //! Parsed configurations.
+    ConfigurationCache cache_;
+    //! Mutex of each output directory of jobs.
+    std::map< std::string, boost::shared_ptr<boost::mutex> > directories_;
+    //! Mutex guarding \c directories_.
+    boost::mutex mutexDirectories_;
+    //! Event loop accepting connections and reading their requests, on which \c idle_ and \c flagStopped_ are accessed.
+    boost::asio::io_context ioService_;
+    //! Workers solving jobs.
+    boost::asio::thread_pool workers_;
+    //! Connections waiting for their next request.
+    std::set<ConnectionPtr> idle_;
+    //! Whether SHUTDOWN has been received.
+    bool flagStopped_;
+    //! Acceptor of the socket.
+    Protocol::acceptor acceptor_;
+};
+
+} // end of namespace CPS
+
+#endif
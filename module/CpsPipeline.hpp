@@ -0,0 +1,1082 @@
+#ifndef __CPSPIPELINE_H__
+#define __CPSPIPELINE_H__
+
+/*!
+ * \file CpsPipeline.hpp
+ *
+ * \date 2026/10/18
+ * \brief This file contains the whole pipeline of calibrated photometric stereo, i.e., loading observations, solving surface, and writing outputs, executed as planned by \c planMemory().
+ *
+ */
+
+// STL
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cctype>
+
+// OpenMP
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Eigen
+#include <Eigen/Core>
+
+// Boost
+#include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/thread/thread.hpp>
+
+// CImg
+#include <CImg.h>
+
+// internal headers
+#include "DataStructure.hpp"
+#include "CpsConfiguration.hpp"
+#include "PhotometricStereoSolver.hpp"
+#include "SurfaceSolver.hpp"
+#include "ReflectanceModel.hpp"
+#include "ResidualStatistics.hpp"
+#include "MemoryPlanner.hpp"
+#include "AsyncWriter.hpp"
+#include "Sharding.hpp"
+#include "LightSelection.hpp"
+#include "NearLight.hpp"
+#include "Chromaticity.hpp"
+#include "Multiplexed.hpp"
+#include "StreamingSolver.hpp"
+#include "SemiCalibrated.hpp"
+
+namespace CPS
+{
+
+/*!
+ * \class PipelineOption
+ *
+ * \brief represents options of \c runPhotometricStereo(), which are not a part of the configuration.
+ *
+ */
+struct PipelineOption
+{
+    PipelineOption(): numberOfWriterThreads(1), memoryLimit(0), flagDisplay(true), shard(0), numberOfShards(1), previewFactor(1), flagCrop(false), numberOfLights(0), saturationLevel(0.0), darkLevel(0.0), flagNearLight(false), pixelSize(1.0), falloff(2.0), flagChromaticity(false), sizeWindow(0), frameRate(0.0), flagSemiCalibrated(false), numberOfSemiCalibrationSamples(4096){}
+    //! The number of threads encoding and writing output images.
+    int numberOfWriterThreads;
+    //! The memory limit in bytes, or 0 to use \c readMemoryLimit().
+    size_t memoryLimit;
+    //! Flag to display the outputs.
+    bool flagDisplay;
+    //! The index of the shard to solve, if \c numberOfShards > 1.
+    int shard;
+    //! The number of shards, or 1 to solve all pixels.
+    int numberOfShards;
+    //! The factor decimating observations in each axis for a preview, or 1 to solve at full resolution.
+    int previewFactor;
+    //! Whether images are cropped to \c region, so that only the region is gathered, solved and written.
+    bool flagCrop;
+    //! The region to be cropped in the full resolution frame, or the bounding box of the mask if its width or height is 0.
+    ImageRegion region;
+    //! The number of lights selected to be loaded and solved, or 0 to solve all lights.
+    int numberOfLights;
+    //! The level at and above which a sample is saturated and excluded from the solve, or 0 to keep all samples.
+    double saturationLevel;
+    //! The level at and below which a sample is dark and excluded from the solve, or 0 to keep all samples.
+    double darkLevel;
+    //! Whether lights are near point lights, whose positions are given as light directions.
+    bool flagNearLight;
+    //! The size of a pixel of the full resolution frame in the units of light positions.
+    double pixelSize;
+    //! The exponent of the distance, by which the irradiance of near lights falls off.
+    double falloff;
+    //! Whether colored observations are solved by the chromaticity-aware color solve, i.e., the geometry once on the luminance and the albedo per color channel.
+    bool flagChromaticity;
+    //! The light table of 3 colored lights multiplexed in the color channels of each frame, or empty to solve all frames at once.
+    std::string strMultiplexedLight;
+    //! The light table of the crosstalk of the multiplexed lights, i.e., the response of the color channels to each light, or empty for no crosstalk.
+    std::string strCrosstalk;
+    //! The number of the last frames solved for each frame of a stream, or 0 to solve all frames at once.
+    int sizeWindow;
+    //! The frame rate of a stream in fps, at which frames arrive and are dropped if they are not processed in time, or 0 to process them as fast as possible.
+    double frameRate;
+    //! Whether the light intensities are estimated from the observations instead of given, i.e., semi-calibrated photometric stereo.
+    bool flagSemiCalibrated;
+    //! The number of pixels sampled to estimate the light intensities.
+    int numberOfSemiCalibrationSamples;
+    //! Called with the name and the elapsed time in milliseconds of each finished stage, if set.
+    boost::function<void (const std::string&, const double)> reportStage;
+    //! Called with the filename of each written output, if set.
+    boost::function<void (const std::string&)> reportOutput;
+};
+
+/*!
+ * \class StageTimer
+ *
+ * \brief measures elapsed time of consecutive stages of the pipeline, and reports them by \c PipelineOption::reportStage.
+ *
+ */
+class StageTimer
+{
+public:
+    StageTimer(
+        const PipelineOption& option
+    ):
+        option_(option),
+        timeStart_( boost::posix_time::microsec_clock::local_time() )
+    {}
+    //! finishes the stage named \c stage, and starts the next one.
+    void lap(
+        const std::string& stage
+    )
+    {
+        boost::posix_time::ptime timeNow = boost::posix_time::microsec_clock::local_time();
+        if( option_.reportStage )
+        {
+            option_.reportStage( stage, (timeNow - timeStart_).total_microseconds() / 1000.0 );
+        }
+        timeStart_ = timeNow;
+    }
+private:
+    const PipelineOption& option_;
+    boost::posix_time::ptime timeStart_;
+};
+
+//! solves the pixels of \c I (pc x f, e.g., mapped from a file) tile by tile, each of \c sizeTile pixels, and stores the results of all pixels, including their confidence map, in \c cps.
+template <typename DataType>
+inline ResidualStatistics<DataType> solveSurfaceTiled(
+    const Eigen::Map< const Eigen::Matrix<DataType, -1, -1> >& I,
+    const ReflectanceModel<DataType>& model,
+    const int sizeTile,
+    CalibratedPhotometricStereo<DataType>& cps,
+    const NearLight<DataType>* nearLight = NULL,
+    const bool flagChromaticity = false
+)
+{
+    int numberOfPixels = cps.numberOfPixels();
+    int numberOfImages = I.cols();
+    int color = cps.color();
+    bool flagLambertian = ( model.name() == "Lambertian" );
+
+    Eigen::Matrix<DataType, -1, -1> R = Eigen::Matrix<DataType, -1, -1>::Zero( 1, numberOfPixels*color );
+    Eigen::Matrix<DataType, -1, -1> N = Eigen::Matrix<DataType, -1, -1>::Zero( numberOfPixels, 3 );
+    Eigen::Matrix<DataType, -1, -1> confidence = Eigen::Matrix<DataType, -1, -1>::Zero( numberOfPixels, 3 );
+    Eigen::Matrix<DataType, -1, -1> Theta;
+    if( !flagLambertian )
+    {
+        Theta = Eigen::Matrix<DataType, -1, -1>::Zero( numberOfPixels, 1 + model.numberOfShapeParameters() );
+    }
+    ResidualStatistics<DataType> stats( numberOfPixels*color, numberOfImages, cps.whiteLevel() * (DataType)256 / (DataType)255 );
+
+    Eigen::Matrix<DataType, -1, -1> Itile, Stile, Rtile, Ntile, ThetaTile, confidenceTile;
+    ResidualStatistics<DataType> statsTile;
+    ValidityMask validityTile;
+    NearLight<DataType> nearLightTile;
+    for(int p0 = 0; p0 < numberOfPixels; p0 += sizeTile)
+    {
+        int numberOfPixelsTile = std::min( sizeTile, numberOfPixels - p0 );
+
+        // copy rows of the tile, so that the tile has the same layout as I.
+        Itile.resize( numberOfPixelsTile*color, numberOfImages );
+        for(int c = 0; c < color; ++c)
+        {
+            Itile.middleRows( c*numberOfPixelsTile, numberOfPixelsTile ) = I.middleRows( c*numberOfPixels+p0, numberOfPixelsTile );
+        }
+
+        if( cps.validity().numberOfPixels() > 0 )
+        {
+            validityTile = cps.validity().middlePixels( p0, numberOfPixelsTile );
+        }
+        if( nearLight != NULL )
+        {
+            nearLightTile = nearLight->middlePixels( p0 );
+        }
+        solveSurface( Itile, cps.L(), model, numberOfPixelsTile, color, Stile, Rtile, Ntile, ThetaTile, statsTile, &validityTile, cps.whiteLevel(), nearLight != NULL ? &nearLightTile : NULL, flagChromaticity, &confidenceTile );
+
+        for(int c = 0; c < color; ++c)
+        {
+            for(int p = 0; p < numberOfPixelsTile; ++p)
+            {
+                R( c*numberOfPixels+p0+p ) = Rtile( c*numberOfPixelsTile+p );
+                stats.rmsPixel()( c*numberOfPixels+p0+p ) = statsTile.rmsPixel()( c*numberOfPixelsTile+p );
+            }
+        }
+        N.middleRows( p0, numberOfPixelsTile ) = Ntile;
+        confidence.middleRows( p0, numberOfPixelsTile ) = confidenceTile;
+        if( !flagLambertian )
+        {
+            Theta.middleRows( p0, numberOfPixelsTile ) = ThetaTile;
+        }
+        stats.merge( statsTile );
+    }
+
+    cps.R( R );
+    cps.N( N );
+    cps.Theta( Theta );
+    cps.confidence( confidence );
+
+    return stats;
+}
+
+//! reports the outputs \c names with \c strSuffix, e.g., "_00012", in the output directory \c strDirOutput in each of \c formats by \c option.reportOutput, if set.
+inline void reportOutputs(
+    const PipelineOption& option,
+    const std::string& strDirOutput,
+    const std::vector<std::string>& names,
+    const std::vector<std::string>& formats,
+    const std::string& strSuffix = ""
+)
+{
+    if( !option.reportOutput )
+    {
+        return;
+    }
+    for(size_t i = 0; i < names.size(); ++i)
+    {
+        for(size_t n = 0; n < formats.size(); ++n)
+        {
+            std::string strExtension( formats[n] );
+            std::transform( strExtension.begin(), strExtension.end(), strExtension.begin(), ::tolower );
+            option.reportOutput( strDirOutput + names[i] + strSuffix + "." + strExtension );
+        }
+    }
+}
+
+//! writes the region of the outputs of \c cps in their frame as region.txt in the output directory, since only RAW stores it, and reports it by \c option.reportOutput, if set. returns \c false if it fails.
+template <typename DataType>
+inline bool writeRegion(
+    const CalibratedPhotometricStereo<DataType>& cps,
+    const PipelineOption& option
+)
+{
+    std::string strSave = cps.config().strDirOutput() + "region.txt";
+    if( !saveImageRegion( cps.region(), strSave ) )
+    {
+        return false;
+    }
+    if( option.reportOutput )
+    {
+        option.reportOutput( strSave );
+    }
+    return true;
+}
+
+//! writes surface albedo, surface normal, reprojection error and confidence map of \c cps and \c stats in the output directory, and returns 0 if all outputs are written.
+template <typename DataType>
+inline int writeOutputs(
+    const CalibratedPhotometricStereo<DataType>& cps,
+    const ResidualStatistics<DataType>& stats,
+    const PipelineOption& option,
+    StageTimer& timer
+)
+{
+    AsyncWriter writer( option.numberOfWriterThreads );
+
+    // outputs are encoded and written by the writer threads while the computation continues.
+    cimg_library::CImg<DataType> imgR = buildSurfaceAlbedoImage(
+        cps.R(),
+        cps.indexOfPixels(),
+        cps.width(),
+        cps.height(),
+        cps.color()
+    );
+    cimg_library::CImg<DataType> imgRDisplay;
+    if( option.flagDisplay )
+    {
+        imgRDisplay = (imgR + (DataType)1) * (DataType)127.5;
+    }
+    submitImage(
+        writer,
+        imgR,
+        cps.config().strDirOutput() + "surfaceAlbedo",
+        cps.config().outputFormat(),
+        (DataType)127.5,
+        (DataType)1,
+        cps.region()
+    );
+    cimg_library::CImg<DataType> imgN = buildSurfaceNormalImage(
+        cps.N(),
+        cps.indexOfPixels(),
+        cps.width(),
+        cps.height()
+    );
+    cimg_library::CImg<DataType> imgNDisplay;
+    if( option.flagDisplay )
+    {
+        imgNDisplay = (imgN + (DataType)1) * (DataType)127.5;
+    }
+    submitImage(
+        writer,
+        imgN,
+        cps.config().strDirOutput() + "surfaceNormal",
+        cps.config().outputFormat(),
+        (DataType)127.5,
+        (DataType)1,
+        cps.region()
+    );
+
+    stats.show();
+    stats.save( cps.config().strDirOutput() + "residualStatistics.txt" );
+    cimg_library::CImg<DataType> imgDiff = buildResidualImage(
+        stats.rmsPixel(),
+        cps.indexOfPixels(),
+        cps.width(),
+        cps.height(),
+        cps.color()
+    );
+    cimg_library::CImg<DataType> imgDiffDisplay;
+    if( option.flagDisplay )
+    {
+        imgDiffDisplay = imgDiff;
+    }
+    submitImage(
+        writer,
+        imgDiff,
+        cps.config().strDirOutput() + "reprojectionError",
+        cps.config().outputFormat(),
+        (DataType)1,
+        (DataType)0,
+        cps.region()
+    );
+
+    // the confidence map is written in the formats of floating point values only.
+    std::vector<std::string> formatsConfidence = confidenceFormats( cps.config().outputFormat() );
+    if( cps.confidence().rows() == cps.numberOfPixels() )
+    {
+        cimg_library::CImg<DataType> imgConfidence = buildSurfaceNormalImage(
+            cps.confidence(),
+            cps.indexOfPixels(),
+            cps.width(),
+            cps.height()
+        );
+        submitImage(
+            writer,
+            imgConfidence,
+            cps.config().strDirOutput() + "confidence",
+            formatsConfidence,
+            (DataType)1,
+            (DataType)0,
+            cps.region()
+        );
+    }
+
+    timer.lap( "output" );
+
+    if( option.flagDisplay )
+    {
+        (imgRDisplay, imgNDisplay, imgDiffDisplay).display("Surface albedo, surface normal, and reprojection error");
+    }
+
+    // returns after all outputs are written to the disk.
+    int numberOfFailed = writer.wait();
+    if( !writeRegion( cps, option ) )
+    {
+        ++numberOfFailed;
+    }
+    timer.lap( "write" );
+    if( option.reportOutput )
+    {
+        const char* names[] = {"surfaceAlbedo", "surfaceNormal", "reprojectionError"};
+        reportOutputs( option, cps.config().strDirOutput(), std::vector<std::string>( names, names + 3 ), cps.config().outputFormat() );
+        if( cps.confidence().rows() == cps.numberOfPixels() )
+        {
+            reportOutputs( option, cps.config().strDirOutput(), std::vector<std::string>( 1, "confidence" ), formatsConfidence );
+        }
+        option.reportOutput( cps.config().strDirOutput() + "residualStatistics.txt" );
+    }
+
+    return numberOfFailed == 0 ? 0 : 1;
+}
+
+//! returns the output directory of the preview decimated by \c factor, e.g., "out_preview4/" for "out/".
+inline std::string previewDirectory(
+    const std::string& strDirOutput,
+    const int factor
+)
+{
+    std::string strDir( strDirOutput );
+    while( !strDir.empty() && strDir[strDir.size()-1] == '/' )
+    {
+        strDir.erase( strDir.size()-1 );
+    }
+    return strDir + "_preview" + toString(factor) + "/";
+}
+
+//! sets size, region, color and \c indexOfPixels of \c cps from its mask. A preview decimates them by \c option.previewFactor, and writes its outputs next to the output directory. They are cropped to \c option.region if \c option.flagCrop.
+template <typename DataType>
+inline void loadSurface(
+    CalibratedPhotometricStereo<DataType>& cps,
+    const PipelineOption& option,
+    std::vector<int>& indexOfPixels
+)
+{
+    int width;
+    int height;
+    loadAvailablePixels(
+        cps.config().strImageMask(),
+        width,
+        height,
+        indexOfPixels
+    );
+
+    if( option.previewFactor > 1 )
+    {
+        std::vector<int> indexOfPixelsFull;
+        indexOfPixelsFull.swap( indexOfPixels );
+        decimateAvailablePixels( indexOfPixelsFull, width, height, option.previewFactor, width, height, indexOfPixels );
+
+        CpsConfig config( cps.config() );
+        config.strDirOutput( previewDirectory( config.strDirOutput(), option.previewFactor ) );
+        boost::filesystem::create_directories( config.strDirOutput() );
+        cps.config( config );
+        std::cout << "preview decimated by " << option.previewFactor << ": " << width << "x" << height << std::endl;
+    }
+
+    ImageRegion region( 0, 0, width, height, width, height );
+    if( option.flagCrop )
+    {
+        region = option.region;
+        region.x /= option.previewFactor;
+        region.y /= option.previewFactor;
+        region.width /= option.previewFactor;
+        region.height /= option.previewFactor;
+        cropAvailablePixels( indexOfPixels, width, height, region );
+        std::cout << "crop " << region.width << "x" << region.height << " at (" << region.x << ", " << region.y << ") of " << width << "x" << height << std::endl;
+    }
+
+    cps.region(region);
+    cps.width(region.width);
+    cps.height(region.height);
+    cps.color(cps.config().color());
+    cps.indexOfPixels(indexOfPixels);
+}
+
+//! keeps only \c option.numberOfLights observations and light sources of \c cps conditioning the solve best, so that the other frames are never loaded. returns the indices of the kept observations, or an empty vector if all are kept.
+template <typename DataType>
+inline std::vector<int> selectObservation(
+    CalibratedPhotometricStereo<DataType>& cps,
+    const PipelineOption& option
+)
+{
+    if( option.numberOfLights <= 0 || option.numberOfLights >= cps.config().numberOfObservation() )
+    {
+        return std::vector<int>();
+    }
+    std::vector<ObservationSingle> obsAll = cps.config().obsAll().observation();
+    LightSelection selection = selectLights( cps.L(), option.numberOfLights );
+    showLightSelection( selection );
+
+    std::vector<ObservationSingle> obsSelected;
+    Eigen::Matrix<DataType, -1, -1> L( 3, selection.indexOfLights.size() );
+    for(size_t n = 0; n < selection.indexOfLights.size(); ++n)
+    {
+        obsSelected.push_back( obsAll[ selection.indexOfLights[n] ] );
+        L.col(n) = cps.L().col( selection.indexOfLights[n] );
+    }
+    CpsConfig config( cps.config() );
+    config.observation( obsSelected );
+    cps.config( config );
+    cps.L( L );
+
+    return selection.indexOfLights;
+}
+
+//! runs calibrated photometric stereo given \c config, and returns 0 if all outputs are written.
+template <typename DataType>
+inline int runPhotometricStereo(
+    const CpsConfig& config,
+    const PipelineOption& option = PipelineOption()
+)
+{
+    StageTimer timer( option );
+    CalibratedPhotometricStereo<DataType> cps( config );
+
+    // light sources are built before any image, so that a subset of them selects the frames to be loaded.
+    cps.L( buildLightSourceMatrix<DataType>( cps.config() ) );
+    if( cps.L().cols() != cps.config().numberOfObservation() )
+    {
+        std::cerr << "Invalid light sources" << std::endl;
+        return 1;
+    }
+
+    // intensities estimated by a shard would differ from those of the others, so that the merged outputs would not be identical.
+    if( option.flagSemiCalibrated && ( option.flagNearLight || option.numberOfShards > 1 ) )
+    {
+        std::cerr << "Semi-calibrated lights support neither near lights nor shards" << std::endl;
+        return 1;
+    }
+
+    // near lights are approximated by distant lights at the center of the frame, e.g., to select lights.
+    Eigen::Matrix<DataType, -1, -1> position, intensity;
+    if( option.flagNearLight )
+    {
+        if( cps.config().strReflection() != "Lambertian" )
+        {
+            std::cerr << "Near lights support only the Lambertian model" << std::endl;
+            return 1;
+        }
+        if( !buildLightPositionMatrix( cps.config(), position, intensity ) )
+        {
+            std::cerr << "Invalid light sources" << std::endl;
+            return 1;
+        }
+        cps.L( NearLight<DataType>( position, intensity, (DataType)option.falloff, (DataType)option.pixelSize ).lightMatrixCenter() );
+    }
+
+    std::vector<int> indexOfLights = selectObservation( cps, option );
+    std::vector<int> indexOfPixels;
+    loadSurface( cps, option, indexOfPixels );
+    showConfiguration( cps.config() );
+
+    // a shard solves only its contiguous range of the available pixels.
+    if( option.numberOfShards > 1 )
+    {
+        int pixelBegin, pixelEnd;
+        computeShardRange( indexOfPixels.size(), option.shard, option.numberOfShards, ResidualStatistics<DataType>::sizeBlock, pixelBegin, pixelEnd );
+        std::cout << "shard " << option.shard << " of " << option.numberOfShards << ": pixels [" << pixelBegin << ", " << pixelEnd << ") of " << indexOfPixels.size() << std::endl;
+        if( pixelBegin == pixelEnd )
+        {
+            std::cerr << "shard " << option.shard << " is empty, since " << indexOfPixels.size() << " pixels are fewer than " << option.numberOfShards << " blocks of " << ResidualStatistics<DataType>::sizeBlock << " pixels" << std::endl;
+        }
+        cps.indexOfPixels( std::vector<int>( indexOfPixels.begin()+pixelBegin, indexOfPixels.begin()+pixelEnd ) );
+    }
+
+    NearLight<DataType> nearLight;
+    if( option.flagNearLight )
+    {
+        for(size_t n = 0; n < indexOfLights.size(); ++n)
+        {
+            position.col(n) = position.col( indexOfLights[n] );
+            intensity.col(n) = intensity.col( indexOfLights[n] );
+        }
+        if( !indexOfLights.empty() )
+        {
+            position.conservativeResize( 3, indexOfLights.size() );
+            intensity.conservativeResize( 1, indexOfLights.size() );
+        }
+        nearLight = NearLight<DataType>( position, intensity, (DataType)option.falloff, (DataType)option.pixelSize );
+        nearLight.pixels( cps.indexOfPixels(), cps.width(), option.previewFactor, cps.region() );
+        std::cout << "near lights of falloff " << option.falloff << ", pixel size " << option.pixelSize << std::endl;
+    }
+
+    boost::shared_ptr< ReflectanceModel<DataType> > model = createReflectanceModel<DataType>(
+        cps.config().strReflection()
+    );
+    if( !model )
+    {
+        std::cerr << "Unknown reflectance model " << cps.config().strReflection() << ", Lambertian is used instead." << std::endl;
+        model = createReflectanceModel<DataType>( "Lambertian" );
+    }
+    if( model->name() != "Lambertian" && !option.flagNearLight )
+    {
+        // near lights are solved by the Lambertian model only.
+        std::cout << "fit " << model->name() << " model to " << cps.numberOfPixels() << " pixels" << std::endl;
+    }
+
+    // plan the execution before loading any image.
+    int numberOfThreads = 1;
+#ifdef _OPENMP
+    numberOfThreads = omp_get_max_threads();
+#endif
+    MemoryPlan plan = planMemory<DataType>(
+        cps.width(),
+        cps.height(),
+        cps.numberOfPixels(),
+        cps.config().numberOfObservation(),
+        cps.color(),
+        model->numberOfShapeParameters(),
+        numberOfThreads + option.numberOfWriterThreads,
+        option.memoryLimit > 0 ? option.memoryLimit : readMemoryLimit(),
+        option.flagDisplay,
+        ResidualStatistics<DataType>::sizeBlock,
+        option.flagChromaticity
+    );
+    showMemoryPlan( plan );
+    timer.lap( "plan" );
+
+    // build observation matrix on memory, or in a mapped file out of core, and light source matrix.
+    size_t numberOfRows = (size_t)cps.numberOfPixels()*cps.color();
+    int numberOfImages = cps.config().numberOfObservation();
+    // unique per job, so that jobs sharing DirectoryOutput, e.g., shards or daemon jobs, do not map the same file.
+    std::string strFileObservation = cps.config().strDirOutput() + "observation" + boost::filesystem::unique_path( "-%%%%-%%%%-%%%%" ).string() + ".tmp";
+    boost::iostreams::mapped_file fileObservation;
+    DataType* ptrI;
+    if( plan.mode == MemoryPlan::OUT_OF_CORE )
+    {
+        boost::iostreams::mapped_file_params params( strFileObservation );
+        params.flags = boost::iostreams::mapped_file::readwrite;
+        params.new_file_size = numberOfRows*numberOfImages*sizeof(DataType);
+        fileObservation.open( params );
+        ptrI = (DataType*)fileObservation.data();
+    }
+    else
+    {
+        cps.I().resize( numberOfRows, numberOfImages );
+        ptrI = cps.I().data();
+    }
+    cps.validity() = ValidityMask( option.saturationLevel, option.darkLevel );
+    cps.whiteLevel( gatherObservationMatrix<DataType>(
+        cps.indexOfPixels(),
+        cps.config().obsAll().observation(),
+        cps.color(),
+        cps.width(),
+        ptrI,
+        option.previewFactor,
+        cps.region(),
+        &cps.validity(),
+        cps.config().strImageAmbient()
+    ) );
+    if( cps.validity().isEnabled() )
+    {
+        std::cout << "exclude " << cps.validity().numberOfInvalid() << " saturated or dark samples of " << (size_t)cps.numberOfPixels()*numberOfImages << std::endl;
+    }
+
+    timer.lap( "load" );
+
+    // estimate the light intensities on a subsample of the pixels, and solve all pixels once by them.
+    if( option.flagSemiCalibrated )
+    {
+        std::vector<int> indexOfSamples = sampleIndexOfPixels( cps.numberOfPixels(), option.numberOfSemiCalibrationSamples );
+        SemiCalibration<DataType> calibration = estimateLightIntensity(
+            Eigen::Map< const Eigen::Matrix<DataType, -1, -1> >( ptrI, numberOfRows, numberOfImages ),
+            cps.L(),
+            cps.numberOfPixels(),
+            cps.color(),
+            indexOfSamples,
+            &cps.validity()
+        );
+        if( calibration.isEstimated() )
+        {
+            std::cout << "semi-calibrated light intensities of " << calibration.numberOfRows << " lit rows of " << indexOfSamples.size() << " pixels in " << calibration.numberOfIterations << " iterations (change " << calibration.change << ")" << std::endl;
+            std::cout << calibration.intensity << std::endl;
+            cps.L( scaleLightSourceMatrix( cps.L(), calibration.intensity ) );
+
+            std::string strSave = cps.config().strDirOutput() + "estimatedLights.txt";
+            if( !saveLightTable( strSave, cps.L() ) )
+            {
+                std::cerr << "Failed to write " << strSave << std::endl;
+                return 1;
+            }
+            if( option.reportOutput )
+            {
+                option.reportOutput( strSave );
+            }
+        }
+        timer.lap( "semi-calibrate" );
+    }
+
+    ResidualStatistics<DataType> stats;
+    if( plan.numberOfTiles == 1 && plan.mode == MemoryPlan::IN_CORE )
+    {
+        Eigen::Matrix<DataType, -1, -1> S, R, N, Theta, confidence;
+        solveSurface( cps.I(), cps.L(), *model, cps.numberOfPixels(), cps.color(), S, R, N, Theta, stats, &cps.validity(), cps.whiteLevel(), option.flagNearLight ? &nearLight : NULL, option.flagChromaticity, &confidence );
+        cps.S(S);
+        cps.R(R);
+        cps.N(N);
+        cps.Theta(Theta);
+        cps.confidence(confidence);
+    }
+    else
+    {
+        stats = solveSurfaceTiled(
+            Eigen::Map< const Eigen::Matrix<DataType, -1, -1> >( ptrI, numberOfRows, numberOfImages ),
+            *model,
+            plan.sizeTile,
+            cps,
+            option.flagNearLight ? &nearLight : NULL,
+            option.flagChromaticity
+        );
+    }
+    if( fileObservation.is_open() )
+    {
+        fileObservation.close();
+        boost::filesystem::remove( strFileObservation );
+    }
+    timer.lap( "solve" );
+
+    if( option.numberOfShards > 1 )
+    {
+        ShardResult<DataType> result;
+        result.shard = option.shard;
+        result.numberOfShards = option.numberOfShards;
+        computeShardRange( indexOfPixels.size(), option.shard, option.numberOfShards, ResidualStatistics<DataType>::sizeBlock, result.pixelBegin, result.pixelEnd );
+        result.numberOfPixels = indexOfPixels.size();
+        result.color = cps.color();
+        result.numberOfImages = numberOfImages;
+        result.R = cps.R();
+        result.N = cps.N();
+        result.Theta = cps.Theta();
+        result.confidence = cps.confidence();
+        result.stats = stats;
+
+        std::string strSave = shardFileName( cps.config().strDirOutput(), option.shard, option.numberOfShards );
+        if( !result.save( strSave ) )
+        {
+            std::cerr << "Failed to write " << strSave << std::endl;
+            return 1;
+        }
+        timer.lap( "write" );
+        if( option.reportOutput )
+        {
+            option.reportOutput( strSave );
+        }
+        return 0;
+    }
+
+    return writeOutputs( cps, stats, option, timer );
+}
+
+//! returns the suffix of the outputs of frame \c f, e.g., "_00012".
+inline std::string frameSuffix(
+    const int f
+)
+{
+    std::ostringstream oss;
+    oss << "_" << std::setw(5) << std::setfill('0') << f;
+    return oss.str();
+}
+
+//! solves each RGB frame of \c config by single-shot photometric stereo multiplexed by the colored lights \c option.strMultiplexedLight and their crosstalk \c option.strCrosstalk, and writes surface normal and albedo of each frame, e.g., surfaceNormal_00012 of frame 12. returns 0 if all outputs are written.
+//! Frames are gathered and solved in parallel in batches of the number of threads, and a batch is written by the writer threads while the next one is solved, so that memory does not grow with the number of frames.
+template <typename DataType>
+inline int runMultiplexedPhotometricStereo(
+    const CpsConfig& config,
+    const PipelineOption& option = PipelineOption()
+)
+{
+    StageTimer timer( option );
+    CalibratedPhotometricStereo<DataType> cps( config );
+    if( cps.config().color() != 3 )
+    {
+        std::cerr << "Multiplexed lights need observations of 3 color channels" << std::endl;
+        return 1;
+    }
+    Eigen::Matrix<DataType, -1, -1> L;
+    if( !buildMultiplexedLightMatrix( option.strMultiplexedLight, option.strCrosstalk, L ) )
+    {
+        std::cerr << "Invalid multiplexed lights" << std::endl;
+        return 1;
+    }
+    Eigen::Matrix<DataType, 3, 3> Linv = Eigen::Matrix<DataType, 3, 3>( L ).inverse();
+    cps.L( L );
+
+    std::vector<int> indexOfPixels;
+    loadSurface( cps, option, indexOfPixels );
+    showConfiguration( cps.config() );
+
+    int numberOfPixels = cps.numberOfPixels();
+    int color = cps.color();
+    size_t numberOfRows = (size_t)numberOfPixels*color;
+    const std::vector<ObservationSingle>& obsSingle = cps.config().obsAll().observation();
+    int numberOfFrames = obsSingle.size();
+    int sizeBatch = 1;
+#ifdef _OPENMP
+    sizeBatch = omp_get_max_threads();
+#endif
+
+    // the ambient image is gathered once for all frames.
+    std::vector<DataType> ambient = gatherAmbient<DataType>( cps.config().strImageAmbient(), cps.indexOfPixels(), color, cps.width(), option.previewFactor, cps.region() );
+    const DataType* ptrAmbient = ambient.empty() ? NULL : &ambient[0];
+    timer.lap( "load" );
+
+    std::cout << "solve " << numberOfFrames << " frames of " << numberOfPixels << " pixels in batches of " << sizeBatch << std::endl;
+    // samples of dead flat field pixels are invalid, so that the mask is enabled if flat fields are given.
+    ValidityMask validity( option.saturationLevel, option.darkLevel );
+    if( hasFlatField( obsSingle ) )
+    {
+        validity.enable();
+    }
+    std::vector<DataType> I( numberOfRows*sizeBatch );
+    std::vector< Eigen::Matrix<DataType, -1, -1> > N( sizeBatch ), R( sizeBatch );
+    AsyncWriter writer( option.numberOfWriterThreads );
+    size_t numberOfInvalid = 0;
+    for(int f0 = 0; f0 < numberOfFrames; f0 += sizeBatch)
+    {
+        int numberOfFramesBatch = std::min( sizeBatch, numberOfFrames - f0 );
+        if( validity.isEnabled() )
+        {
+            validity.resize( numberOfPixels, numberOfFramesBatch );
+        }
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+        for(int b = 0; b < numberOfFramesBatch; ++b)
+        { // b means "b"atch
+            DataType whiteLevel;
+            gatherObservation( obsSingle[f0+b], cps.indexOfPixels(), color, cps.width(), option.previewFactor, cps.region(), b, &I[b*numberOfRows], validity.isEnabled() ? &validity : NULL, whiteLevel, ptrAmbient );
+            estimateSurfaceMultiplexed( &I[b*numberOfRows], numberOfPixels, Linv, b, &validity, N[b], R[b] );
+        }
+        if( validity.isEnabled() )
+        {
+            numberOfInvalid += validity.numberOfInvalid();
+        }
+
+        // the previous batch has been written while this batch is solved.
+        writer.flush();
+        for(int b = 0; b < numberOfFramesBatch; ++b)
+        {
+            std::string strSuffix = frameSuffix( f0+b );
+            cimg_library::CImg<DataType> imgR = buildSurfaceAlbedoImage( R[b], cps.indexOfPixels(), cps.width(), cps.height(), 1 );
+            submitImage( writer, imgR, cps.config().strDirOutput() + "surfaceAlbedo" + strSuffix, cps.config().outputFormat(), (DataType)127.5, (DataType)1, cps.region() );
+            cimg_library::CImg<DataType> imgN = buildSurfaceNormalImage( N[b], cps.indexOfPixels(), cps.width(), cps.height() );
+            submitImage( writer, imgN, cps.config().strDirOutput() + "surfaceNormal" + strSuffix, cps.config().outputFormat(), (DataType)127.5, (DataType)1, cps.region() );
+        }
+    }
+    if( validity.isEnabled() )
+    {
+        std::cout << "exclude " << numberOfInvalid << " saturated or dark samples of " << (size_t)numberOfPixels*numberOfFrames << std::endl;
+    }
+    timer.lap( "solve" );
+
+    // returns after all outputs are written to the disk.
+    int numberOfFailed = writer.wait();
+    if( !writeRegion( cps, option ) )
+    {
+        ++numberOfFailed;
+    }
+    timer.lap( "write" );
+    if( option.reportOutput )
+    {
+        const char* names[] = {"surfaceAlbedo", "surfaceNormal"};
+        for(int f = 0; f < numberOfFrames; ++f)
+        { // f means "f"rame
+            reportOutputs( option, cps.config().strDirOutput(), std::vector<std::string>( names, names + 2 ), cps.config().outputFormat(), frameSuffix(f) );
+        }
+    }
+
+    return numberOfFailed == 0 ? 0 : 1;
+}
+
+//! solves a stream of the frames of \c config, e.g., of a camera under a cyclic sequence of lights, by the sliding window of the last \c option.sizeWindow frames, and writes surface normal and albedo of each frame once the window is full, e.g., surfaceNormal_00012 of the window ending at frame 12. returns 0 if all outputs are written.
+//! If \c option.frameRate > 0, frame f arrives at f / frameRate seconds, and is dropped if the next frame has arrived before it is processed, as a camera keeping only its latest frame. The latency of each frame from its arrival to its output submitted to the writer, and the dropped frames are reported and saved in streamStatistics.txt.
+template <typename DataType>
+inline int runStreamingPhotometricStereo(
+    const CpsConfig& config,
+    const PipelineOption& option = PipelineOption()
+)
+{
+    typedef boost::posix_time::ptime Time;
+
+    StageTimer timer( option );
+    CalibratedPhotometricStereo<DataType> cps( config );
+    if( cps.config().strReflection() != "Lambertian" )
+    {
+        std::cerr << "Streaming supports only the Lambertian model" << std::endl;
+        return 1;
+    }
+    cps.L( buildLightSourceMatrix<DataType>( cps.config() ) );
+    if( cps.L().cols() != cps.config().numberOfObservation() )
+    {
+        std::cerr << "Invalid light sources" << std::endl;
+        return 1;
+    }
+
+    std::vector<int> indexOfPixels;
+    loadSurface( cps, option, indexOfPixels );
+    showConfiguration( cps.config() );
+
+    int numberOfPixels = cps.numberOfPixels();
+    int color = cps.color();
+    const std::vector<ObservationSingle>& obsSingle = cps.config().obsAll().observation();
+    int numberOfFrames = obsSingle.size();
+
+    // the ambient image is gathered once for all frames.
+    std::vector<DataType> ambient = gatherAmbient<DataType>( cps.config().strImageAmbient(), cps.indexOfPixels(), color, cps.width(), option.previewFactor, cps.region() );
+    const DataType* ptrAmbient = ambient.empty() ? NULL : &ambient[0];
+    // samples of dead flat field pixels are invalid, so that the mask is enabled if flat fields are given.
+    ValidityMask validity( option.saturationLevel, option.darkLevel );
+    if( hasFlatField( obsSingle ) )
+    {
+        validity.enable();
+    }
+    SlidingWindowSolver<DataType> solver( numberOfPixels, color, option.sizeWindow, validity );
+    timer.lap( "load" );
+
+    std::cout << "stream " << numberOfFrames << " frames of " << numberOfPixels << " pixels through a window of " << option.sizeWindow << " frames";
+    if( option.frameRate > 0.0 )
+    {
+        std::cout << " at " << option.frameRate << " fps";
+    }
+    std::cout << std::endl;
+
+    AsyncWriter writer( option.numberOfWriterThreads );
+    Eigen::Matrix<DataType, -1, -1> S, R, N;
+    std::vector<double> latency;
+    std::vector<int> indexOfEmitted;
+    int numberOfDropped = 0;
+    Time timeStart = boost::posix_time::microsec_clock::local_time();
+    for(int f = 0; f < numberOfFrames; ++f)
+    { // f means "f"rame
+        Time timeArrival = boost::posix_time::microsec_clock::local_time();
+        if( option.frameRate > 0.0 )
+        {
+            timeArrival = timeStart + boost::posix_time::microseconds( (long long)( f * 1e6 / option.frameRate ) );
+            Time timeNext = timeStart + boost::posix_time::microseconds( (long long)( (f+1) * 1e6 / option.frameRate ) );
+            Time timeNow = boost::posix_time::microsec_clock::local_time();
+            if( timeNow < timeArrival )
+            {
+                boost::this_thread::sleep( timeArrival - timeNow );
+            }
+            else if( timeNow >= timeNext )
+            {
+                ++numberOfDropped;
+                continue;
+            }
+        }
+
+        DataType whiteLevel;
+        DataType* ptrColumn = solver.beginFrame();
+        gatherObservation( obsSingle[f], cps.indexOfPixels(), color, cps.width(), option.previewFactor, cps.region(), solver.slot(), ptrColumn, solver.validity().isEnabled() ? &solver.validity() : NULL, whiteLevel, ptrAmbient );
+        solver.endFrame( cps.L().col(f) );
+        if( !solver.isFull() || !solver.solve( S ) )
+        {
+            continue;
+        }
+        R = estimateSurfaceAlbedo( S );
+        N = estimateSurfaceNormal( S, R, numberOfPixels, color );
+
+        // the writer is waited for if it falls behind, so that its queue does not grow with the stream.
+        if( writer.numberOfPending() > 4*option.numberOfWriterThreads )
+        {
+            writer.flush();
+        }
+        std::string strSuffix = frameSuffix( f );
+        cimg_library::CImg<DataType> imgR = buildSurfaceAlbedoImage( R, cps.indexOfPixels(), cps.width(), cps.height(), color );
+        submitImage( writer, imgR, cps.config().strDirOutput() + "surfaceAlbedo" + strSuffix, cps.config().outputFormat(), (DataType)127.5, (DataType)1, cps.region() );
+        cimg_library::CImg<DataType> imgN = buildSurfaceNormalImage( N, cps.indexOfPixels(), cps.width(), cps.height() );
+        submitImage( writer, imgN, cps.config().strDirOutput() + "surfaceNormal" + strSuffix, cps.config().outputFormat(), (DataType)127.5, (DataType)1, cps.region() );
+        latency.push_back( ( boost::posix_time::microsec_clock::local_time() - timeArrival ).total_microseconds() / 1000.0 );
+        indexOfEmitted.push_back( f );
+    }
+    double duration = ( boost::posix_time::microsec_clock::local_time() - timeStart ).total_microseconds() / 1e6;
+    timer.lap( "solve" );
+
+    std::ostringstream oss;
+    oss << "frames " << numberOfFrames << std::endl;
+    oss << "emitted " << latency.size() << std::endl;
+    oss << "dropped " << numberOfDropped << std::endl;
+    oss << "rate " << ( duration > 0.0 ? latency.size() / duration : 0.0 ) << std::endl;
+    if( !latency.empty() )
+    {
+        std::vector<double> sorted( latency );
+        std::sort( sorted.begin(), sorted.end() );
+        double sum = 0.0;
+        for(size_t n = 0; n < sorted.size(); ++n)
+        {
+            sum += sorted[n];
+        }
+        oss << "latencyMean " << sum / sorted.size() << std::endl;
+        oss << "latency50 " << sorted[sorted.size()/2] << std::endl;
+        oss << "latency99 " << sorted[std::min( sorted.size()-1, sorted.size()*99/100 )] << std::endl;
+        oss << "latencyMax " << sorted.back() << std::endl;
+    }
+    std::cout << "stream statistics (latency in ms, rate in fps):" << std::endl << oss.str();
+    std::ofstream ofs( ( cps.config().strDirOutput() + "streamStatistics.txt" ).c_str() );
+    ofs << "# stream statistics of a window of " << option.sizeWindow << " frames, latency in ms, rate in fps" << std::endl << oss.str();
+    ofs.close();
+
+    // returns after all outputs are written to the disk.
+    int numberOfFailed = writer.wait();
+    if( !writeRegion( cps, option ) )
+    {
+        ++numberOfFailed;
+    }
+    timer.lap( "write" );
+    if( option.reportOutput )
+    {
+        const char* names[] = {"surfaceAlbedo", "surfaceNormal"};
+        for(size_t e = 0; e < indexOfEmitted.size(); ++e)
+        {
+            reportOutputs( option, cps.config().strDirOutput(), std::vector<std::string>( names, names + 2 ), cps.config().outputFormat(), frameSuffix( indexOfEmitted[e] ) );
+        }
+        option.reportOutput( cps.config().strDirOutput() + "streamStatistics.txt" );
+    }
+
+    return numberOfFailed == 0 && ofs ? 0 : 1;
+}
+
+//! merges results of \c numberOfShards shards of \c config saved by \c runPhotometricStereo(), and writes the outputs, which are identical to the outputs solved at once.
+template <typename DataType>
+inline int mergeShards(
+    const CpsConfig& config,
+    const int numberOfShards,
+    const PipelineOption& option = PipelineOption()
+)
+{
+    StageTimer timer( option );
+    CalibratedPhotometricStereo<DataType> cps( config );
+
+    std::vector<int> indexOfPixels;
+    loadSurface( cps, option, indexOfPixels );
+
+    int numberOfPixels = cps.numberOfPixels();
+    int color = cps.color();
+    Eigen::Matrix<DataType, -1, -1> R = Eigen::Matrix<DataType, -1, -1>::Zero( 1, numberOfPixels*color );
+    Eigen::Matrix<DataType, -1, -1> N = Eigen::Matrix<DataType, -1, -1>::Zero( numberOfPixels, 3 );
+    Eigen::Matrix<DataType, -1, -1> confidence = Eigen::Matrix<DataType, -1, -1>::Zero( numberOfPixels, 3 );
+    Eigen::Matrix<DataType, -1, -1> Theta;
+    ResidualStatistics<DataType> stats;
+
+    // shards are merged in pixel order, so that the statistics are summed in the same order as at once.
+    int pixelEnd = 0;
+    for(int shard = 0; shard < numberOfShards; ++shard)
+    {
+        std::string strFile = shardFileName( cps.config().strDirOutput(), shard, numberOfShards );
+        ShardResult<DataType> result;
+        if( !result.load( strFile ) ||
+            result.numberOfShards != numberOfShards ||
+            result.numberOfPixels != numberOfPixels ||
+            result.color != color ||
+            result.pixelBegin != pixelEnd )
+        {
+            std::cerr << "Invalid shard result " << strFile << std::endl;
+            return 1;
+        }
+        int numberOfPixelsShard = result.pixelEnd - result.pixelBegin;
+        for(int c = 0; c < color; ++c)
+        {
+            R.middleCols( c*numberOfPixels+result.pixelBegin, numberOfPixelsShard ) = result.R.middleCols( c*numberOfPixelsShard, numberOfPixelsShard );
+        }
+        N.middleRows( result.pixelBegin, numberOfPixelsShard ) = result.N;
+        confidence.middleRows( result.pixelBegin, numberOfPixelsShard ) = result.confidence;
+        if( result.Theta.size() > 0 )
+        {
+            if( Theta.size() == 0 )
+            {
+                Theta = Eigen::Matrix<DataType, -1, -1>::Zero( numberOfPixels, result.Theta.cols() );
+            }
+            Theta.middleRows( result.pixelBegin, numberOfPixelsShard ) = result.Theta;
+        }
+        if( shard == 0 )
+        {
+            stats = ResidualStatistics<DataType>( numberOfPixels*color, result.numberOfImages, result.stats.maxValue(), result.stats.histogram().size()-1 );
+        }
+        for(int c = 0; c < color; ++c)
+        {
+            stats.rmsPixel().segment( c*numberOfPixels+result.pixelBegin, numberOfPixelsShard ) = result.stats.rmsPixel().segment( c*numberOfPixelsShard, numberOfPixelsShard );
+        }
+        stats.merge( result.stats );
+        pixelEnd = result.pixelEnd;
+    }
+    if( pixelEnd != numberOfPixels )
+    {
+        std::cerr << "Shard results cover " << pixelEnd << " of " << numberOfPixels << " pixels." << std::endl;
+        return 1;
+    }
+    cps.R( R );
+    cps.N( N );
+    cps.Theta( Theta );
+    cps.confidence( confidence );
+    timer.lap( "merge" );
+
+    return writeOutputs( cps, stats, option, timer );
+}
+
+} // end of namespace CPS
+
+#endif
@@ -34,14 +34,175 @@ struct PixelLocation
     int y;
 };
 
+//! represents a region of (width x height) cropped at (x,y) from a frame of (widthFrame x heightFrame).
+struct ImageRegion
+{
+    ImageRegion(const int x_ = 0, const int y_ = 0, const int width_ = 0, const int height_ = 0, const int widthFrame_ = 0, const int heightFrame_ = 0):
+        x(x_), y(y_), width(width_), height(height_), widthFrame(widthFrame_), heightFrame(heightFrame_){}
+    //! returns \c true if the region is smaller than its frame.
+    bool isCropped(void) const {return width < widthFrame || height < heightFrame;}
+    int x;
+    int y;
+    int width;
+    int height;
+    int widthFrame;
+    int heightFrame;
+};
+
 namespace CPS
 {
 
+/*!
+ * \class ValidityMask
+ *
+ * \brief represents validity of each sample, i.e., each pixel under each light, as a bitmask of lights per pixel.
+ *
+ * A sample is invalid if any channel is saturated (>= \c saturationLevel) or all channels are dark (<= \c darkLevel).
+ * Each pixel has \c numberOfWords() 64-bit words, whose bit f is set if light f is valid.
+ *
+ */
+class ValidityMask
+{
+public:
+    typedef unsigned long long Word;
+
+    //! Default constructor, which detects no invalid sample.
+    ValidityMask(
+        const double saturationLevel = 0.0,
+        const double darkLevel = 0.0
+    ):
+        saturationLevel_(saturationLevel),
+        darkLevel_(darkLevel),
+        flagEnabled_(false),
+        numberOfPixels_(0),
+        numberOfImages_(0),
+        numberOfWords_(0)
+    {}
+
+    //! returns \c true if saturated or dark samples are detected, or the mask is enabled by \c enable().
+    bool isEnabled(void) const {return flagEnabled_ || saturationLevel_ > 0.0 || darkLevel_ > 0.0;}
+    //! enables the mask without detecting saturated or dark samples, e.g., to exclude samples of dead flat field pixels.
+    void enable(void) {flagEnabled_ = true;}
+    //! returns \c saturationLevel_, The level at and above which a channel is saturated, or 0 not to detect saturation.
+    double saturationLevel(void) const {return saturationLevel_;}
+    //! returns \c darkLevel_, The level at and below which a channel is dark, or 0 not to detect dark samples.
+    double darkLevel(void) const {return darkLevel_;}
+
+    //! sets all samples of \c numberOfPixels pixels under \c numberOfImages lights valid.
+    void resize(const int numberOfPixels, const int numberOfImages)
+    {
+        numberOfPixels_ = numberOfPixels;
+        numberOfImages_ = numberOfImages;
+        numberOfWords_ = (numberOfImages + 63) / 64;
+        bits_.assign( (size_t)numberOfPixels_*numberOfWords_, ~(Word)0 );
+        for(int w = 0; w < numberOfWords_; ++w)
+        {
+            int numberOfBits = std::min( 64, numberOfImages - 64*w );
+            Word last = numberOfBits == 64 ? ~(Word)0 : (((Word)1 << numberOfBits) - 1);
+            for(int p = 0; p < numberOfPixels_; ++p)
+            {
+                bits_[(size_t)p*numberOfWords_+w] = last;
+            }
+        }
+    }
+    //! returns \c true if \c values of \c color channels are valid.
+    template <typename T>
+    bool isValidSample(const T* values, const int stride, const int color) const
+    {
+        bool flagDark = darkLevel_ > 0.0;
+        for(int c = 0; c < color; ++c)
+        {
+            if( saturationLevel_ > 0.0 && values[c*stride] >= saturationLevel_ ) return false;
+            flagDark = flagDark && values[c*stride] <= darkLevel_;
+        }
+        return !flagDark;
+    }
+    //! sets the sample of pixel \c p under light \c f invalid. Lights sharing a word can be set by different threads.
+    void setInvalid(const int p, const int f)
+    {
+        Word& word = bits_[(size_t)p*numberOfWords_+f/64];
+        Word bit = ~((Word)1 << (f%64));
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+        word &= bit;
+    }
+    //! sets the samples of all pixels under light \c f valid, e.g., to reuse it for another frame.
+    void setValidImage(const int f)
+    {
+        Word bit = (Word)1 << (f%64);
+        for(int p = 0; p < numberOfPixels_; ++p)
+        {
+            bits_[(size_t)p*numberOfWords_+f/64] |= bit;
+        }
+    }
+    //! returns \c true if the sample of pixel \c p under light \c f is valid.
+    bool isValid(const int p, const int f) const {return ((bits_[(size_t)p*numberOfWords_+f/64] >> (f%64)) & 1) != 0;}
+    //! returns the number of valid lights of pixel \c p.
+    int numberOfValid(const int p) const
+    {
+        int n = 0;
+        for(int w = 0; w < numberOfWords_; ++w)
+        {
+            for(Word bits = bits_[(size_t)p*numberOfWords_+w]; bits != 0; bits &= bits-1)
+            {
+                ++n;
+            }
+        }
+        return n;
+    }
+    //! returns the number of invalid samples of all pixels.
+    size_t numberOfInvalid(void) const
+    {
+        size_t n = 0;
+        for(int p = 0; p < numberOfPixels_; ++p)
+        {
+            n += numberOfImages_ - numberOfValid(p);
+        }
+        return n;
+    }
+    //! returns the mask of \c numberOfPixels pixels from \c pixelBegin, e.g., of a tile.
+    ValidityMask middlePixels(const int pixelBegin, const int numberOfPixels) const
+    {
+        ValidityMask mask( saturationLevel_, darkLevel_ );
+        mask.numberOfPixels_ = numberOfPixels;
+        mask.numberOfImages_ = numberOfImages_;
+        mask.numberOfWords_ = numberOfWords_;
+        mask.bits_.assign( bits_.begin() + (size_t)pixelBegin*numberOfWords_, bits_.begin() + (size_t)(pixelBegin+numberOfPixels)*numberOfWords_ );
+        return mask;
+    }
+
+    //! returns \c numberOfPixels_, The number of pixels.
+    int numberOfPixels(void) const {return numberOfPixels_;}
+    //! returns \c numberOfImages_, The number of lights.
+    int numberOfImages(void) const {return numberOfImages_;}
+    //! returns \c numberOfWords_, The number of words of each pixel.
+    int numberOfWords(void) const {return numberOfWords_;}
+private:
+    //! The level at and above which a channel is saturated.
+    double saturationLevel_;
+    //! The level at and below which a channel is dark.
+    double darkLevel_;
+    //! Whether the mask is enabled regardless of the levels.
+    bool flagEnabled_;
+    //! The number of pixels.
+    int numberOfPixels_;
+    //! The number of lights.
+    int numberOfImages_;
+    //! The number of words of each pixel.
+    int numberOfWords_;
+    //! Bits of valid lights of each pixel.
+    std::vector<Word> bits_;
+};
+
 /*!
  * \class ObservationSingle
  *
  * \brief represents data of a single observation, i.e., filename of an image and light source information (direction and intensity).
  *
+ * An observation can be an exposure stack of the light, i.e., the image and images of other exposures, each of its exposure time, which are merged into one observation in the units of the image.
+ * An observation can have a flat field, i.e., an image of a uniform white target under the light, which corrects the spatial falloff of the light.
+ *
  * \author Yuji Oyamada
  * \date 2014/05/18
  *
@@ -69,13 +230,31 @@ class ObservationSingle
         lightIntensity_(lightIntensity)
     {}
 
+    //! Constructor of an exposure stack.
+    ObservationSingle(
+        const std::string strImage,
+        const std::string lightDirection,
+        const float lightIntensity,
+        const std::vector<std::string>& strImageExposure,
+        const std::vector<float>& exposureTime
+    ):
+        strImage_(strImage),
+        lightDirection_(lightDirection),
+        lightIntensity_(lightIntensity),
+        strImageExposure_(strImageExposure),
+        exposureTime_(exposureTime)
+    {}
+
     //! Copy constructor
     ObservationSingle(
         const ObservationSingle& obj
     ) :
         strImage_(obj.strImage()),
         lightDirection_(obj.lightDirection()),
-        lightIntensity_(obj.lightIntensity())
+        lightIntensity_(obj.lightIntensity()),
+        strImageExposure_(obj.strImageExposure()),
+        exposureTime_(obj.exposureTime()),
+        strImageFlat_(obj.strImageFlat())
     {}
     //@}
 
@@ -89,6 +268,9 @@ class ObservationSingle
         strImage_ = obj.strImage();
         lightDirection_ = obj.lightDirection();
         lightIntensity_ = obj.lightIntensity();
+        strImageExposure_ = obj.strImageExposure();
+        exposureTime_ = obj.exposureTime();
+        strImageFlat_ = obj.strImageFlat();
 
         return *this;
     }
@@ -97,6 +279,9 @@ class ObservationSingle
         strImage_ = obj.strImage();
         lightDirection_ = obj.lightDirection();
         lightIntensity_ = obj.lightIntensity();
+        strImageExposure_ = obj.strImageExposure();
+        exposureTime_ = obj.exposureTime();
+        strImageFlat_ = obj.strImageFlat();
 
         return *this;
     }
@@ -118,6 +303,24 @@ class ObservationSingle
     void lightDirection(const std::string lightDirection){lightDirection_ = lightDirection;}
     //! sets \c lightIntensity_, Light source intensity.
     void lightIntensity(const float lightIntensity){lightIntensity_ = lightIntensity;}
+    //! returns \c strImageExposure_, Filenames of images of the other exposures.
+    const std::vector<std::string>& strImageExposure(void) const {return strImageExposure_;}
+    //! sets \c strImageExposure_, Filenames of images of the other exposures.
+    void strImageExposure(const std::vector<std::string>& strImageExposure){strImageExposure_ = strImageExposure;}
+    //! returns \c exposureTime_, Exposure times of the image and the other exposures.
+    const std::vector<float>& exposureTime(void) const {return exposureTime_;}
+    //! sets \c exposureTime_, Exposure times of the image and the other exposures.
+    void exposureTime(const std::vector<float>& exposureTime){exposureTime_ = exposureTime;}
+    //! returns \c strImageFlat_, Filename of the flat field of the light, or empty if not corrected.
+    std::string strImageFlat(void) const {return strImageFlat_;}
+    //! sets \c strImageFlat_, Filename of the flat field of the light, or empty if not corrected.
+    void strImageFlat(const std::string strImageFlat){strImageFlat_ = strImageFlat;}
+    //! returns the number of exposures, i.e., 1 unless this is an exposure stack.
+    int numberOfExposures(void) const {return 1 + strImageExposure_.size();}
+    //! returns the filename of the image of exposure \c k.
+    std::string strImage(const int k) const {return k == 0 ? strImage_ : strImageExposure_[k-1];}
+    //! returns the exposure time of exposure \c k, which is 1 if not given.
+    float exposureTime(const int k) const {return k < (int)exposureTime_.size() ? exposureTime_[k] : 1.0f;}
     //@}
 
 private:
@@ -127,6 +330,12 @@ private:
     std::string lightDirection_;
     //! Light source intensity.
     float lightIntensity_;
+    //! Filenames of images of the other exposures.
+    std::vector<std::string> strImageExposure_;
+    //! Exposure times of the image and the other exposures.
+    std::vector<float> exposureTime_;
+    //! Filename of the flat field of the light, or empty if not corrected.
+    std::string strImageFlat_;
 };
 
 /*!
@@ -169,6 +378,8 @@ class ObservationAll
         observation_( obj.observation() ),
         strImageMask_( obj.strImageMask() ),
         strDirObservation_( obj.strDirObservation() ),
+        strLightTable_( obj.strLightTable() ),
+        strImageAmbient_( obj.strImageAmbient() ),
         color_( obj.color() )
     {}
     //@}
@@ -183,6 +394,8 @@ class ObservationAll
         observation_ = obj.observation();
         strImageMask_ = obj.strImageMask();
         strDirObservation_ = obj.strDirObservation();
+        strLightTable_ = obj.strLightTable();
+        strImageAmbient_ = obj.strImageAmbient();
         color_ = obj.color();
 
         return *this;
@@ -192,6 +405,8 @@ class ObservationAll
         observation_ = obj.observation();
         strImageMask_ = obj.strImageMask();
         strDirObservation_ = obj.strDirObservation();
+        strLightTable_ = obj.strLightTable();
+        strImageAmbient_ = obj.strImageAmbient();
         color_ = obj.color();
 
         return *this;
@@ -206,6 +421,10 @@ class ObservationAll
     std::string strImageMask(void) const {return strImageMask_;}
     //! returns \c strDirObservation_, Name of a directory, which contains all observation data.
     std::string strDirObservation(void) const {return strDirObservation_;}
+    //! returns \c strLightTable_, Filename of the light table, which overrides light sources of each observation if not empty.
+    std::string strLightTable(void) const {return strLightTable_;}
+    //! returns \c strImageAmbient_, Filename of the ambient image, i.e., an image without any light, which is subtracted from each observation if not empty.
+    std::string strImageAmbient(void) const {return strImageAmbient_;}
     //! returns \c observation_, A set of single observation.
     std::vector<ObservationSingle> observation(void) const {return observation_;}
     //! returns \c index-th observation.
@@ -216,6 +435,10 @@ class ObservationAll
     void strImageMask(const std::string  strImageMask){strImageMask_ = strImageMask;}
     //! sets \c strDirObservation_, Name of a directory, which contains all observation data.
     void strDirObservation(const std::string strDirObservation){strDirObservation_ = strDirObservation;}
+    //! sets \c strLightTable_, Filename of the light table, which overrides light sources of each observation if not empty.
+    void strLightTable(const std::string strLightTable){strLightTable_ = strLightTable;}
+    //! sets \c strImageAmbient_, Filename of the ambient image, i.e., an image without any light, which is subtracted from each observation if not empty.
+    void strImageAmbient(const std::string strImageAmbient){strImageAmbient_ = strImageAmbient;}
     //! sets \c observation_, A set of single observation.
     void observation(const std::vector<ObservationSingle> observation){observation_ = observation;}
     //! sets \c color_, the number of color channels of input images.
@@ -223,7 +446,7 @@ class ObservationAll
     //! adds a single observation.
     void addObservation(const ObservationSingle obs){observation_.push_back(obs);}
     //! returns the number of observation.
-    int numberOfObservation(void) const {observation_.size();}
+    int numberOfObservation(void) const {return observation_.size();}
     //@}
 
 private:
@@ -233,6 +456,10 @@ private:
     std::string strImageMask_;
     //! Name of a directory, which contains all observation data.
     std::string strDirObservation_;
+    //! Filename of the light table, which overrides light sources of each observation if not empty.
+    std::string strLightTable_;
+    //! Filename of the ambient image, which is subtracted from each observation if not empty.
+    std::string strImageAmbient_;
     //! The number of color channels of input images.
     int color_;
 };
@@ -259,11 +486,13 @@ public:
     CpsConfig(
         const ObservationAll obsAll = ObservationAll(),
         const std::string strDirOutput = "",
-        const std::string strReflection = ""
+        const std::string strReflection = "",
+        const std::vector<std::string> outputFormat = std::vector<std::string>(1, "PNG")
     ):
         obsAll_(obsAll),
         strDirOutput_(strDirOutput),
-        strReflection_(strReflection)
+        strReflection_(strReflection),
+        outputFormat_(outputFormat)
     {}
     //! Copy constructor.
     CpsConfig(
@@ -271,7 +500,8 @@ public:
     ):
         obsAll_(config.obsAll()),
         strDirOutput_(config.strDirOutput()),
-        strReflection_(config.strReflection())
+        strReflection_(config.strReflection()),
+        outputFormat_(config.outputFormat())
     {}
     //@}
 
@@ -285,6 +515,11 @@ public:
     //! sets \c strDirOutput_, Name of a directory, which contains all output data.
     void strDirOutput(const std::string  strDirOutput){strDirOutput_ = strDirOutput;}
 
+    //! returns \c outputFormat_, Formats of output images (PNG, PFM, NPY or RAW).
+    std::vector<std::string> outputFormat(void) const {return outputFormat_;}
+    //! sets \c outputFormat_, Formats of output images (PNG, PFM, NPY or RAW).
+    void outputFormat(const std::vector<std::string>& outputFormat){outputFormat_ = outputFormat;}
+
     //! returns \c strReflection_, Name of reflectance model.
     std::string strReflection(void) const {return strReflection_;}
     //! sets \c strReflection_, Name of reflectance model.
@@ -307,6 +542,16 @@ public:
     //! sets \c obsAll_.strImageMask_, Filename of the image mask.
     void strImageMask(const std::string  strImageMask){obsAll_.strImageMask(strImageMask);}
 
+    //! returns \c obsAll_.strLightTable_, Filename of the light table.
+    std::string strLightTable(void) const {return obsAll_.strLightTable();}
+    //! sets \c obsAll_.strLightTable_, Filename of the light table.
+    void strLightTable(const std::string strLightTable){obsAll_.strLightTable(strLightTable);}
+
+    //! returns \c obsAll_.strImageAmbient_, Filename of the ambient image.
+    std::string strImageAmbient(void) const {return obsAll_.strImageAmbient();}
+    //! sets \c obsAll_.strImageAmbient_, Filename of the ambient image.
+    void strImageAmbient(const std::string strImageAmbient){obsAll_.strImageAmbient(strImageAmbient);}
+
     //! sets \c observation_, A set of single observation.
     void observation(const std::vector<ObservationSingle> observation){obsAll_.observation(observation);}
     //! adds a single observation.
@@ -332,6 +577,8 @@ private:
     std::string strDirOutput_;
     //! Name of reflectance model.
     std::string strReflection_;
+    //! Formats of output images (PNG, PFM, NPY or RAW).
+    std::vector<std::string> outputFormat_;
     //@}
 };
 
@@ -359,13 +606,15 @@ public:
     CalibratedPhotometricStereo(
         const CpsConfig& config = CpsConfig()
     ):
-        config_(config)
+        config_(config),
+        whiteLevel_( (DataType)255 )
     {}
     //! Copy constructor.
     CalibratedPhotometricStereo(
         const CalibratedPhotometricStereo& cps
     ):
-        config_( cps.config() )
+        config_( cps.config() ),
+        whiteLevel_( cps.whiteLevel() )
     {}
     //@}
 
@@ -389,13 +638,23 @@ public:
     //! sets \c height_, Image width.
     void height(const int height){height_ = height;}
 
+    //! returns \c region_, The region of the image in its frame.
+    const ImageRegion& region(void) const {return region_;}
+    //! sets \c region_, The region of the image in its frame.
+    void region(const ImageRegion& region){region_ = region;}
+
+    //! returns \c whiteLevel_, The white level of the observations.
+    DataType whiteLevel(void) const {return whiteLevel_;}
+    //! sets \c whiteLevel_, The white level of the observations.
+    void whiteLevel(const DataType whiteLevel){whiteLevel_ = whiteLevel;}
+
     //! returns \c color_, The number of color channels.
     int color(void) const {return color_;}
     //! sets \c color_, The number of color channels.
     void color(const int color){color_ = color;}
 
     //! returns \c indexOfPixels_, The indices of available pixels.
-    std::vector<int> indexOfPixels(void) const {return indexOfPixels_;}
+    const std::vector<int>& indexOfPixels(void) const {return indexOfPixels_;}
     //! sets \c indexOfPixels_, The indices of available pixels.
     void indexOfPixels(const std::vector<int>& indexOfPixels){indexOfPixels_ = indexOfPixels; numberOfPixels_ = indexOfPixels_.size();}
     //! returns \c numberOfPixels_, The number of available pixels.
@@ -406,29 +665,43 @@ public:
     int numberOfPixels(void) const {return numberOfPixels_;}
 
     //! returns \c I_.
-    Eigen::Matrix<DataType, -1, -1> I(void) const {return I_;}
+    const Eigen::Matrix<DataType, -1, -1>& I(void) const {return I_;}
+    //! returns \c I_ to be filled in place, which avoids a copy of the largest matrix.
+    Eigen::Matrix<DataType, -1, -1>& I(void) {return I_;}
     //! sets \c I_.
     void I(const Eigen::Matrix<DataType, -1, -1>& I){I_ = I;}
     //! returns \c S_.
-    Eigen::Matrix<DataType, -1, -1> S(void) const {return S_;}
+    const Eigen::Matrix<DataType, -1, -1>& S(void) const {return S_;}
     //! sets \c S_.
     void S(const Eigen::Matrix<DataType, -1, -1>& S){S_ = S;}
     //! returns \c R_.
-    Eigen::Matrix<DataType, -1, -1> R(void) const {return R_;}
+    const Eigen::Matrix<DataType, -1, -1>& R(void) const {return R_;}
     //! sets \c R_.
     void R(const Eigen::Matrix<DataType, -1, -1>& R){R_ = R;}
     //! returns \c N_.
-    Eigen::Matrix<DataType, -1, -1> N(void) const {return N_;}
+    const Eigen::Matrix<DataType, -1, -1>& N(void) const {return N_;}
     //! sets \c N_.
     void N(const Eigen::Matrix<DataType, -1, -1>& N){N_ = N;}
+    //! returns \c validity_.
+    const ValidityMask& validity(void) const {return validity_;}
+    //! returns \c validity_ to be filled while \c I_ is gathered.
+    ValidityMask& validity(void) {return validity_;}
     //! returns \c L_.
-    Eigen::Matrix<DataType, -1, -1> L(void) const {return L_;}
+    const Eigen::Matrix<DataType, -1, -1>& L(void) const {return L_;}
     //! sets \c L_.
     void L(const Eigen::Matrix<DataType, -1, -1>& L){L_ = L;}
     //! returns \c Idiff_.
-    Eigen::Matrix<DataType, -1, -1> Idiff(void) const {return Idiff_;}
+    const Eigen::Matrix<DataType, -1, -1>& Idiff(void) const {return Idiff_;}
     //! sets \c Idiff_.
     void Idiff(const Eigen::Matrix<DataType, -1, -1>& Idiff){Idiff_ = Idiff;}
+    //! returns \c Theta_.
+    const Eigen::Matrix<DataType, -1, -1>& Theta(void) const {return Theta_;}
+    //! sets \c Theta_.
+    void Theta(const Eigen::Matrix<DataType, -1, -1>& Theta){Theta_ = Theta;}
+    //! returns \c confidence_.
+    const Eigen::Matrix<DataType, -1, -1>& confidence(void) const {return confidence_;}
+    //! sets \c confidence_.
+    void confidence(const Eigen::Matrix<DataType, -1, -1>& confidence){confidence_ = confidence;}
     //@}
 private:
     //------------------------------------------
@@ -446,6 +719,10 @@ private:
     int width_;
     //! Image height.
     int height_;
+    //! The region of the image in its frame.
+    ImageRegion region_;
+    //! The white level of the observations, e.g., 255 for 8 bits, 65535 for 16 bits, and 1 for floating point.
+    DataType whiteLevel_;
     //! The number of color channels.
     int color_;
     //! The number of available pixels.
@@ -456,6 +733,8 @@ private:
     int numberOfImages_;
     //! The observation matrix \c I = pxf matrix, which satisfies \c I = SL.
     Eigen::Matrix<DataType, -1, -1> I_;
+    //! Validity of each sample of \c I_.
+    ValidityMask validity_;
     //! The surface matrix \c S = px3 matrix, which satisfies \c I = SL.
     Eigen::Matrix<DataType, -1, -1> S_;
     //! The surface albedo matrix \c R = pxc vector, which satisfies \c S = RN.
@@ -466,6 +745,10 @@ private:
     Eigen::Matrix<DataType, -1, -1> L_;
     //! The reprojection error matrix \c Idiff = pxf matrix, which satisfies \c Idiff = I - SL.
     Eigen::Matrix<DataType, -1, -1> Idiff_;
+    //! The reflectance parameters matrix \c Theta = px(1+e) matrix, which holds specular coefficient and e shape parameters of non-Lambertian models.
+    Eigen::Matrix<DataType, -1, -1> Theta_;
+    //! The confidence matrix = px3 matrix, which holds the number of active lights, the reciprocal condition number of their light matrix, and the normalized residual of each pixel.
+    Eigen::Matrix<DataType, -1, -1> confidence_;
     //@}
 };
 
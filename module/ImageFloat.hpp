@@ -0,0 +1,279 @@
+#ifndef __IMAGEFLOAT_H__
+#define __IMAGEFLOAT_H__
+
+/*!
+ * \file ImageFloat.hpp
+ *
+ * \date 2026/10/18
+ * \brief This file contains writers of floating point images, i.e., PFM, NPY and headered raw format, which keep exact values unlike 8-bit PNG.
+ *
+ * Each writer converts the planar \c CImg buffer into one interleaved buffer, writes it by a single sequential write, and syncs it to the disk.
+ * The headered raw format (.raw) is:
+ * \code
+ * char[8]  magic "CPSRAW01"
+ * int32    header size in bytes (including magic)
+ * int32    width
+ * int32    height
+ * int32    channels
+ * int32    bytes per value (4: float, 8: double)
+ * int32    x and y offset of the image in its frame
+ * int32    frame width and height, which are larger than width and height if the image is cropped
+ * values   height x width x channels, row-major, interleaved, native byte order
+ * \endcode
+ * Readers should skip to the header size, since fields can be added before the values.
+ * PNG, PFM and NPY have no field for the offset of a cropped image, so \c saveImageRegion() writes the region of all outputs of a directory as a text sidecar (region.txt):
+ * \code
+ * x 120
+ * y 80
+ * width 256
+ * height 192
+ * widthFrame 640
+ * heightFrame 480
+ * \endcode
+ *
+ */
+
+// STL
+#include <vector>
+#include <string>
+#include <iostream>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+// POSIX
+#include <fcntl.h>
+#include <unistd.h>
+
+// CImg
+#include <CImg.h>
+
+// internal headers
+#include "DataStructure.hpp"
+
+//! returns \c true if this machine stores values as little endian.
+inline bool isLittleEndian(void)
+{
+    const unsigned short one = 1;
+    return *(const unsigned char*)&one == 1;
+}
+
+//! converts planar \c img into interleaved (row-major, height x width x channels) buffer. Rows are stored from bottom to top if \c flagBottomUp.
+template <typename DataType, typename OutputType>
+inline void interleaveImage(
+    const cimg_library::CImg<DataType>& img,
+    std::vector<OutputType>& buffer,
+    const bool flagBottomUp = false
+)
+{
+    int width = img.width();
+    int height = img.height();
+    int channels = img.spectrum();
+    buffer.resize( (size_t)width*height*channels );
+    for(int y = 0; y < height; ++y)
+    {
+        int yOut = flagBottomUp ? height-1-y : y;
+        OutputType* ptr = &buffer[ (size_t)yOut*width*channels ];
+        for(int x = 0; x < width; ++x)
+        {
+            for(int c = 0; c < channels; ++c)
+            {
+                *ptr++ = (OutputType)img(x, y, 0, c);
+            }
+        }
+    }
+}
+
+//! flushes \c strFile from the page cache to the disk, so that it is durable. returns \c false if it fails.
+inline bool syncFile(
+    const std::string& strFile
+)
+{
+    int fd = open( strFile.c_str(), O_RDONLY );
+    if( fd < 0 )
+    {
+        return false;
+    }
+    bool flagSuccess = (fsync(fd) == 0);
+    return (close(fd) == 0) && flagSuccess;
+}
+
+//! writes \c header and \c buffer to \c strSave by sequential writes. returns \c false if it fails.
+template <typename OutputType>
+inline bool writeBuffer(
+    const std::string& strSave,
+    const std::string& header,
+    const std::vector<OutputType>& buffer
+)
+{
+    std::FILE* fp = std::fopen( strSave.c_str(), "wb" );
+    if( fp == NULL )
+    {
+        std::cerr << "Cannot open " << strSave << std::endl;
+        return false;
+    }
+    bool flagSuccess = std::fwrite( header.data(), 1, header.size(), fp ) == header.size();
+    if( flagSuccess && !buffer.empty() )
+    {
+        flagSuccess = std::fwrite( &buffer[0], sizeof(OutputType), buffer.size(), fp ) == buffer.size();
+    }
+    flagSuccess = (std::fflush(fp) == 0) && (fsync(fileno(fp)) == 0) && flagSuccess;
+    flagSuccess = (std::fclose(fp) == 0) && flagSuccess;
+    if( !flagSuccess )
+    {
+        std::cerr << "Failed to write " << strSave << std::endl;
+    }
+    return flagSuccess;
+}
+
+//! saves \c img as Portable Float Map, which stores 1 or 3 channel 32-bit float values from bottom to top row.
+template <typename DataType>
+inline bool saveImagePfm(
+    const cimg_library::CImg<DataType>& img,
+    const std::string& strSave
+)
+{
+    assert(
+        (img.spectrum() == 1 || img.spectrum() == 3) &&
+        "PFM supports 1 or 3 channels only."
+    );
+    std::vector<float> buffer;
+    interleaveImage(img, buffer, true);
+
+    char header[64];
+    std::sprintf(header, "%s\n%d %d\n%s\n", img.spectrum() == 3 ? "PF" : "Pf", img.width(), img.height(), isLittleEndian() ? "-1.0" : "1.0");
+
+    return writeBuffer( strSave, std::string(header), buffer );
+}
+
+//! saves \c img as NumPy .npy file (version 1.0) of shape (height, width, channels).
+template <typename DataType>
+inline bool saveImageNpy(
+    const cimg_library::CImg<DataType>& img,
+    const std::string& strSave
+)
+{
+    std::vector<DataType> buffer;
+    interleaveImage(img, buffer);
+
+    char dict[128];
+    std::sprintf(
+        dict,
+        "{'descr': '%c%c%d', 'fortran_order': False, 'shape': (%d, %d, %d), }",
+        isLittleEndian() ? '<' : '>',
+        'f',
+        (int)sizeof(DataType),
+        img.height(),
+        img.width(),
+        img.spectrum()
+    );
+    // magic(6) + version(2) + header length(2) + dict, padded by spaces and terminated by '\n' to a multiple of 64 bytes.
+    std::string strDict(dict);
+    size_t lenTotal = 10 + strDict.size() + 1;
+    strDict.append( (64 - lenTotal % 64) % 64, ' ' );
+    strDict += '\n';
+    unsigned short lenHeader = (unsigned short)strDict.size();
+
+    std::string header("\x93NUMPY\x01\x00", 8);
+    header += (char)(lenHeader & 0xff);
+    header += (char)(lenHeader >> 8);
+    header += strDict;
+
+    return writeBuffer( strSave, header, buffer );
+}
+
+//! saves \c img cropped as \c region from its frame as headered raw file, see the file description for its layout.
+template <typename DataType>
+inline bool saveImageRaw(
+    const cimg_library::CImg<DataType>& img,
+    const std::string& strSave,
+    const ImageRegion& region = ImageRegion()
+)
+{
+    std::vector<DataType> buffer;
+    interleaveImage(img, buffer);
+
+    int fields[9] = {
+        8 + 9*(int)sizeof(int),
+        img.width(),
+        img.height(),
+        img.spectrum(),
+        (int)sizeof(DataType),
+        region.x,
+        region.y,
+        std::max( region.widthFrame, img.width() ),
+        std::max( region.heightFrame, img.height() )
+    };
+    std::string header("CPSRAW01", 8);
+    header.append( (const char*)fields, sizeof(fields) );
+
+    return writeBuffer( strSave, header, buffer );
+}
+
+//! saves \c region of the images cropped from their frame as text file of "key value" lines, see the file description for its layout.
+inline bool saveImageRegion(
+    const ImageRegion& region,
+    const std::string& strSave
+)
+{
+    char text[256];
+    std::sprintf(
+        text,
+        "x %d\ny %d\nwidth %d\nheight %d\nwidthFrame %d\nheightFrame %d\n",
+        region.x,
+        region.y,
+        region.width,
+        region.height,
+        std::max( region.widthFrame, region.width ),
+        std::max( region.heightFrame, region.height )
+    );
+    return writeBuffer( strSave, std::string(text), std::vector<char>() );
+}
+
+//! saves \c img in each format of \c formats (PNG, PFM, NPY or RAW) as \c strSave plus its extension. PNG stores \c scale*(img+offset) quantized to 8 bits, while the other formats store exact values. RAW also stores \c region of a cropped image, which is written for the other formats by \c saveImageRegion().
+template <typename DataType>
+inline bool saveImageFormats(
+    const cimg_library::CImg<DataType>& img,
+    const std::string& strSave,
+    const std::vector<std::string>& formats,
+    const DataType scale = (DataType)1,
+    const DataType offset = (DataType)0,
+    const ImageRegion& region = ImageRegion()
+)
+{
+    bool flagSuccess = true;
+    for(size_t n = 0; n < formats.size(); ++n)
+    {
+        if( formats[n] == "PNG" )
+        {
+            cimg_library::CImg<DataType> imgQuantized( img );
+            for(size_t i = 0; i < imgQuantized.size(); ++i)
+            {
+                imgQuantized.data()[i] = scale * (imgQuantized.data()[i] + offset);
+            }
+            imgQuantized.save( (strSave + ".png").c_str() );
+            flagSuccess = syncFile( strSave + ".png" ) && flagSuccess;
+        }
+        else if( formats[n] == "PFM" )
+        {
+            flagSuccess = saveImagePfm( img, strSave + ".pfm" ) && flagSuccess;
+        }
+        else if( formats[n] == "NPY" )
+        {
+            flagSuccess = saveImageNpy( img, strSave + ".npy" ) && flagSuccess;
+        }
+        else if( formats[n] == "RAW" )
+        {
+            flagSuccess = saveImageRaw( img, strSave + ".raw", region ) && flagSuccess;
+        }
+        else
+        {
+            std::cerr << "Unknown output format " << formats[n] << std::endl;
+            flagSuccess = false;
+        }
+    }
+    return flagSuccess;
+}
+
+#endif
@@ -0,0 +1,292 @@
+#ifndef __LIGHTCALIBRATION_H__
+#define __LIGHTCALIBRATION_H__
+
+/*!
+ * \file LightCalibration.hpp
+ *
+ * \date 2026/10/18
+ * \brief This file contains light source calibration from images of a chrome sphere, e.g., psmImages/chrome.
+ *
+ * The sphere is detected from the mask, and the specular highlight of each image gives the sphere normal \c n at the highlight.
+ * The light direction is the mirror direction of the view direction \c v = (0,0,1), i.e., \c l = 2(n.v)n - v.
+ * The coordinate system has x axis to the right, y axis to the top of the image, and z axis towards the camera.
+ *
+ */
+
+// STL
+#include <vector>
+#include <string>
+#include <iostream>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+// Eigen
+#include <Eigen/Core>
+#include <Eigen/Dense>
+
+// internal headers
+#include "utilString.hpp"
+#include "DataStructure.hpp"
+#include "Image.hpp"
+#include "LightTable.hpp"
+
+namespace CPS
+{
+
+/*!
+ * \class SphereInImage
+ *
+ * \brief represents a sphere projected to the image, i.e., center and radius in pixel.
+ *
+ */
+template <typename DataType = float>
+struct SphereInImage
+{
+    SphereInImage(const DataType cx_ = 0, const DataType cy_ = 0, const DataType radius_ = 0): cx(cx_), cy(cy_), radius(radius_){}
+    DataType cx;
+    DataType cy;
+    DataType radius;
+};
+
+//! detects the sphere given its mask as \c indexOfPixels, by fitting a circle to the boundary pixels of the mask.
+template <typename DataType>
+inline SphereInImage<DataType> detectSphere(
+    const std::vector<int>& indexOfPixels,
+    const int width,
+    const int height
+)
+{
+    std::vector<bool> flagMask(width*height, false);
+    for(size_t p = 0; p < indexOfPixels.size(); ++p)
+    {
+        flagMask[indexOfPixels[p]] = true;
+    }
+
+    // algebraic circle fit (Kasa): x^2 + y^2 + a*x + b*y + c = 0.
+    Eigen::Matrix<double, 3, 3> A = Eigen::Matrix<double, 3, 3>::Zero();
+    Eigen::Matrix<double, 3, 1> b = Eigen::Matrix<double, 3, 1>::Zero();
+    Eigen::Matrix<double, 3, 1> row;
+    int numberOfBoundary = 0;
+    int x, y;
+    for(size_t p = 0; p < indexOfPixels.size(); ++p)
+    {
+        x = indexOfPixels[p] % width;
+        y = indexOfPixels[p] / width;
+        bool flagBoundary =
+            x == 0 || y == 0 || x == width-1 || y == height-1 ||
+            !flagMask[indexOfPixels[p]-1] || !flagMask[indexOfPixels[p]+1] ||
+            !flagMask[indexOfPixels[p]-width] || !flagMask[indexOfPixels[p]+width];
+        if( flagBoundary )
+        {
+            row << x, y, 1.0;
+            A += row * row.transpose();
+            b -= row * (double)(x*x + y*y);
+            ++numberOfBoundary;
+        }
+    }
+    assert(
+        numberOfBoundary >= 3 &&
+        "The mask of the sphere must have at least 3 boundary pixels."
+    );
+    Eigen::Matrix<double, 3, 1> abc = A.ldlt().solve(b);
+
+    SphereInImage<DataType> sphere;
+    sphere.cx = (DataType)( -abc(0) / 2.0 );
+    sphere.cy = (DataType)( -abc(1) / 2.0 );
+    sphere.radius = (DataType)std::sqrt( std::max( (double)(sphere.cx*sphere.cx + sphere.cy*sphere.cy) - abc(2), 0.0 ) );
+
+    return sphere;
+}
+
+//! finds the specular highlight in image \c strImage of \c width x \c height, the size of the mask, with sub-pixel precision (\c x, \c y), as the intensity weighted centroid of the brightest pixels in the mask which are connected to the brightest one, so that a highlight elsewhere, e.g., an interreflection, does not pull the centroid.
+template <typename DataType>
+inline void findHighlight(
+    const std::string strImage,
+    const std::vector<int>& indexOfPixels,
+    const int width,
+    const int height,
+    DataType& x,
+    DataType& y,
+    const DataType ratioThreshold = (DataType)0.9
+)
+{
+    ImageSingle<DataType, DataType> img( strImage );
+    assert(
+        img._width() == width && img._height() == height &&
+        "The image must be the size of the mask."
+    );
+    int numberOfPixels = indexOfPixels.size();
+    int color = img._color();
+
+    // intensity of each pixel in the mask, averaged over color channels.
+    std::vector<DataType> intensity(numberOfPixels, (DataType)0);
+    DataType valMax = (DataType)0;
+    int pMax = 0;
+    for(int p = 0; p < numberOfPixels; ++p)
+    {
+        for(int c = 0; c < color; ++c)
+        {
+            intensity[p] += img(indexOfPixels[p]%width, indexOfPixels[p]/width, c);
+        }
+        intensity[p] /= color;
+        if( intensity[p] > valMax )
+        {
+            valMax = intensity[p];
+            pMax = p;
+        }
+    }
+
+    // position of each image pixel in the mask, or -1.
+    std::vector<int> indexInMask(width*height, -1);
+    for(int p = 0; p < numberOfPixels; ++p)
+    {
+        indexInMask[indexOfPixels[p]] = p;
+    }
+
+    // the centroid of the 8-connected blob of pixels above the threshold around the brightest pixel.
+    DataType threshold = ratioThreshold * valMax;
+    DataType weightSum = (DataType)0;
+    DataType weight;
+    x = (DataType)0;
+    y = (DataType)0;
+    std::vector<bool> flagVisited(numberOfPixels, false);
+    std::vector<int> stack(1, pMax);
+    flagVisited[pMax] = true;
+    while( !stack.empty() )
+    {
+        int p = stack.back();
+        stack.pop_back();
+        int xp = indexOfPixels[p] % width;
+        int yp = indexOfPixels[p] / width;
+        weight = intensity[p] - threshold + std::numeric_limits<DataType>::epsilon();
+        x += weight * xp;
+        y += weight * yp;
+        weightSum += weight;
+
+        for(int dy = -1; dy <= 1; ++dy)
+        {
+            for(int dx = -1; dx <= 1; ++dx)
+            {
+                if( xp+dx < 0 || xp+dx >= width || yp+dy < 0 || yp+dy >= height )
+                {
+                    continue;
+                }
+                int q = indexInMask[(yp+dy)*width+(xp+dx)];
+                if( q >= 0 && !flagVisited[q] && intensity[q] >= threshold )
+                {
+                    flagVisited[q] = true;
+                    stack.push_back(q);
+                }
+            }
+        }
+    }
+    x /= weightSum;
+    y /= weightSum;
+}
+
+//! computes light direction given the highlight (x, y) on the \c sphere.
+template <typename DataType>
+inline Eigen::Matrix<DataType, 3, 1> computeLightDirection(
+    const SphereInImage<DataType>& sphere,
+    const DataType x,
+    const DataType y
+)
+{
+    Eigen::Matrix<DataType, 3, 1> n;
+    n(0) = (x - sphere.cx) / sphere.radius;
+    n(1) = -(y - sphere.cy) / sphere.radius;
+    DataType r2 = n(0)*n(0) + n(1)*n(1);
+    if( r2 > (DataType)1 )
+    { // the highlight is outside of the fitted circle, which can happen at grazing lights.
+        n.template head<2>() /= std::sqrt(r2);
+        r2 = (DataType)1;
+    }
+    n(2) = std::sqrt( (DataType)1 - r2 );
+
+    Eigen::Matrix<DataType, 3, 1> v(0, 0, 1);
+    Eigen::Matrix<DataType, 3, 1> l = (DataType)2 * n.dot(v) * n - v;
+
+    return l.normalized();
+}
+
+//! estimates light direction of each observation in \c obsSingle, given images of a chrome sphere and its mask \c indexOfPixels. The images are processed in parallel.
+template <typename DataType>
+inline Eigen::Matrix<DataType, -1, -1> calibrateLightDirection(
+    const std::vector<CPS::ObservationSingle>& obsSingle,
+    const std::vector<int>& indexOfPixels,
+    const int width,
+    const int height
+)
+{
+    int numberOfImages = obsSingle.size();
+
+    SphereInImage<DataType> sphere = detectSphere<DataType>(indexOfPixels, width, height);
+    std::cout << "sphere center (" << sphere.cx << ", " << sphere.cy << "), radius " << sphere.radius << std::endl;
+
+    Eigen::Matrix<DataType, -1, -1> D = Eigen::Matrix<DataType, -1, -1>::Zero(3, numberOfImages);
+    std::vector<DataType> highlightX(numberOfImages);
+    std::vector<DataType> highlightY(numberOfImages);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for(int f = 0; f < numberOfImages; ++f)
+    { // f means "f"rame
+        findHighlight<DataType>(
+            obsSingle[f].strImage(),
+            indexOfPixels,
+            width,
+            height,
+            highlightX[f],
+            highlightY[f]
+        );
+        D.col(f) = computeLightDirection(sphere, highlightX[f], highlightY[f]);
+    }
+
+    for(int f = 0; f < numberOfImages; ++f)
+    {
+        std::cout << "  " << obsSingle[f].strImage() << ": highlight (" << highlightX[f] << ", " << highlightY[f] << "), direction " << D.col(f).transpose() << std::endl;
+    }
+
+    return D;
+}
+
+//! replaces light direction of each observation in \c config by \c D (3xf), and removes its light table, whose intensities are kept as the light intensity of each observation.
+template <typename DataType>
+inline CPS::CpsConfig applyLightDirection(
+    const CPS::CpsConfig& config,
+    const Eigen::Matrix<DataType, -1, -1>& D
+)
+{
+    assert(
+        config.numberOfObservation() == D.cols() &&
+        "The number of calibrated lights must be same as the number of observations."
+    );
+    std::vector<CPS::ObservationSingle> obsSingle = config.obsAll().observation();
+    // the calibrated directions replace a light table, so that its intensities move to the observations.
+    Eigen::Matrix<DataType, -1, -1> directionTable, intensity;
+    bool flagIntensity = !config.strLightTable().empty() &&
+        loadLightTable( config.strLightTable(), config.numberOfObservation(), directionTable, &intensity );
+    if( !config.strLightTable().empty() && !flagIntensity )
+    {
+        std::cerr << "The intensities of the light table " << config.strLightTable() << " are not kept." << std::endl;
+    }
+    for(size_t f = 0; f < obsSingle.size(); ++f)
+    { // f means "f"rame
+        obsSingle[f].lightDirection( toString(D(0,f)) + " " + toString(D(1,f)) + " " + toString(D(2,f)) );
+        if( flagIntensity )
+        {
+            obsSingle[f].lightIntensity( (float)intensity(0,f) );
+        }
+    }
+    CPS::CpsConfig configCalibrated( config );
+    configCalibrated.observation( obsSingle );
+    configCalibrated.strLightTable( "" );
+
+    return configCalibrated;
+}
+
+} // end of namespace CPS
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef __LIGHTSELECTION_H__
+#define __LIGHTSELECTION_H__
+
+/*!
+ * \file LightSelection.hpp
+ *
+ * \date 2026/10/18
+ * \brief This file contains selection of a subset of lights, which conditions the per-pixel solve best, so that only the frames of the subset are loaded and solved.
+ *
+ * The Lambertian solve s = I L^+ amplifies noise of the observations by (L L^T)^{-1}.
+ * Lights are selected greedily to maximize det(L_k L_k^T) of the subset L_k (D-optimal design), i.e., the light l maximizing l^T M^{-1} l is added to the subset of M = L_k L_k^T.
+ * The accuracy loss is estimated as the ratio of sqrt(trace((L L^T)^{-1})), i.e., the RMS error of the solved surface under i.i.d. noise, of the subset to all lights.
+ *
+ */
+
+// STL
+#include <vector>
+#include <iostream>
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+#include <limits>
+
+// Eigen
+#include <Eigen/Core>
+#include <Eigen/LU>
+
+namespace CPS
+{
+
+/*!
+ * \class LightSelection
+ *
+ * \brief represents a subset of lights and its estimated cost and accuracy against all lights.
+ *
+ */
+struct LightSelection
+{
+    LightSelection(): numberOfLights(0), noiseGainAll(0.0), noiseGainSelected(0.0){}
+
+    //! returns the speedup of loading and solving the subset, which is linear in the number of lights.
+    double speedup(void) const {return indexOfLights.empty() ? 1.0 : (double)numberOfLights / indexOfLights.size();}
+    //! returns the estimated increase of the RMS error of the subset, e.g., 0.1 for 10%.
+    double accuracyLoss(void) const {return noiseGainAll > 0.0 ? noiseGainSelected / noiseGainAll - 1.0 : 0.0;}
+
+    //! The number of all lights.
+    int numberOfLights;
+    //! The indices of the selected lights in ascending order.
+    std::vector<int> indexOfLights;
+    //! sqrt(trace((L L^T)^{-1})) of all lights.
+    double noiseGainAll;
+    //! sqrt(trace((L L^T)^{-1})) of the selected lights.
+    double noiseGainSelected;
+};
+
+//! returns sqrt(trace(M^{-1})) of the information matrix \c M, or infinity if it is singular.
+inline double computeNoiseGain(
+    const Eigen::Matrix3d& M
+)
+{
+    Eigen::FullPivLU<Eigen::Matrix3d> lu( M );
+    if( !lu.isInvertible() )
+    {
+        return std::numeric_limits<double>::infinity();
+    }
+    return std::sqrt( lu.inverse().trace() );
+}
+
+//! selects \c numberOfSelected lights of the light source matrix \c L (3 x f) maximizing the determinant of their information matrix.
+template <typename DataType>
+inline LightSelection selectLights(
+    const Eigen::Matrix<DataType, -1, -1>& L,
+    const int numberOfSelected
+)
+{
+    assert( L.rows() == 3 && numberOfSelected >= 3 );
+    int numberOfLights = L.cols();
+    Eigen::Matrix<double, -1, -1> Ld = L.template cast<double>();
+
+    LightSelection selection;
+    selection.numberOfLights = numberOfLights;
+    selection.noiseGainAll = computeNoiseGain( Ld * Ld.transpose() );
+
+    // a small ridge keeps M invertible until 3 independent lights are selected.
+    double ridge = 1e-6 * ( Ld.squaredNorm() / std::max(numberOfLights, 1) );
+    Eigen::Matrix3d M = ridge * Eigen::Matrix3d::Identity();
+    std::vector<bool> flagSelected( numberOfLights, false );
+    for(int k = 0; k < std::min(numberOfSelected, numberOfLights); ++k)
+    {
+        Eigen::Matrix3d Minv = M.inverse();
+        int fBest = -1;
+        double gainBest = -1.0;
+        for(int f = 0; f < numberOfLights; ++f)
+        { // f means "f"rame
+            if( flagSelected[f] )
+            {
+                continue;
+            }
+            double gain = Ld.col(f).dot( Minv * Ld.col(f) );
+            if( gain > gainBest )
+            {
+                gainBest = gain;
+                fBest = f;
+            }
+        }
+        flagSelected[fBest] = true;
+        M.noalias() += Ld.col(fBest) * Ld.col(fBest).transpose();
+    }
+
+    Eigen::Matrix3d Mselected = Eigen::Matrix3d::Zero();
+    for(int f = 0; f < numberOfLights; ++f)
+    {
+        if( flagSelected[f] )
+        {
+            selection.indexOfLights.push_back( f );
+            Mselected.noalias() += Ld.col(f) * Ld.col(f).transpose();
+        }
+    }
+    selection.noiseGainSelected = computeNoiseGain( Mselected );
+
+    return selection;
+}
+
+//! shows \c selection.
+inline void showLightSelection(
+    const LightSelection& selection
+)
+{
+    std::cout << "selected " << selection.indexOfLights.size() << " of " << selection.numberOfLights << " lights:";
+    for(size_t n = 0; n < selection.indexOfLights.size(); ++n)
+    {
+        std::cout << " " << selection.indexOfLights[n];
+    }
+    std::cout << std::endl;
+    std::cout << "  speedup " << selection.speedup() << "x, estimated RMS error +" << 100.0 * selection.accuracyLoss() << "%"
+              << " (noise gain " << selection.noiseGainSelected << " against " << selection.noiseGainAll << ")" << std::endl;
+}
+
+} // end of namespace CPS
+
+#endif
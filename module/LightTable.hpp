@@ -0,0 +1,269 @@
+#ifndef __LIGHTTABLE_H__
+#define __LIGHTTABLE_H__
+
+/*!
+ * \file LightTable.hpp
+ *
+ * \date 2026/10/18
+ * \brief This file contains a loader and a writer of a light table, which gives light sources of all observations in one file instead of each observation entry.
+ *
+ * A light table is either a text or a binary file.
+ * The text file has a line per observation of its light direction "x y z" optionally followed by its intensity (1 if omitted).
+ * An optional first line of a single number, i.e., the number of lights as lights.txt of psmImages, empty lines and lines starting with '#' are skipped.
+ * The binary file (.bin) is:
+ * \code
+ * char[8]  magic "CPSLIT01"
+ * int32    the number of lights f
+ * float32  light directions (f x 3), row-major
+ * float32  light intensities (f)
+ * \endcode
+ * Both are read through a mapped file, and numbers are parsed by a locale-free parser without any allocation directly into the light source matrix.
+ *
+ */
+
+// STL
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <cstring>
+#include <algorithm>
+
+// Eigen
+#include <Eigen/Core>
+
+// Boost
+#include <boost/iostreams/device/mapped_file.hpp>
+
+namespace CPS
+{
+
+//! parses a decimal number such as "-0.25" or "1e-3" at \c ptr before \c end into \c value, and advances \c ptr after it. returns \c false if \c ptr is not at a number.
+inline bool parseNumber(
+    const char*& ptr,
+    const char* end,
+    double& value
+)
+{
+    static const double pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18};
+
+    const char* p = ptr;
+    bool flagNegative = false;
+    if( p < end && (*p == '-' || *p == '+') )
+    {
+        flagNegative = (*p == '-');
+        ++p;
+    }
+    // digits beyond 18 significant ones only shift the exponent.
+    unsigned long long mantissa = 0;
+    int exponent = 0;
+    int numberOfDigits = 0;
+    int numberOfSignificant = 0;
+    for( ; p < end && *p >= '0' && *p <= '9'; ++p, ++numberOfDigits )
+    {
+        if( numberOfSignificant < 18 )
+        {
+            mantissa = mantissa*10 + (*p - '0');
+            numberOfSignificant += (mantissa > 0);
+        }
+        else
+        {
+            ++exponent;
+        }
+    }
+    if( p < end && *p == '.' )
+    {
+        for( ++p; p < end && *p >= '0' && *p <= '9'; ++p, ++numberOfDigits )
+        {
+            if( numberOfSignificant < 18 )
+            {
+                mantissa = mantissa*10 + (*p - '0');
+                numberOfSignificant += (mantissa > 0);
+                --exponent;
+            }
+        }
+    }
+    if( numberOfDigits == 0 )
+    {
+        return false;
+    }
+    if( p < end && (*p == 'e' || *p == 'E') )
+    {
+        const char* q = p+1;
+        bool flagNegativeExponent = false;
+        if( q < end && (*q == '-' || *q == '+') )
+        {
+            flagNegativeExponent = (*q == '-');
+            ++q;
+        }
+        if( q < end && *q >= '0' && *q <= '9' )
+        {
+            int exponentGiven = 0;
+            for( ; q < end && *q >= '0' && *q <= '9'; ++q )
+            {
+                exponentGiven = std::min( exponentGiven*10 + (*q - '0'), 9999 );
+            }
+            exponent += flagNegativeExponent ? -exponentGiven : exponentGiven;
+            p = q;
+        }
+    }
+
+    value = (double)mantissa;
+    for( ; exponent > 18; exponent -= 18 ) value *= pow10[18];
+    for( ; exponent < -18; exponent += 18 ) value /= pow10[18];
+    value = exponent >= 0 ? value * pow10[exponent] : value / pow10[-exponent];
+    if( flagNegative )
+    {
+        value = -value;
+    }
+    ptr = p;
+    return true;
+}
+
+//! loads the light table \c strFile of \c numberOfImages lights into the light source matrix \c L (3 x f), whose columns are directions scaled by intensities. If \c intensity is given, \c L is not scaled and \c intensity (1 x f) gets the intensities instead, e.g., for light positions. returns \c false if it is invalid.
+template <typename DataType>
+inline bool loadLightTable(
+    const std::string& strFile,
+    const int numberOfImages,
+    Eigen::Matrix<DataType, -1, -1>& L,
+    Eigen::Matrix<DataType, -1, -1>* intensity = NULL
+)
+{
+    boost::iostreams::mapped_file_source file;
+    try
+    {
+        file.open( strFile );
+    }
+    catch( const std::exception& )
+    {
+        std::cerr << "Cannot open the light table " << strFile << std::endl;
+        return false;
+    }
+    const char* ptr = file.data();
+    const char* end = ptr + file.size();
+    L.resize( 3, numberOfImages );
+    if( intensity != NULL )
+    {
+        intensity->resize( 1, numberOfImages );
+    }
+
+    if( file.size() >= 12 && std::memcmp( ptr, "CPSLIT01", 8 ) == 0 )
+    {
+        int numberOfLights;
+        std::memcpy( &numberOfLights, ptr+8, sizeof(int) );
+        if( numberOfLights != numberOfImages || file.size() < 12 + (size_t)numberOfLights*4*sizeof(float) )
+        {
+            std::cerr << "The light table " << strFile << " has " << numberOfLights << " lights for " << numberOfImages << " images" << std::endl;
+            return false;
+        }
+        const char* ptrDirection = ptr + 12;
+        const char* ptrIntensity = ptrDirection + (size_t)numberOfLights*3*sizeof(float);
+        for(int f = 0; f < numberOfImages; ++f)
+        { // f means "f"rame
+            float intensity;
+            std::memcpy( &intensity, ptrIntensity + f*sizeof(float), sizeof(float) );
+            for(int d = 0; d < 3; ++d)
+            { // d means "d"imension
+                float direction;
+                std::memcpy( &direction, ptrDirection + (3*f+d)*sizeof(float), sizeof(float) );
+                L(d,f) = (DataType)( intensity * direction );
+            }
+        }
+        if( intensity != NULL )
+        {
+            for(int f = 0; f < numberOfImages; ++f)
+            {
+                float value;
+                std::memcpy( &value, ptrIntensity + f*sizeof(float), sizeof(float) );
+                (*intensity)(0,f) = (DataType)value;
+                L.col(f) /= (DataType)value;
+            }
+        }
+        return true;
+    }
+
+    int f = 0;
+    bool flagFirstLine = true;
+    while( ptr < end )
+    {
+        const char* endLine = (const char*)std::memchr( ptr, '\n', end-ptr );
+        if( endLine == NULL )
+        {
+            endLine = end;
+        }
+
+        double values[4];
+        int numberOfValues = 0;
+        const char* p = ptr;
+        while( p < endLine && *p != '#' )
+        {
+            if( *p == ' ' || *p == '\t' || *p == '\r' || *p == ',' || *p == ';' )
+            {
+                ++p;
+            }
+            else if( numberOfValues == 4 || !parseNumber( p, endLine, values[numberOfValues++] ) )
+            {
+                std::cerr << "Invalid values of light " << f << " in the light table " << strFile << std::endl;
+                return false;
+            }
+        }
+        ptr = endLine + 1;
+
+        if( numberOfValues == 0 )
+        {
+            continue;
+        }
+        if( numberOfValues == 1 && flagFirstLine )
+        {
+            flagFirstLine = false;
+            continue;
+        }
+        flagFirstLine = false;
+        if( numberOfValues < 3 || f >= numberOfImages )
+        {
+            std::cerr << "The light table " << strFile << " does not have 3 or 4 values for each of " << numberOfImages << " images" << std::endl;
+            return false;
+        }
+        double value = numberOfValues == 4 ? values[3] : 1.0;
+        for(int d = 0; d < 3; ++d)
+        {
+            L(d,f) = (DataType)( ( intensity != NULL ? 1.0 : value ) * values[d] );
+        }
+        if( intensity != NULL )
+        {
+            (*intensity)(0,f) = (DataType)value;
+        }
+        ++f;
+    }
+    if( f != numberOfImages )
+    {
+        std::cerr << "The light table " << strFile << " has " << f << " lights for " << numberOfImages << " images" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+//! saves the light source matrix \c L (3 x f) as the text light table \c strSave of the number of lights and "x y z intensity" of each light, which \c loadLightTable() loads. returns \c false if it fails.
+template <typename DataType>
+inline bool saveLightTable(
+    const std::string& strSave,
+    const Eigen::Matrix<DataType, -1, -1>& L
+)
+{
+    std::ofstream ofs( strSave.c_str() );
+    ofs << L.cols() << std::endl;
+    ofs << std::setprecision(9);
+    for(int f = 0; f < L.cols(); ++f)
+    { // f means "f"rame
+        double intensity = L.col(f).template cast<double>().norm();
+        double scale = intensity > 0.0 ? 1.0 / intensity : 0.0;
+        ofs << L(0,f) * scale << " " << L(1,f) * scale << " " << L(2,f) * scale << " " << intensity << std::endl;
+    }
+
+    return !ofs.fail();
+}
+
+} // end of namespace CPS
+
+#endif
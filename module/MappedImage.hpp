@@ -0,0 +1,398 @@
+#ifndef __MAPPEDIMAGE_H__
+#define __MAPPEDIMAGE_H__
+
+/*!
+ * \file MappedImage.hpp
+ *
+ * \date 2026/10/18
+ * \brief This file contains a reader of uncompressed images, which maps the file and reads each pixel in place without decoding the whole frame.
+ *
+ * It reads
+ * - binary PGM (P5) and PPM (P6) of 8 or 16 bits (big-endian) per value,
+ * - uncompressed TGA of 8-bit gray (type 3) and 24/32-bit BGR(A) (type 2) stored from bottom or top,
+ * - Portable Float Map (PFM) of 1 or 3 channels in the byte order of this machine,
+ * - NumPy .npy of shape (height, width) or (height, width, channels) of uint8, uint16, float32 or float64 in the byte order of this machine,
+ * - headered raw (.raw) written by \c saveImageRaw() in ImageFloat.hpp,
+ *
+ * in their native precision with the same values and channel order as \c CImg. \c maxValue() is the white level of the format, e.g., 255 for 8 bits, the maximum value of 16-bit PGM/PPM, and 1 for floating point. Any other file is rejected by \c open(), and is read by \c ImageSingle instead.
+ *
+ */
+
+// STL
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cstddef>
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+
+// Boost
+#include <boost/iostreams/device/mapped_file.hpp>
+
+/*!
+ * \class MappedImage
+ *
+ * \brief represents an uncompressed image mapped from its file.
+ *
+ */
+class MappedImage
+{
+public:
+    //! Types of values in the file.
+    enum Encoding
+    {
+        UINT8 = 0,
+        UINT16_BIG_ENDIAN,
+        UINT16,
+        FLOAT32,
+        FLOAT64
+    };
+
+    //--------------------------------------------------------
+    //
+    //! \name Constructors / Destructor / Instance Management
+    //@{
+    //--------------------------------------------------------
+    //! Default constructor.
+    MappedImage():
+        width_(0),
+        height_(0),
+        channels_(0),
+        encoding_(UINT8),
+        maxValue_(0.0),
+        ptrData_(NULL),
+        strideRow_(0),
+        stridePixel_(0)
+    {}
+    //@}
+
+    //! maps \c strFile, and returns \c true if it is an image supported by this reader.
+    bool open(
+        const std::string& strFile
+    )
+    {
+        close();
+        try
+        {
+            file_.open( strFile );
+        }
+        catch( const std::exception& )
+        {
+            return false;
+        }
+        // TGA has no magic number, so that it is identified by its extension.
+        std::string strExtension = strFile.substr( std::min( strFile.size(), strFile.rfind('.') ) );
+        std::transform( strExtension.begin(), strExtension.end(), strExtension.begin(), ::tolower );
+        if( !file_.is_open() || !( parsePnm() || parsePfm() || parseNpy() || parseRaw() || (strExtension == ".tga" && parseTga()) ) )
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+    //! unmaps the file.
+    void close(void)
+    {
+        if( file_.is_open() )
+        {
+            file_.close();
+        }
+        width_ = height_ = channels_ = 0;
+        ptrData_ = NULL;
+    }
+
+    //! returns a value of pixel (x,y) in channel \c c, which is clamped to the last channel as \c ImageSingle.
+    double operator()(
+        const int x,
+        const int y,
+        const int c
+    ) const
+    {
+        const unsigned char* ptr = ptrData_ + (std::ptrdiff_t)y*strideRow_ + (std::ptrdiff_t)x*stridePixel_ + offsetChannel_[ std::min(c, channels_-1) ];
+        switch( encoding_ )
+        {
+        case UINT8:
+            return *ptr;
+        case UINT16_BIG_ENDIAN:
+            return (ptr[0] << 8) | ptr[1];
+        case UINT16:
+            {
+                unsigned short value;
+                std::memcpy( &value, ptr, sizeof(unsigned short) );
+                return value;
+            }
+        case FLOAT32:
+            {
+                float value;
+                std::memcpy( &value, ptr, sizeof(float) );
+                return value;
+            }
+        case FLOAT64:
+            {
+                double value;
+                std::memcpy( &value, ptr, sizeof(double) );
+                return value;
+            }
+        }
+        return 0.0;
+    }
+
+    //! returns \c width_, Image width.
+    int width(void) const {return width_;}
+    //! returns \c height_, Image height.
+    int height(void) const {return height_;}
+    //! returns \c channels_, The number of channels.
+    int channels(void) const {return channels_;}
+    //! returns \c maxValue_, The white level of the format.
+    double maxValue(void) const {return maxValue_;}
+
+private:
+    //! parses the header of binary PGM or PPM.
+    bool parsePnm(void)
+    {
+        const char* ptr = file_.data();
+        const char* end = ptr + file_.size();
+        if( file_.size() < 3 || ptr[0] != 'P' || (ptr[1] != '5' && ptr[1] != '6') )
+        {
+            return false;
+        }
+        int channels = ( ptr[1] == '6' ) ? 3 : 1;
+        ptr += 2;
+
+        // width, height and maximum value separated by white spaces or comments, and a single white space before values.
+        int fields[3];
+        for(int n = 0; n < 3; ++n)
+        {
+            while( ptr < end && ( *ptr == ' ' || *ptr == '\t' || *ptr == '\r' || *ptr == '\n' || *ptr == '#' ) )
+            {
+                if( *ptr == '#' )
+                {
+                    while( ptr < end && *ptr != '\n' ) ++ptr;
+                }
+                else
+                {
+                    ++ptr;
+                }
+            }
+            fields[n] = 0;
+            const char* ptrDigits = ptr;
+            for( ; ptr < end && *ptr >= '0' && *ptr <= '9'; ++ptr )
+            {
+                fields[n] = fields[n]*10 + (*ptr - '0');
+            }
+            if( ptr == ptrDigits )
+            {
+                return false;
+            }
+        }
+        ++ptr;
+
+        int bytesPerValue = fields[2] < 256 ? 1 : 2;
+        maxValue_ = fields[2];
+        return setLayout( fields[0], fields[1], channels, bytesPerValue == 1 ? UINT8 : UINT16_BIG_ENDIAN, bytesPerValue,
+                          (const unsigned char*)ptr, false, false );
+    }
+
+    //! parses the header of uncompressed TGA.
+    bool parseTga(void)
+    {
+        const unsigned char* header = (const unsigned char*)file_.data();
+        if( file_.size() < 18 )
+        {
+            return false;
+        }
+        int lengthId = header[0];
+        int typeColorMap = header[1];
+        int typeImage = header[2];
+        int width = header[12] | (header[13] << 8);
+        int height = header[14] | (header[15] << 8);
+        int bitsPerPixel = header[16];
+        int descriptor = header[17];
+
+        // color mapped, run-length encoded and right-to-left images are left to CImg.
+        if( typeColorMap != 0 || (descriptor & 0x10) != 0 ||
+            !( (typeImage == 2 && (bitsPerPixel == 24 || bitsPerPixel == 32)) || (typeImage == 3 && bitsPerPixel == 8) ) )
+        {
+            return false;
+        }
+        maxValue_ = 255.0;
+        return setLayout( width, height, bitsPerPixel/8, UINT8, 1,
+                          header + 18 + lengthId, typeImage == 2, (descriptor & 0x20) == 0 );
+    }
+
+    //! parses the header of Portable Float Map, whose rows are stored from bottom to top.
+    bool parsePfm(void)
+    {
+        const char* ptr = file_.data();
+        const char* end = ptr + file_.size();
+        if( file_.size() < 3 || ptr[0] != 'P' || (ptr[1] != 'F' && ptr[1] != 'f') )
+        {
+            return false;
+        }
+        int channels = ( ptr[1] == 'F' ) ? 3 : 1;
+        ptr += 2;
+
+        // width, height and scale, whose sign is negative for little endian, each followed by white spaces.
+        double fields[3];
+        for(int n = 0; n < 3; ++n)
+        {
+            while( ptr < end && ( *ptr == ' ' || *ptr == '\t' || *ptr == '\r' || *ptr == '\n' ) ) ++ptr;
+            char* ptrEnd = NULL;
+            std::string strField( ptr, std::min<std::ptrdiff_t>( end-ptr, 32 ) );
+            fields[n] = std::strtod( strField.c_str(), &ptrEnd );
+            if( ptrEnd == strField.c_str() )
+            {
+                return false;
+            }
+            ptr += ptrEnd - strField.c_str();
+        }
+        ++ptr;
+
+        const unsigned short one = 1;
+        bool flagLittleEndian = ( *(const unsigned char*)&one == 1 );
+        if( (fields[2] < 0.0) != flagLittleEndian )
+        {
+            return false;
+        }
+        maxValue_ = 1.0;
+        return setLayout( (int)fields[0], (int)fields[1], channels, FLOAT32, 4,
+                          (const unsigned char*)ptr, false, true );
+    }
+
+    //! parses the header of NumPy .npy, which must be C-ordered.
+    bool parseNpy(void)
+    {
+        const char* ptr = file_.data();
+        if( file_.size() < 10 || std::memcmp( ptr, "\x93NUMPY", 6 ) != 0 )
+        {
+            return false;
+        }
+        size_t lengthHeader = ( ptr[6] == 1 ) ? ( (unsigned char)ptr[8] | ((unsigned char)ptr[9] << 8) ) : 0;
+        size_t offsetData = 10 + lengthHeader;
+        if( ptr[6] != 1 || offsetData > file_.size() )
+        {
+            return false;
+        }
+        std::string strDict( ptr+10, lengthHeader );
+
+        const unsigned short one = 1;
+        char order = ( *(const unsigned char*)&one == 1 ) ? '<' : '>';
+        Encoding encoding;
+        int bytesPerValue;
+        if( strDict.find( std::string("'descr': '|u1'") ) != std::string::npos )
+        {
+            encoding = UINT8; bytesPerValue = 1; maxValue_ = 255.0;
+        }
+        else if( strDict.find( std::string("'descr': '") + order + "u2'" ) != std::string::npos )
+        {
+            encoding = UINT16; bytesPerValue = 2; maxValue_ = 65535.0;
+        }
+        else if( strDict.find( std::string("'descr': '") + order + "f4'" ) != std::string::npos )
+        {
+            encoding = FLOAT32; bytesPerValue = 4; maxValue_ = 1.0;
+        }
+        else if( strDict.find( std::string("'descr': '") + order + "f8'" ) != std::string::npos )
+        {
+            encoding = FLOAT64; bytesPerValue = 8; maxValue_ = 1.0;
+        }
+        else
+        {
+            return false;
+        }
+        std::string::size_type posShape = strDict.find( "'shape': (" );
+        if( strDict.find( "'fortran_order': False" ) == std::string::npos || posShape == std::string::npos )
+        {
+            return false;
+        }
+        int shape[3] = {0, 0, 1};
+        int numberOfAxes = std::sscanf( strDict.c_str() + posShape + 10, "%d, %d, %d", &shape[0], &shape[1], &shape[2] );
+        if( numberOfAxes < 2 )
+        {
+            return false;
+        }
+        return setLayout( shape[1], shape[0], shape[2], encoding, bytesPerValue,
+                          (const unsigned char*)ptr + offsetData, false, false );
+    }
+
+    //! parses the header of headered raw.
+    bool parseRaw(void)
+    {
+        const char* ptr = file_.data();
+        int fields[5];
+        if( file_.size() < 8 + sizeof(fields) || std::memcmp( ptr, "CPSRAW01", 8 ) != 0 )
+        {
+            return false;
+        }
+        std::memcpy( fields, ptr+8, sizeof(fields) );
+        if( fields[4] != 4 && fields[4] != 8 )
+        {
+            return false;
+        }
+        maxValue_ = 1.0;
+        return setLayout( fields[1], fields[2], fields[3], fields[4] == 4 ? FLOAT32 : FLOAT64, fields[4],
+                          (const unsigned char*)ptr + fields[0], false, false );
+    }
+
+    //! sets the layout of interleaved values from \c ptrData, whose channels are stored in reverse order if \c flagBgr, and rows from bottom to top if \c flagBottomUp. returns \c false if the file is too short.
+    bool setLayout(
+        const int width,
+        const int height,
+        const int channels,
+        const Encoding encoding,
+        const int bytesPerValue,
+        const unsigned char* ptrData,
+        const bool flagBgr,
+        const bool flagBottomUp
+    )
+    {
+        if( width <= 0 || height <= 0 || channels <= 0 || channels > 4 )
+        {
+            return false;
+        }
+        const unsigned char* ptrBegin = (const unsigned char*)file_.data();
+        std::ptrdiff_t sizeRow = (std::ptrdiff_t)width*channels*bytesPerValue;
+        if( ptrData < ptrBegin || ptrData + sizeRow*height > ptrBegin + file_.size() )
+        {
+            return false;
+        }
+
+        width_ = width;
+        height_ = height;
+        channels_ = channels;
+        encoding_ = encoding;
+        stridePixel_ = channels*bytesPerValue;
+        strideRow_ = flagBottomUp ? -sizeRow : sizeRow;
+        ptrData_ = flagBottomUp ? ptrData + sizeRow*(height-1) : ptrData;
+        for(int c = 0; c < channels; ++c)
+        {
+            // BGR(A) is read as RGB(A).
+            int cStored = ( flagBgr && c < 3 && channels >= 3 ) ? 2-c : c;
+            offsetChannel_[c] = cStored*bytesPerValue;
+        }
+        return true;
+    }
+
+    //! The mapped file.
+    boost::iostreams::mapped_file_source file_;
+    //! Image width.
+    int width_;
+    //! Image height.
+    int height_;
+    //! The number of channels.
+    int channels_;
+    //! Type of values.
+    Encoding encoding_;
+    //! The white level of the format.
+    double maxValue_;
+    //! Pointer to pixel (0,0), i.e., the top-left pixel.
+    const unsigned char* ptrData_;
+    //! Bytes from a row to the next one, which is negative if rows are stored from bottom to top.
+    std::ptrdiff_t strideRow_;
+    //! Bytes from a pixel to the next one.
+    std::ptrdiff_t stridePixel_;
+    //! Bytes from a pixel to each channel.
+    int offsetChannel_[4];
+};
+
+#endif
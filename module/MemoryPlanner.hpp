@@ -0,0 +1,250 @@
+#ifndef __MEMORYPLANNER_H__
+#define __MEMORYPLANNER_H__
+
+/*!
+ * \file MemoryPlanner.hpp
+ *
+ * \date 2026/10/18
+ * \brief This file contains a planner, which estimates peak memory of photometric stereo before loading any image, and chooses its execution mode.
+ *
+ * The execution modes are
+ * - in-core: the observation matrix \c I and all intermediate matrices are on memory, and solved at once.
+ * - tiled: \c I is on memory, and the pixels are solved tile by tile, so that intermediate matrices are as large as a tile.
+ * - out-of-core: \c I is stored in a memory mapped file in the output directory, and the pixels are solved tile by tile.
+ *
+ */
+
+// STL
+#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <algorithm>
+
+// POSIX
+#include <unistd.h>
+
+namespace CPS
+{
+
+/*!
+ * \class MemoryPlan
+ *
+ * \brief represents the execution mode, the tile size and the memory estimation behind them.
+ *
+ */
+struct MemoryPlan
+{
+    enum Mode
+    {
+        IN_CORE,
+        TILED,
+        OUT_OF_CORE
+    };
+
+    MemoryPlan(): mode(IN_CORE), limit(0), peakInCore(0), peakTiled(0), peakPlanned(0), sizeTile(0), numberOfTiles(1){}
+    //! The execution mode.
+    Mode mode;
+    //! The memory limit in bytes.
+    size_t limit;
+    //! Estimated peak memory of in-core execution in bytes.
+    size_t peakInCore;
+    //! Estimated peak memory of tiled execution in bytes.
+    size_t peakTiled;
+    //! Estimated peak memory of the chosen mode in bytes.
+    size_t peakPlanned;
+    //! The number of pixels in a tile.
+    int sizeTile;
+    //! The number of tiles.
+    int numberOfTiles;
+};
+
+//! returns the name of \c mode.
+inline std::string nameOfMode(
+    const MemoryPlan::Mode mode
+)
+{
+    switch( mode )
+    {
+    case MemoryPlan::IN_CORE:
+        return "in-core";
+    case MemoryPlan::TILED:
+        return "tiled";
+    default:
+        return "out-of-core";
+    }
+}
+
+//! returns \c size in bytes with a human readable unit.
+inline std::string formatMemorySize(
+    const size_t size
+)
+{
+    const char* units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+    double value = (double)size;
+    int u = 0;
+    while( value >= 1024.0 && u < 4 )
+    {
+        value /= 1024.0;
+        ++u;
+    }
+    char str[32];
+    std::sprintf(str, "%.1f %s", value, units[u]);
+    return std::string(str);
+}
+
+//! parses memory size such as "1073741824", "512M", "4G" or "4GiB", where K, M, G and T are powers of 1024. returns 0 if \c str is invalid.
+inline size_t parseMemorySize(
+    const std::string& str
+)
+{
+    char* ptrEnd = NULL;
+    double value = std::strtod( str.c_str(), &ptrEnd );
+    if( ptrEnd == str.c_str() || value < 0.0 )
+    {
+        return 0;
+    }
+    std::string strUnit( ptrEnd );
+    double scale = 1.0;
+    if( !strUnit.empty() )
+    {
+        switch( std::toupper(strUnit[0]) )
+        {
+        case 'K': scale = 1024.0; break;
+        case 'M': scale = 1024.0*1024.0; break;
+        case 'G': scale = 1024.0*1024.0*1024.0; break;
+        case 'T': scale = 1024.0*1024.0*1024.0*1024.0; break;
+        case 'B': break;
+        default: return 0;
+        }
+    }
+    return (size_t)( value * scale );
+}
+
+//! returns the memory available to this process, i.e., the smaller of the physical memory and the cgroup (v2 or v1) limit.
+inline size_t readMemoryLimit(void)
+{
+    size_t limit = (size_t)sysconf(_SC_PHYS_PAGES) * (size_t)sysconf(_SC_PAGE_SIZE);
+
+    const char* files[] = {
+        "/sys/fs/cgroup/memory.max",
+        "/sys/fs/cgroup/memory/memory.limit_in_bytes"
+    };
+    for(int i = 0; i < 2; ++i)
+    {
+        std::ifstream ifs( files[i] );
+        std::string str;
+        if( ifs >> str && str != "max" )
+        {
+            size_t limitCgroup = (size_t)std::strtoull( str.c_str(), NULL, 10 );
+            if( limitCgroup > 0 )
+            {
+                limit = std::min( limit, limitCgroup );
+            }
+        }
+    }
+
+    return limit;
+}
+
+//! estimates peak memory of each execution mode given the image size, the number of available pixels, images, color channels, reflectance shape parameters and threads, and chooses the mode that fits in \c limit. Tiles start at multiples of \c sizeAlignment pixels. \c flagChromaticity accounts for the chromaticity-aware color solve, which solves S of the luminance.
+template <typename DataType>
+inline MemoryPlan planMemory(
+    const int width,
+    const int height,
+    const int numberOfPixels,
+    const int numberOfImages,
+    const int color,
+    const int numberOfShape,
+    const int numberOfThreads,
+    const size_t limit,
+    const bool flagDisplay = true,
+    const int sizeAlignment = 1,
+    const bool flagChromaticity = false
+)
+{
+    const size_t sz = sizeof(DataType);
+    const size_t P = numberOfPixels;
+    const size_t C = color;
+    const size_t F = numberOfImages;
+    const size_t frame = (size_t)width * height;
+
+    // I (pc x f).
+    size_t sizeI = P*C*F*sz;
+    // a decoded input image, its conversion to DataType, and the mask.
+    size_t sizeInput = frame*C*(sz+1) + frame + P*sizeof(int);
+    // output images of albedo, normal, error and confidence, which are held by the writer, copied for display, and converted once more while encoded.
+    size_t sizeOutput = frame*(C+3+C+3)*sz * (flagDisplay ? 2 : 1) + frame*std::max<size_t>(C, 3)*sz * std::max(numberOfThreads, 1);
+    // R (pc), N (px3), Theta (px(1+e)), per-pixel RMS (pc) and confidence (px3) of all pixels.
+    size_t sizeResult = (P*C + P*3 + P*(1+numberOfShape) + P*C + P*3)*sz;
+    // per pixel intermediates of the solver, i.e., S and its temporary (2 x pc x 3), R, N, Theta, RMS and confidence of a tile, and the conditioning and RMS observation (2 x pc) of the confidence.
+    size_t sizeIntermediatePerPixel = (2*C*3 + C + 3 + (1+numberOfShape) + C + 3 + 2*C)*sz;
+    if( flagChromaticity && C > 1 )
+    {
+        // the luminance (p x f) and S of it (2 x p x 3) instead.
+        sizeIntermediatePerPixel = (F + 2*3 + C + 3 + (1+numberOfShape) + C + 3 + 2*C)*sz;
+    }
+
+    MemoryPlan plan;
+    plan.limit = limit;
+    plan.peakInCore = sizeI + std::max( sizeInput, P*sizeIntermediatePerPixel + sizeResult + sizeOutput );
+
+    // a tile additionally holds its copy of I.
+    size_t sizeTilePerPixel = C*F*sz + sizeIntermediatePerPixel;
+    size_t sizeFixed = sizeResult + sizeOutput;
+    const int sizeTileMin = std::min(numberOfPixels, 4096);
+
+    if( plan.peakInCore <= limit )
+    {
+        plan.mode = MemoryPlan::IN_CORE;
+        plan.sizeTile = numberOfPixels;
+        plan.peakPlanned = plan.peakInCore;
+    }
+    else
+    {
+        // tiled: I stays on memory; out-of-core: I is paged from the mapped file, so that only a tile of it counts.
+        size_t sizeBase = sizeI + sizeFixed;
+        plan.mode = MemoryPlan::TILED;
+        if( sizeBase + sizeTileMin*sizeTilePerPixel > limit )
+        {
+            plan.mode = MemoryPlan::OUT_OF_CORE;
+            sizeBase = sizeFixed;
+        }
+        size_t sizeBudget = limit > sizeBase ? limit - sizeBase : 0;
+        plan.sizeTile = (int)std::min( (size_t)numberOfPixels, std::max( (size_t)sizeTileMin, sizeBudget / sizeTilePerPixel ) );
+        if( plan.sizeTile < numberOfPixels )
+        {
+            plan.sizeTile = std::max( sizeAlignment, plan.sizeTile / sizeAlignment * sizeAlignment );
+        }
+        plan.peakPlanned = sizeBase + plan.sizeTile*sizeTilePerPixel;
+    }
+    plan.sizeTile = std::max( plan.sizeTile, 1 );
+    plan.numberOfTiles = (numberOfPixels + plan.sizeTile - 1) / plan.sizeTile;
+    plan.peakTiled = sizeI + sizeFixed + plan.sizeTile*sizeTilePerPixel;
+
+    return plan;
+}
+
+//! shows \c plan.
+inline void showMemoryPlan(
+    const MemoryPlan& plan
+)
+{
+    std::cout << "memory plan: " << nameOfMode(plan.mode)
+              << ", " << plan.numberOfTiles << " tile(s) of " << plan.sizeTile << " pixels"
+              << ", estimated peak " << formatMemorySize(plan.peakPlanned)
+              << " (in-core " << formatMemorySize(plan.peakInCore)
+              << ", tiled " << formatMemorySize(plan.peakTiled)
+              << ") of limit " << formatMemorySize(plan.limit) << std::endl;
+    if( plan.peakPlanned > plan.limit )
+    {
+        std::cout << "memory plan: the estimated peak exceeds the limit even out of core." << std::endl;
+    }
+}
+
+} // end of namespace CPS
+
+#endif
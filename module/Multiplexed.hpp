@@ -0,0 +1,99 @@
+#ifndef __MULTIPLEXED_H__
+#define __MULTIPLEXED_H__
+
+/*!
+ * \file Multiplexed.hpp
+ *
+ * \date 2026/10/18
+ * \brief This file contains single-shot photometric stereo multiplexed by colored lights, which solves a normal map from each RGB frame, e.g., of a video of a moving object.
+ *
+ * Each of 3 differently colored lights k at L_k (direction times intensity) is seen by the color channels of the camera by the crosstalk X (c x k), i.e., X(c,k) is the response of channel c to light k on a white surface.
+ * A pixel of albedo rho and normal n observes I_c = rho sum_k X(c,k) L_k^T n in channel c, i.e., the channels of a frame are 3 gray observations under the multiplexed light matrix L X^T (3 x 3).
+ * The surface S = rho n of each pixel is solved by the inverse of the multiplexed light matrix, which is computed once for all frames, assuming the surface reflects the lights equally, i.e., it is gray or of a calibrated color.
+ * Both the lights and the crosstalk are light tables of 3 lines in the order of the channels, i.e., "x y z [intensity]" of each light and "r g b" of the response to each light.
+ *
+ */
+
+// STL
+#include <string>
+#include <iostream>
+#include <limits>
+
+// Eigen
+#include <Eigen/Core>
+#include <Eigen/LU>
+
+// internal headers
+#include "DataStructure.hpp"
+#include "LightTable.hpp"
+
+namespace CPS
+{
+
+//! builds the multiplexed light matrix \c L (3 x 3) from the light table \c strLight of the 3 colored lights and the light table \c strCrosstalk of their crosstalk, which is the identity if empty. returns \c false if either is invalid or the matrix is singular.
+template <typename DataType>
+inline bool buildMultiplexedLightMatrix(
+    const std::string& strLight,
+    const std::string& strCrosstalk,
+    Eigen::Matrix<DataType, -1, -1>& L
+)
+{
+    Eigen::Matrix<DataType, -1, -1> lights;
+    if( !loadLightTable( strLight, 3, lights ) )
+    {
+        return false;
+    }
+    Eigen::Matrix<DataType, -1, -1> X = Eigen::Matrix<DataType, -1, -1>::Identity( 3, 3 );
+    if( !strCrosstalk.empty() && !loadLightTable( strCrosstalk, 3, X ) )
+    {
+        return false;
+    }
+    std::cout << "multiplexed lights of " << strLight << ", crosstalk" << std::endl << X << std::endl;
+
+    L = lights * X.transpose();
+    Eigen::FullPivLU< Eigen::Matrix<DataType, 3, 3> > lu( L );
+    if( !lu.isInvertible() )
+    {
+        std::cerr << "The multiplexed lights of " << strLight << " do not span 3 dimensions" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+//! estimates surface normal \c N (p x 3) and albedo \c R (1 x p) of frame \c f from its channels \c ptrColumn (pc, c = 3), given the inverse \c Linv of the multiplexed light matrix. Pixels having an invalid sample in \c validity, if given, and dark pixels are set to zero.
+template <typename DataType>
+inline void estimateSurfaceMultiplexed(
+    const DataType* ptrColumn,
+    const int numberOfPixels,
+    const Eigen::Matrix<DataType, 3, 3>& Linv,
+    const int f,
+    const ValidityMask* validity,
+    Eigen::Matrix<DataType, -1, -1>& N,
+    Eigen::Matrix<DataType, -1, -1>& R
+)
+{
+    typedef Eigen::Matrix<DataType, 1, 3> RowVector3;
+    bool flagValidity = ( validity != NULL && validity->numberOfPixels() > 0 );
+    DataType tol = std::numeric_limits<DataType>::epsilon() * (DataType)255;
+
+    N.resize( numberOfPixels, 3 );
+    R.resize( 1, numberOfPixels );
+    for(int p = 0; p < numberOfPixels; ++p)
+    { // p means "p"ixel
+        RowVector3 i( ptrColumn[p], ptrColumn[numberOfPixels+p], ptrColumn[2*numberOfPixels+p] );
+        RowVector3 s = i * Linv;
+        DataType rho = s.norm();
+        if( ( flagValidity && !validity->isValid(p, f) ) || i.norm() < tol || rho <= (DataType)0 )
+        {
+            N.row(p).setZero();
+            R(p) = (DataType)0;
+            continue;
+        }
+        N.row(p) = s / rho;
+        R(p) = rho;
+    }
+}
+
+} // end of namespace CPS
+
+#endif
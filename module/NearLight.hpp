@@ -0,0 +1,298 @@
+#ifndef __NEARLIGHT_H__
+#define __NEARLIGHT_H__
+
+/*!
+ * \file NearLight.hpp
+ *
+ * \date 2026/10/18
+ * \brief This file contains near point lights, whose direction and irradiance vary over the pixels, and the per-pixel Lambertian solve under them.
+ *
+ * A pixel (x, y) of the frame is the point X = ((x + 0.5 - w/2) s, -(y + 0.5 - h/2) s, 0) on the reference plane, where w x h is the frame and s is the pixel size, i.e., x right, y up and z toward the camera as light directions.
+ * Light f at position P_f of intensity e_f lights the point X by l_f = e_f (P_f - X) / |P_f - X|^(1 + falloff), i.e., the inverse square law if falloff is 2.
+ * The light matrix (3 x f) of each pixel is computed when the pixel is solved or predicted instead of being stored, and the pixel is solved by its 3x3 normal equations.
+ *
+ */
+
+// STL
+#include <vector>
+#include <cmath>
+#include <limits>
+
+// Eigen
+#include <Eigen/Core>
+#include <Eigen/LU>
+
+// internal headers
+#include "DataStructure.hpp"
+#include "ConfidenceMap.hpp"
+
+namespace CPS
+{
+
+/*!
+ * \class NearLight
+ *
+ * \brief represents near point lights and the points of the available pixels lit by them.
+ *
+ */
+template <typename DataType = float>
+class NearLight
+{
+public:
+    typedef Eigen::Matrix<DataType, -1, -1> Matrix;
+    typedef Eigen::Matrix<DataType, 3, 1> Vector3;
+    typedef Eigen::Matrix<DataType, 3, -1> LightMatrix;
+
+    //! Default constructor.
+    NearLight():
+        falloff_( (DataType)2 ),
+        pixelSize_( (DataType)1 ),
+        indexOfPixels_( NULL ),
+        width_( 0 ),
+        factor_( 1 ),
+        pixelBegin_( 0 )
+    {}
+    //! Constructor given light positions \c position (3 x f) and intensities \c intensity (1 x f).
+    NearLight(
+        const Matrix& position,
+        const Matrix& intensity,
+        const DataType falloff,
+        const DataType pixelSize
+    ):
+        position_( position ),
+        intensity_( intensity ),
+        falloff_( falloff ),
+        pixelSize_( pixelSize ),
+        indexOfPixels_( NULL ),
+        width_( 0 ),
+        factor_( 1 ),
+        pixelBegin_( 0 )
+    {}
+
+    //! sets the pixels lit by the lights, i.e., \c indexOfPixels of \c region decimated by \c factor as \c gatherObservationMatrix(). \c indexOfPixels is referred to, not copied.
+    void pixels(
+        const std::vector<int>& indexOfPixels,
+        const int width,
+        const int factor,
+        const ImageRegion& region
+    )
+    {
+        indexOfPixels_ = &indexOfPixels;
+        width_ = width;
+        factor_ = factor;
+        region_ = region;
+        pixelBegin_ = 0;
+    }
+
+    //! returns the point of pixel \c p on the reference plane.
+    Vector3 point(const int p) const
+    {
+        int index = (*indexOfPixels_)[pixelBegin_+p];
+        DataType x = ( (DataType)( region_.x + index % width_ ) + (DataType)0.5 ) * factor_ - (DataType)0.5 * region_.widthFrame * factor_;
+        DataType y = ( (DataType)( region_.y + index / width_ ) + (DataType)0.5 ) * factor_ - (DataType)0.5 * region_.heightFrame * factor_;
+        return Vector3( x * pixelSize_, -y * pixelSize_, (DataType)0 );
+    }
+    //! returns the light of light \c f at the point \c X.
+    Vector3 light(const Vector3& X, const int f) const
+    {
+        Vector3 d = position_.col(f) - X;
+        DataType r2 = d.squaredNorm();
+        DataType scale = ( falloff_ == (DataType)2 ) ? (DataType)1 / ( r2 * std::sqrt(r2) ) : std::pow( r2, -(DataType)0.5 * ( (DataType)1 + falloff_ ) );
+        return ( intensity_(f) * scale ) * d;
+    }
+    //! computes the light matrix \c L (3 x f) of the point \c X.
+    void lightMatrix(const Vector3& X, LightMatrix& L) const
+    {
+        int numberOfImages = position_.cols();
+        L.resize( 3, numberOfImages );
+        for(int f = 0; f < numberOfImages; ++f)
+        { // f means "f"rame
+            L.col(f) = light( X, f );
+        }
+    }
+    //! computes the light matrix \c L (3 x f) of pixel \c p.
+    void lightMatrix(const int p, LightMatrix& L) const {lightMatrix( point(p), L );}
+    //! returns the light matrix of distant lights approximating the lights at the center of the frame.
+    Matrix lightMatrixCenter(void) const
+    {
+        LightMatrix L;
+        lightMatrix( Vector3::Zero(), L );
+        return L;
+    }
+    //! returns the lights of the pixels from \c pixelBegin, e.g., of a tile.
+    NearLight middlePixels(const int pixelBegin) const
+    {
+        NearLight light( *this );
+        light.pixelBegin_ += pixelBegin;
+        return light;
+    }
+    //! returns the number of lights.
+    int numberOfImages(void) const {return position_.cols();}
+
+private:
+    //! Light positions (3 x f).
+    Matrix position_;
+    //! Light intensities (1 x f).
+    Matrix intensity_;
+    //! The exponent of the distance, by which the irradiance falls off.
+    DataType falloff_;
+    //! The size of a pixel on the reference plane in the units of light positions.
+    DataType pixelSize_;
+    //! The indices of available pixels in \c region_.
+    const std::vector<int>* indexOfPixels_;
+    //! The width of \c region_.
+    int width_;
+    //! The factor by which the frame is decimated.
+    int factor_;
+    //! The region of the pixels in the (decimated) frame.
+    ImageRegion region_;
+    //! The first pixel in \c indexOfPixels_.
+    int pixelBegin_;
+};
+
+//! estimates the surface matrix \c S (pc x 3) of the pixels observed in \c I under near lights \c light, each pixel by its own normal equations. Invalid samples of \c validity, if given, are excluded.
+//! Each light of a pixel is computed and accumulated into the normal equations at once without storing the light matrix, and the normal matrix is shared by all color channels of the pixel and inverted in closed form.
+//! If \c conditioning is given, it gets the reciprocal condition number of the lights solving each row.
+template <typename DataType>
+inline Eigen::Matrix<DataType, -1, -1> estimateSurfaceNear(
+    const Eigen::Matrix<DataType, -1, -1>& I,
+    const NearLight<DataType>& light,
+    const int numberOfPixels,
+    const int color,
+    const ValidityMask* validity = NULL,
+    Eigen::Matrix<DataType, -1, 1>* conditioning = NULL
+)
+{
+    Eigen::Matrix<DataType, -1, -1> Shat( I.rows(), 3 );
+    if( conditioning != NULL )
+    {
+        conditioning->resize( I.rows() );
+    }
+    bool flagValidity = ( validity != NULL && validity->numberOfPixels() > 0 );
+    int numberOfImages = I.cols();
+    DataType tol = std::numeric_limits<DataType>::epsilon() * (DataType)255;
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        std::vector< Eigen::Matrix<DataType, 3, 1> > b( color );
+        std::vector<DataType> sumSquare( color );
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+        for(int p = 0; p < numberOfPixels; ++p)
+        { // p means "p"ixel
+            typename NearLight<DataType>::Vector3 X = light.point(p);
+            // the upper triangle of the normal matrix.
+            DataType m00 = 0, m01 = 0, m02 = 0, m11 = 0, m12 = 0, m22 = 0;
+            for(int c = 0; c < color; ++c)
+            {
+                b[c].setZero();
+                sumSquare[c] = (DataType)0;
+            }
+            int numberOfValid = 0;
+            for(int f = 0; f < numberOfImages; ++f)
+            { // f means "f"rame
+                const DataType* ptrI = I.data() + (size_t)f*I.rows() + p;
+                for(int c = 0; c < color; ++c)
+                {
+                    sumSquare[c] += ptrI[c*numberOfPixels] * ptrI[c*numberOfPixels];
+                }
+                if( flagValidity && !validity->isValid(p, f) )
+                {
+                    continue;
+                }
+                typename NearLight<DataType>::Vector3 l = light.light( X, f );
+                m00 += l(0)*l(0); m01 += l(0)*l(1); m02 += l(0)*l(2);
+                m11 += l(1)*l(1); m12 += l(1)*l(2); m22 += l(2)*l(2);
+                for(int c = 0; c < color; ++c)
+                {
+                    b[c] += ptrI[c*numberOfPixels] * l;
+                }
+                ++numberOfValid;
+            }
+            Eigen::Matrix<DataType, 3, 3> M;
+            M << m00, m01, m02,
+                 m01, m11, m12,
+                 m02, m12, m22;
+
+            // the adjugate divided by the determinant.
+            Eigen::Matrix<DataType, 3, 3> A;
+            A(0,0) = M(1,1)*M(2,2) - M(1,2)*M(2,1);
+            A(0,1) = M(0,2)*M(2,1) - M(0,1)*M(2,2);
+            A(0,2) = M(0,1)*M(1,2) - M(0,2)*M(1,1);
+            A(1,0) = A(0,1);
+            A(1,1) = M(0,0)*M(2,2) - M(0,2)*M(2,0);
+            A(1,2) = M(0,2)*M(1,0) - M(0,0)*M(1,2);
+            A(2,0) = A(0,2);
+            A(2,1) = A(1,2);
+            A(2,2) = M(0,0)*M(1,1) - M(0,1)*M(1,0);
+            DataType det = M(0,0)*A(0,0) + M(0,1)*A(1,0) + M(0,2)*A(2,0);
+            bool flagSolvable = isSolvable( M, numberOfValid );
+            DataType conditioningPixel = ( conditioning != NULL && flagSolvable ) ? computeReciprocalCondition( M ) : (DataType)0;
+
+            for(int c = 0; c < color; ++c)
+            { // c means "c"olor
+                int i = c*numberOfPixels+p;
+                if( conditioning != NULL )
+                {
+                    (*conditioning)(i) = conditioningPixel;
+                }
+                if( !flagSolvable || std::sqrt(sumSquare[c]) < tol )
+                {
+                    Shat.row(i).setZero();
+                    continue;
+                }
+                Shat.row(i) = ( A * b[c] ).transpose() / det;
+            }
+        }
+    }
+
+    return Shat;
+}
+
+/*!
+ * \class PredictorNearLambertian
+ *
+ * \brief predicts observation of a pixel by the Lambertian model under near lights, i.e., a row of \c S times the light matrix of the pixel.
+ *
+ */
+template <typename DataType = float>
+class PredictorNearLambertian
+{
+public:
+    PredictorNearLambertian(
+        const Eigen::Matrix<DataType, -1, -1>& S,
+        const NearLight<DataType>& light,
+        const int numberOfPixels,
+        const int color
+    ):
+        S_(S),
+        light_(light),
+        numberOfPixels_(numberOfPixels),
+        color_(color)
+    {}
+    //! predicts observation \c obs (color x f) of pixel \c p.
+    void operator()(
+        const int p,
+        Eigen::Matrix<DataType, -1, -1>& obs
+    )
+    {
+        light_.lightMatrix( p, L_ );
+        for(int c = 0; c < color_; ++c)
+        {
+            obs.row(c).noalias() = S_.row(c*numberOfPixels_+p) * L_;
+        }
+    }
+private:
+    const Eigen::Matrix<DataType, -1, -1>& S_;
+    const NearLight<DataType>& light_;
+    int numberOfPixels_;
+    int color_;
+    typename NearLight<DataType>::LightMatrix L_;
+};
+
+} // end of namespace CPS
+
+#endif
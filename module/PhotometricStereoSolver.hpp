@@ -16,15 +16,22 @@
 #include <iostream>
 #include <cassert>
 #include <limits>
+#include <algorithm>
 
 // internal headers
 #include "utilEigen.hpp"
 #include "utilString.hpp"
 #include "DataStructure.hpp"
 #include "Image.hpp"
+#include "ImageFloat.hpp"
+#include "MappedImage.hpp"
+#include "LightTable.hpp"
+#include "ConfidenceMap.hpp"
+#include "ResidualStatistics.hpp"
 #include "CpsConfiguration.hpp"
+#include "SurfaceSolver.hpp"
 
-void showMatrix(
+inline void showMatrix(
     const Eigen::MatrixXf& mat
 )
 {
@@ -40,7 +47,8 @@ void showMatrix(
     }
 }
 
-void loadAvailablePixels(
+//! loads available pixels of \c strImageMask, whose values are the white level of its format, e.g., 255 for 8 bits and 65535 for 16 bits.
+inline void loadAvailablePixels(
     const std::string strImageMask,
     int& width,
     int& height,
@@ -48,15 +56,35 @@ void loadAvailablePixels(
 )
 {
 
-    ImageSingle<unsigned char, int> imgMask(strImageMask);
+    // an uncompressed mask is read in place from its mapped file.
+    MappedImage imgMapped;
+    if( imgMapped.open(strImageMask) )
+    {
+        width = imgMapped.width();
+        height = imgMapped.height();
+        for(int y = 0; y < height; ++y)
+        {
+            for(int x = 0; x < width; ++x)
+            {
+                if( imgMapped(x,y,0) == imgMapped.maxValue() )
+                {
+                    indexOfPixels.push_back( y*width+x );
+                }
+            }
+        }
+        return;
+    }
+
+    ImageSingle<unsigned short, int> imgMask(strImageMask);
 
     width = imgMask._width();
     height = imgMask._height();
+    int white = imgMask._img().max() > 255 ? 65535 : 255;
     for(int y = 0; y < height; ++y)
     {
         for(int x = 0; x < width; ++x)
         {
-            if( imgMask(x,y,0) == 255 )
+            if( imgMask(x,y,0) == white )
             {
                 indexOfPixels.push_back( y*width+x );
             }
@@ -64,34 +92,498 @@ void loadAvailablePixels(
     }
 }
 
+//! decimates available pixels of (\c width x \c height) by \c factor in each axis. A decimated pixel is available only if all pixels of its (factor x factor) block are available.
+inline void decimateAvailablePixels(
+    const std::vector<int>& indexOfPixels,
+    const int width,
+    const int height,
+    const int factor,
+    int& widthDecimated,
+    int& heightDecimated,
+    std::vector<int>& indexOfPixelsDecimated
+)
+{
+    assert( factor >= 1 );
+    int w = width / factor;
+    int h = height / factor;
+
+    std::vector<int> count( w*h, 0 );
+    for(size_t p = 0; p < indexOfPixels.size(); ++p)
+    {
+        int x = indexOfPixels[p] % width / factor;
+        int y = indexOfPixels[p] / width / factor;
+        if( x < w && y < h )
+        {
+            ++count[y*w+x];
+        }
+    }
+
+    indexOfPixelsDecimated.clear();
+    for(int i = 0; i < w*h; ++i)
+    {
+        if( count[i] == factor*factor )
+        {
+            indexOfPixelsDecimated.push_back( i );
+        }
+    }
+    widthDecimated = w;
+    heightDecimated = h;
+}
+
+//! crops available pixels of (\c width x \c height) to \c region, which is the bounding box of the pixels if its width or height is 0. \c indexOfPixels is re-indexed in \c region, and pixels out of it are removed.
+inline void cropAvailablePixels(
+    std::vector<int>& indexOfPixels,
+    const int width,
+    const int height,
+    ImageRegion& region
+)
+{
+    if( region.width <= 0 || region.height <= 0 )
+    {
+        int xMin = width, yMin = height, xMax = -1, yMax = -1;
+        for(size_t p = 0; p < indexOfPixels.size(); ++p)
+        {
+            int x = indexOfPixels[p] % width;
+            int y = indexOfPixels[p] / width;
+            xMin = std::min( xMin, x );
+            xMax = std::max( xMax, x );
+            yMin = std::min( yMin, y );
+            yMax = std::max( yMax, y );
+        }
+        region = xMax < 0 ? ImageRegion(0, 0, width, height) : ImageRegion(xMin, yMin, xMax-xMin+1, yMax-yMin+1);
+    }
+    region.x = std::max( 0, std::min( region.x, width ) );
+    region.y = std::max( 0, std::min( region.y, height ) );
+    region.width = std::min( region.width, width - region.x );
+    region.height = std::min( region.height, height - region.y );
+    region.widthFrame = width;
+    region.heightFrame = height;
+
+    // indices increase in the region as in the frame, so that the order of pixels is kept.
+    size_t n = 0;
+    for(size_t p = 0; p < indexOfPixels.size(); ++p)
+    {
+        int x = indexOfPixels[p] % width - region.x;
+        int y = indexOfPixels[p] / width - region.y;
+        if( x >= 0 && x < region.width && y >= 0 && y < region.height )
+        {
+            indexOfPixels[n++] = y*region.width + x;
+        }
+    }
+    indexOfPixels.resize( n );
+}
+
+//! corrects pixel \c p of \c ptrColumn by subtracting \c ptrAmbient and multiplying \c ptrGain, i.e., columns of the ambient image and the reciprocal flat field, each of which is skipped if \c NULL. returns \c false if a channel has no gain, i.e., its flat field is dead, and cannot be corrected.
 template <typename DataType>
-inline Eigen::Matrix<DataType, -1, -1> buildObservationMatrix(
+inline bool correctObservationPixel(
+    DataType* ptrColumn,
+    const int p,
+    const int numberOfPixels,
+    const int color,
+    const DataType* ptrAmbient,
+    const DataType* ptrGain
+)
+{
+    for(int c = 0; c < color; ++c)
+    { // c means "c"olor
+        DataType& value = ptrColumn[c*numberOfPixels+p];
+        if( ptrAmbient != NULL )
+        {
+            value -= ptrAmbient[c*numberOfPixels+p];
+        }
+        if( ptrGain != NULL )
+        {
+            value *= ptrGain[c*numberOfPixels+p];
+        }
+    }
+    if( ptrGain != NULL )
+    {
+        for(int c = 0; c < color; ++c)
+        {
+            if( ptrGain[c*numberOfPixels+p] <= (DataType)0 )
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+//! returns \c true if any observation of \c obsSingle has a flat field, whose dead pixels make samples invalid.
+inline bool hasFlatField(
+    const std::vector<CPS::ObservationSingle>& obsSingle
+)
+{
+    for(size_t f = 0; f < obsSingle.size(); ++f)
+    {
+        if( !obsSingle[f].strImageFlat().empty() )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+//! gathers available pixels of frame \c f from \c img, either \c MappedImage or \c ImageSingle, into \c ptrColumn, and returns the maximum of them before correction. Each pixel is corrected by \c ptrAmbient and \c ptrGain, if given, right after it is gathered and classified in \c validity. See \c gatherObservationMatrix() for the other arguments.
+template <typename DataType, typename ImageType>
+inline DataType gatherObservationFrame(
+    ImageType& img,
+    const std::vector<int>& indexOfPixels,
+    const int color,
+    const int width,
+    const int factor,
+    const ImageRegion& region,
+    const int f,
+    DataType* ptrColumn,
+    CPS::ValidityMask* validity,
+    const DataType* ptrAmbient = NULL,
+    const DataType* ptrGain = NULL
+)
+{
+    int numberOfPixels = indexOfPixels.size();
+    DataType scale = (DataType)1 / (factor*factor);
+    DataType maxValue = (DataType)0;
+    for(int p = 0; p < numberOfPixels; ++p)
+    { // p means "p"ixel
+        int x0 = (region.x + indexOfPixels[p] % width) * factor;
+        int y0 = (region.y + indexOfPixels[p] / width) * factor;
+        for(int c = 0; c < color; ++c)
+        { // c means "c"olor
+            if( factor == 1 )
+            {
+                ptrColumn[c*numberOfPixels+p] = (DataType)img(x0, y0, c);
+                maxValue = std::max( maxValue, ptrColumn[c*numberOfPixels+p] );
+                continue;
+            }
+            DataType sum = (DataType)0;
+            for(int dy = 0; dy < factor; ++dy)
+            {
+                for(int dx = 0; dx < factor; ++dx)
+                {
+                    sum += (DataType)img(x0+dx, y0+dy, c);
+                }
+            }
+            ptrColumn[c*numberOfPixels+p] = sum * scale;
+            maxValue = std::max( maxValue, ptrColumn[c*numberOfPixels+p] );
+        }
+        bool flagValid = ( validity == NULL || validity->isValidSample( ptrColumn+p, numberOfPixels, color ) );
+        flagValid = correctObservationPixel( ptrColumn, p, numberOfPixels, color, ptrAmbient, ptrGain ) && flagValid;
+        if( validity != NULL && !flagValid )
+        {
+            validity->setInvalid( p, f );
+        }
+    }
+    return maxValue;
+}
+
+//! returns the white level of an image decoded by \c ImageSingle, whose maximum gathered value is \c maxValue, i.e., 255 or 65535 if \c maxValue does not exceed it, otherwise \c maxValue.
+template <typename DataType>
+inline DataType estimateWhiteLevel(
+    const DataType maxValue
+)
+{
+    return maxValue <= (DataType)255 ? (DataType)255 : maxValue <= (DataType)65535 ? (DataType)65535 : maxValue;
+}
+
+//! gathers available pixels of the image \c strImage as frame \c f into \c ptrColumn, and sets its white level \c whiteLevel. returns \c true if it is read in place from its mapped file. See \c gatherObservationMatrix() for the other arguments.
+template <typename DataType>
+inline bool gatherObservationImage(
+    const std::string& strImage,
+    const std::vector<int>& indexOfPixels,
+    const int color,
+    const int width,
+    const int factor,
+    const ImageRegion& region,
+    const int f,
+    DataType* ptrColumn,
+    CPS::ValidityMask* validity,
+    DataType& whiteLevel,
+    const DataType* ptrAmbient = NULL,
+    const DataType* ptrGain = NULL
+)
+{
+    MappedImage imgMapped;
+    if( imgMapped.open( strImage ) )
+    {
+        gatherObservationFrame( imgMapped, indexOfPixels, color, width, factor, region, f, ptrColumn, validity, ptrAmbient, ptrGain );
+        whiteLevel = (DataType)imgMapped.maxValue();
+        return true;
+    }
+    ImageSingle<DataType, DataType> img( strImage );
+    whiteLevel = estimateWhiteLevel( gatherObservationFrame( img, indexOfPixels, color, width, factor, region, f, ptrColumn, validity, ptrAmbient, ptrGain ) );
+    return false;
+}
+
+//! merges the exposure stack of \c obs into \c ptrColumn as frame \c f, in the units of its first exposure, and sets the white level \c whiteLevel of the merged radiance, i.e., the white level of the first exposure scaled to the shortest exposure. returns the number of exposures read in place from their mapped files. See \c gatherObservationMatrix() for the other arguments.
+//! Exposures are gathered one by one into a column buffer and accumulated, so that no merged image is stored. Each pixel of each exposure is weighted by a hat function of its brightest channel relative to the white level, which is 0 if the channel is saturated. A pixel saturated in all exposures takes the shortest exposure, and is marked invalid in \c validity, if given. Each merged pixel is corrected by \c ptrAmbient and \c ptrGain, if given.
+template <typename DataType>
+inline int mergeExposureStack(
+    const CPS::ObservationSingle& obs,
+    const std::vector<int>& indexOfPixels,
+    const int color,
+    const int width,
+    const int factor,
+    const ImageRegion& region,
+    const int f,
+    DataType* ptrColumn,
+    CPS::ValidityMask* validity,
+    DataType& whiteLevel,
+    const DataType* ptrAmbient = NULL,
+    const DataType* ptrGain = NULL
+)
+{
+    // a channel at or above this fraction of the white level is saturated.
+    const DataType levelSaturated = (DataType)0.98;
+    // the least weight of a valid pixel, which merges dark pixels of all exposures.
+    const DataType weightMin = (DataType)1e-3;
+
+    int numberOfPixels = indexOfPixels.size();
+    int numberOfExposures = obs.numberOfExposures();
+    size_t numberOfRows = (size_t)numberOfPixels*color;
+
+    // exposures are merged from the longest to the shortest, whose pixels remain in the buffer.
+    std::vector<int> order( numberOfExposures );
+    for(int k = 0; k < numberOfExposures; ++k)
+    {
+        order[k] = k;
+    }
+    for(int k = 1; k < numberOfExposures; ++k)
+    {
+        for(int j = k; j > 0 && obs.exposureTime(order[j]) > obs.exposureTime(order[j-1]); --j)
+        {
+            std::swap( order[j], order[j-1] );
+        }
+    }
+
+    std::fill( ptrColumn, ptrColumn + numberOfRows, (DataType)0 );
+    std::vector<DataType> weightSum( numberOfPixels, (DataType)0 );
+    std::vector<DataType> buffer( numberOfRows );
+    int numberOfMapped = 0;
+    DataType scale = (DataType)1;
+    DataType scaleMax = (DataType)1;
+    for(int n = 0; n < numberOfExposures; ++n)
+    { // n means the "n"-th longest exposure
+        int k = order[n];
+        DataType white;
+        numberOfMapped += gatherObservationImage( obs.strImage(k), indexOfPixels, color, width, factor, region, f, &buffer[0], (CPS::ValidityMask*)NULL, white );
+        if( k == 0 )
+        {
+            whiteLevel = white;
+        }
+        scale = (DataType)( obs.exposureTime(0) / obs.exposureTime(k) );
+        scaleMax = std::max( scaleMax, scale );
+        for(int p = 0; p < numberOfPixels; ++p)
+        { // p means "p"ixel
+            DataType z = (DataType)0;
+            for(int c = 0; c < color; ++c)
+            { // c means "c"olor
+                z = std::max( z, buffer[c*numberOfPixels+p] / white );
+            }
+            if( z >= levelSaturated )
+            {
+                continue;
+            }
+            DataType w = std::max( std::min( z, (DataType)1 - z ), weightMin );
+            for(int c = 0; c < color; ++c)
+            {
+                ptrColumn[c*numberOfPixels+p] += w * scale * buffer[c*numberOfPixels+p];
+            }
+            weightSum[p] += w;
+        }
+    }
+
+    for(int p = 0; p < numberOfPixels; ++p)
+    {
+        for(int c = 0; c < color; ++c)
+        {
+            DataType& value = ptrColumn[c*numberOfPixels+p];
+            value = weightSum[p] > (DataType)0 ? value / weightSum[p] : scale * buffer[c*numberOfPixels+p];
+        }
+        // the merged radiance exceeds the white level of any exposure, so that only a pixel saturated in all exposures is invalid.
+        bool flagValid = correctObservationPixel( ptrColumn, p, numberOfPixels, color, ptrAmbient, ptrGain );
+        if( validity != NULL && ( weightSum[p] == (DataType)0 || !flagValid ) )
+        {
+            validity->setInvalid( p, f );
+        }
+    }
+    whiteLevel *= scaleMax;
+
+    return numberOfMapped;
+}
+
+//! gathers available pixels of the observation \c obs as frame \c f into \c ptrColumn, i.e., its image or its exposure stack divided by its flat field, if given, and sets its white level \c whiteLevel. returns the number of images read in place from their mapped files. See \c gatherObservationMatrix() for the other arguments.
+template <typename DataType>
+inline int gatherObservation(
+    const CPS::ObservationSingle& obs,
+    const std::vector<int>& indexOfPixels,
+    const int color,
+    const int width,
+    const int factor,
+    const ImageRegion& region,
+    const int f,
+    DataType* ptrColumn,
+    CPS::ValidityMask* validity,
+    DataType& whiteLevel,
+    const DataType* ptrAmbient = NULL
+)
+{
+    size_t numberOfRows = indexOfPixels.size()*color;
+
+    // the flat field is gathered as a column of its reciprocal normalized by its white level.
+    std::vector<DataType> gain;
+    if( !obs.strImageFlat().empty() )
+    {
+        DataType whiteFlat;
+        gain.resize( numberOfRows );
+        gatherObservationImage( obs.strImageFlat(), indexOfPixels, color, width, factor, region, f, &gain[0], (CPS::ValidityMask*)NULL, whiteFlat );
+        for(size_t r = 0; r < numberOfRows; ++r)
+        {
+            gain[r] = gain[r] > (DataType)0 ? whiteFlat / gain[r] : (DataType)0;
+        }
+    }
+    const DataType* ptrGain = gain.empty() ? NULL : &gain[0];
+
+    if( obs.numberOfExposures() > 1 )
+    {
+        return mergeExposureStack( obs, indexOfPixels, color, width, factor, region, f, ptrColumn, validity, whiteLevel, ptrAmbient, ptrGain );
+    }
+    return gatherObservationImage( obs.strImage(), indexOfPixels, color, width, factor, region, f, ptrColumn, validity, whiteLevel, ptrAmbient, ptrGain );
+}
+
+//! gathers available pixels of the ambient image \c strImageAmbient once as a column (pc) subtracted from each observation, or returns an empty column if it is not given. See \c gatherObservationMatrix() for the other arguments.
+template <typename DataType>
+inline std::vector<DataType> gatherAmbient(
+    const std::string& strImageAmbient,
+    const std::vector<int>& indexOfPixels,
+    const int color,
+    const int width,
+    const int factor,
+    const ImageRegion& region
+)
+{
+    std::vector<DataType> ambient;
+    if( !strImageAmbient.empty() )
+    {
+        DataType whiteAmbient;
+        ambient.resize( (size_t)indexOfPixels.size()*color );
+        gatherObservationImage( strImageAmbient, indexOfPixels, color, width, factor, region, 0, &ambient[0], (CPS::ValidityMask*)NULL, whiteAmbient );
+        std::cout << "subtract the ambient image " << strImageAmbient << std::endl;
+    }
+    return ambient;
+}
+
+//! gathers available pixels of each observation into \c ptrI, which points to column-major (pc x f) storage of the observation matrix, e.g., on memory or in a mapped file. If \c factor > 1, \c indexOfPixels and \c width are of the image decimated by \c factor, and each pixel is the average of its (factor x factor) block. \c indexOfPixels and \c width are of \c region, which is cropped from the (decimated) image. Saturated and dark samples are marked in \c validity, if given and enabled, while they are gathered.
+//! Uncompressed images are read in place from their mapped files by \c MappedImage, and the others are decoded by \c ImageSingle, both in their native precision, e.g., 16-bit PNG/PGM/PPM and floating-point PFM/NPY/RAW. An exposure stack is merged into its column by \c mergeExposureStack(). Observations are gathered in parallel.
+//! If \c strImageAmbient is given, its available pixels are subtracted from each observation, and the flat field of each observation, if given, divides it after normalized by its white level. Both are applied to each pixel as it is gathered, and saturated and dark samples are detected before them.
+//! A sample of a dead flat field pixel, i.e., of no gain, is invalid in \c validity, if given and enabled, otherwise its pixel is dropped, i.e., all its rows are zero.
+//! returns the white level of the observations, i.e., the largest white level of the images, which is that of the format of mapped images, otherwise 255 or 65535 if no gathered value exceeds it, or the maximum gathered value.
+template <typename DataType>
+inline DataType gatherObservationMatrix(
     const std::vector<int>& indexOfPixels,
     const std::vector<CPS::ObservationSingle>& obsSingle,
     const int color,
-    const int width
+    const int width,
+    DataType* ptrI,
+    const int factor = 1,
+    const ImageRegion& region = ImageRegion(),
+    CPS::ValidityMask* validity = NULL,
+    const std::string& strImageAmbient = ""
 )
 {
     int numberOfPixels = indexOfPixels.size();
     int numberOfImages = obsSingle.size();
+    size_t numberOfRows = (size_t)numberOfPixels*color;
 
-    Eigen::Matrix<DataType, -1, -1> I = Eigen::Matrix<DataType, -1, -1>::Zero(numberOfPixels*color, numberOfImages);
-    typename ImagePixel<DataType>::PixelValue pixelValue;
+    // the ambient image is gathered once as a column, instead of a frame.
+    std::vector<DataType> ambient = gatherAmbient<DataType>( strImageAmbient, indexOfPixels, color, width, factor, region );
+    const DataType* ptrAmbient = ambient.empty() ? NULL : &ambient[0];
+
+    // samples of dead flat field pixels are collected even without a mask given, whose pixels are dropped after all.
+    CPS::ValidityMask validityFlat;
+    if( validity == NULL || !validity->isEnabled() )
+    {
+        validity = NULL;
+        if( hasFlatField( obsSingle ) )
+        {
+            validityFlat.enable();
+            validity = &validityFlat;
+        }
+    }
+    if( validity != NULL )
+    {
+        validity->resize( numberOfPixels, numberOfImages );
+    }
 
-    std::cout << "build I of " << numberOfPixels*color << "x" << numberOfImages << " matrix" << std::endl;
+    std::cout << "build I of " << numberOfRows << "x" << numberOfImages << " matrix" << std::endl;
+    std::vector<int> numberOfMapped( numberOfImages, 0 );
+    std::vector<DataType> whiteLevel( numberOfImages, (DataType)0 );
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
     for(int f = 0; f < numberOfImages; ++f)
     { // f means "f"rame
-        ImageSingle<DataType, DataType> img( obsSingle[f].strImage() );
+        numberOfMapped[f] = gatherObservation( obsSingle[f], indexOfPixels, color, width, factor, region, f, ptrI + f*numberOfRows, validity, whiteLevel[f], ptrAmbient );
+    }
+
+    if( validity == &validityFlat )
+    {
+        // drop the pixels of dead flat field samples, whose rows are zero and are not solved.
+        int numberOfDropped = 0;
         for(int p = 0; p < numberOfPixels; ++p)
         { // p means "p"ixel
-            pixelValue = img(indexOfPixels[p]%width, indexOfPixels[p]/width);
-            for(int c = 0; c < color; ++c)
-            { // c means "c"olor
-                I(c*numberOfPixels+p,f) = pixelValue[c];
+            if( validityFlat.numberOfValid( p ) < numberOfImages )
+            {
+                for(int f = 0; f < numberOfImages; ++f)
+                { // f means "f"rame
+                    for(int c = 0; c < color; ++c)
+                    { // c means "c"olor
+                        ptrI[(size_t)f*numberOfRows+c*numberOfPixels+p] = (DataType)0;
+                    }
+                }
+                ++numberOfDropped;
             }
         }
+        if( numberOfDropped > 0 )
+        {
+            std::cout << "drop " << numberOfDropped << " pixels of dead flat field samples" << std::endl;
+        }
+    }
+
+    int numberOfFiles = 0;
+    int numberOfStacks = 0;
+    int numberOfMappedAll = 0;
+    for(int f = 0; f < numberOfImages; ++f)
+    {
+        numberOfFiles += obsSingle[f].numberOfExposures();
+        numberOfStacks += ( obsSingle[f].numberOfExposures() > 1 );
+        numberOfMappedAll += numberOfMapped[f];
+    }
+    if( numberOfStacks > 0 )
+    {
+        std::cout << "merged " << numberOfStacks << " exposure stacks of " << numberOfFiles << " images" << std::endl;
+    }
+    if( numberOfMappedAll > 0 )
+    {
+        std::cout << "read " << numberOfMappedAll << " of " << numberOfFiles << " images from mapped files" << std::endl;
     }
 
+    return numberOfImages > 0 ? *std::max_element( whiteLevel.begin(), whiteLevel.end() ) : (DataType)255;
+}
+
+template <typename DataType>
+inline Eigen::Matrix<DataType, -1, -1> buildObservationMatrix(
+    const std::vector<int>& indexOfPixels,
+    const std::vector<CPS::ObservationSingle>& obsSingle,
+    const int color,
+    const int width
+)
+{
+    int numberOfPixels = indexOfPixels.size();
+    int numberOfImages = obsSingle.size();
+
+    Eigen::Matrix<DataType, -1, -1> I = Eigen::Matrix<DataType, -1, -1>::Zero(numberOfPixels*color, numberOfImages);
+    gatherObservationMatrix(indexOfPixels, obsSingle, color, width, I.data());
+
     return I;
 }
 
@@ -118,6 +610,55 @@ inline Eigen::Matrix<DataType, -1, -1> buildLightSourceMatrix(
     return L;
 }
 
+//! returns the light source matrix of \c config, which is loaded from its light table if given. It is empty if the light table is invalid.
+template <typename DataType>
+inline Eigen::Matrix<DataType, -1, -1> buildLightSourceMatrix(
+    const CPS::CpsConfig& config
+)
+{
+    if( config.strLightTable().empty() )
+    {
+        return buildLightSourceMatrix<DataType>( config.obsAll().observation() );
+    }
+
+    Eigen::Matrix<DataType, -1, -1> L;
+    std::cout << "load L of " << 3 << "x" << config.numberOfObservation() << " matrix from " << config.strLightTable() << std::endl;
+    if( !CPS::loadLightTable( config.strLightTable(), config.numberOfObservation(), L ) )
+    {
+        L.resize( 3, 0 );
+    }
+    return L;
+}
+
+//! builds light positions \c position (3 x f) and intensities \c intensity (1 x f) of near lights in \c config, whose light directions (or light table) give the positions. returns \c false if the light table is invalid.
+template <typename DataType>
+inline bool buildLightPositionMatrix(
+    const CPS::CpsConfig& config,
+    Eigen::Matrix<DataType, -1, -1>& position,
+    Eigen::Matrix<DataType, -1, -1>& intensity
+)
+{
+    int numberOfImages = config.numberOfObservation();
+    if( !config.strLightTable().empty() )
+    {
+        std::cout << "load light positions of " << numberOfImages << " lights from " << config.strLightTable() << std::endl;
+        return CPS::loadLightTable( config.strLightTable(), numberOfImages, position, &intensity );
+    }
+
+    position = Eigen::Matrix<DataType, -1, -1>::Zero( 3, numberOfImages );
+    intensity.resize( 1, numberOfImages );
+    for(int f = 0; f < numberOfImages; ++f)
+    { // f means "f"rame
+        std::vector<DataType> vecP = str2vector<DataType>( config.observationSingle(f).lightDirection() );
+        for(int d = 0; d < 3 && d < (int)vecP.size(); ++d)
+        { // d means "d"imension
+            position(d,f) = vecP[d];
+        }
+        intensity(0,f) = config.observationSingle(f).lightIntensity();
+    }
+    return true;
+}
+
 template <typename DataType>
 inline void loadObservation(
     const std::vector<int>& indexOfPixels,
@@ -143,78 +684,60 @@ inline void loadObservation(
     showMatrix(L);
 }
 
+//! returns surface normal \c N as an image of 3 channels.
 template <typename DataType>
-inline Eigen::Matrix<DataType, -1, -1> estimateSurface(
-    const Eigen::Matrix<DataType, -1, -1>& I,
-    const Eigen::Matrix<DataType, -1, -1>& L
+inline cimg_library::CImg<DataType> buildSurfaceNormalImage(
+    const Eigen::Matrix<DataType, -1, -1>& N,
+    const std::vector<int>& indexOfPixels,
+    const int width,
+    const int height
 )
 {
-    Eigen::Matrix<DataType, -1, -1> Linv = pinv(L);
-    Eigen::Matrix<DataType, -1, -1> Shat = I * Linv;
+    cimg_library::CImg<DataType> img(width, height, 1, 3, (DataType)0);
+    int numberOfPixels = indexOfPixels.size();
 
-    DataType tol = std::numeric_limits<DataType>::epsilon() * (DataType)255;
-    for( int i = 0; i < I.rows(); ++i )
+    int x, y;
+    for(int p = 0; p < numberOfPixels; ++p)
     {
-        if( I.row(i).norm() < tol )
+        x = indexOfPixels[p] % width;
+        y = indexOfPixels[p] / width;
+        for(int c = 0; c < 3; ++c)
         {
-            // Pixel intensity is almost zero vector
-            // means that the obtained normal vector is unreliable.
-            Shat.row(i) = Eigen::Matrix<DataType, 3, 1>::Zero();
+            img(x, y, 0, c) = N(p,c);
         }
     }
 
-    return Shat;
+    return img;
 }
 
+//! saves surface normal \c N in each of \c formats as \c strSave plus its extension, and returns the image quantized as PNG for display.
 template <typename DataType>
-inline Eigen::Matrix<DataType, -1, -1> estimateSurfaceAlbedo(
-    const Eigen::Matrix<DataType, -1, -1>& S
+inline cimg_library::CImg<DataType> saveSurfaceNormalToImage(
+    const Eigen::Matrix<DataType, -1, -1>& N,
+    const std::vector<int>& indexOfPixels,
+    const int width,
+    const int height,
+    const std::string strSave,
+    const std::vector<std::string>& formats = std::vector<std::string>(1, "PNG")
 )
 {
-    Eigen::Matrix<DataType, -1, -1> ST = S.transpose();
+    cimg_library::CImg<DataType> img = buildSurfaceNormalImage(N, indexOfPixels, width, height);
+    saveImageFormats( img, strSave, formats, (DataType)127.5, (DataType)1 );
 
-    return ST.colwise().norm();
+    return (img + (DataType)1) * (DataType)127.5;
 }
 
+//! returns surface albedo \c R as an image of \c color channels.
 template <typename DataType>
-inline Eigen::Matrix<DataType, -1, -1> estimateSurfaceNormal(
-    const Eigen::Matrix<DataType, -1, -1>& S,
+inline cimg_library::CImg<DataType> buildSurfaceAlbedoImage(
     const Eigen::Matrix<DataType, -1, -1>& R,
-    const int numberOfPixels,
-    const int color
-)
-{
-    Eigen::Matrix<DataType, -1, -1> N = Eigen::Matrix<DataType, -1, -1>::Zero( numberOfPixels, 3 );
-    Eigen::Matrix<DataType, 3, 3> Ssub = Eigen::Matrix<DataType, 3, 3>::Zero();
-    Eigen::Matrix<DataType, 1, 3> RsubInv = Eigen::Matrix<DataType, 1, 3>::Zero();
-
-    // the following loop can be done by 1 line of code using Eigen trick.
-    for( size_t p = 0; p < numberOfPixels; ++p )
-    {
-        if( R( p ) > 0.0 )
-        {
-            for(int c = 0; c < color; ++c)
-            {
-                Ssub.row(c) = S.row(c*numberOfPixels+p);
-                RsubInv(c) = 1.0/R(c*numberOfPixels+p);
-            }
-            N.row( p ) = RsubInv * Ssub / 3.0;
-        }
-    }
-
-    return N;
-}
-
-template <typename DataType>
-inline cimg_library::CImg<DataType> saveSurfaceNormalToImage(
-    const Eigen::Matrix<DataType, -1, -1>& N,
     const std::vector<int>& indexOfPixels,
     const int width,
     const int height,
-    const std::string strSave
+    const int color
 )
 {
-    cimg_library::CImg<DataType> img(width, height, 1, 3, (DataType)0);
+    cimg_library::CImg<DataType> img(width, height, 1, color, (DataType)0);
     int numberOfPixels = indexOfPixels.size();
 
     int x, y;
@@ -222,16 +745,16 @@ inline cimg_library::CImg<DataType> saveSurfaceNormalToImage(
     {
         x = indexOfPixels[p] % width;
         y = indexOfPixels[p] / width;
-        for(int c = 0; c < 3; ++c)
+        for(int c = 0; c < color; ++c)
         {
-            img(x, y, 0, c) = 255*(N(p,c)+1)/2;
+            img(x, y, 0, c) = R(c*numberOfPixels+p);
         }
     }
-    img.save( strSave.c_str() );
 
     return img;
 }
 
+//! saves surface albedo \c R in each of \c formats as \c strSave plus its extension, and returns the image quantized as PNG for display.
 template <typename DataType>
 inline cimg_library::CImg<DataType> saveSurfaceAlbedoToImage(
     const Eigen::Matrix<DataType, -1, -1>& R,
@@ -239,11 +762,38 @@ inline cimg_library::CImg<DataType> saveSurfaceAlbedoToImage(
     const int width,
     const int height,
     const int color,
-    const std::string strSave
+    const std::string strSave,
+    const std::vector<std::string>& formats = std::vector<std::string>(1, "PNG")
+)
+{
+    cimg_library::CImg<DataType> img = buildSurfaceAlbedoImage(R, indexOfPixels, width, height, color);
+    saveImageFormats( img, strSave, formats, (DataType)127.5, (DataType)1 );
+
+    return (img + (DataType)1) * (DataType)127.5;
+}
+
+template <typename DataType>
+inline Eigen::Matrix<DataType, -1, -1> computeErrorLambertian(
+    const Eigen::Matrix<DataType, -1, -1>& I,
+    const Eigen::Matrix<DataType, -1, -1>& Shat,
+    const Eigen::Matrix<DataType, -1, -1>& L
+)
+{
+    return I - Shat*L;
+}
+
+//! returns absolute reprojection error \c Idiff as an image of \c color channels.
+template <typename DataType>
+inline cimg_library::CImg<DataType> buildReprojectionErrorImage(
+    const Eigen::Matrix<DataType, -1, -1>& Idiff,
+    const std::vector<int>& indexOfPixels,
+    const int width,
+    const int height,
+    const int color
 )
 {
-    cimg_library::CImg<DataType> img(width, height, 1, color, (DataType)0);
     int numberOfPixels = indexOfPixels.size();
+    cimg_library::CImg<DataType> img(width, height, 1, color, (DataType)0);
 
     int x, y;
     for(int p = 0; p < numberOfPixels; ++p)
@@ -252,32 +802,40 @@ inline cimg_library::CImg<DataType> saveSurfaceAlbedoToImage(
         y = indexOfPixels[p] / width;
         for(int c = 0; c < color; ++c)
         {
-            img(x, y, 0, c) = 255*(R(c*numberOfPixels+p)+1)/2;
+            img(x, y, 0, c) = std::abs(Idiff(c*numberOfPixels+p,c));
         }
     }
-    img.save( strSave.c_str() );
 
     return img;
 }
 
+//! saves absolute reprojection error in each of \c formats as \c strSave plus its extension, and returns the image for display.
 template <typename DataType>
-inline Eigen::Matrix<DataType, -1, -1> computeErrorLambertian(
-    const Eigen::Matrix<DataType, -1, -1>& I,
-    const Eigen::Matrix<DataType, -1, -1>& Shat,
-    const Eigen::Matrix<DataType, -1, -1>& L
+inline cimg_library::CImg<DataType> saveReprojectionError(
+    const Eigen::Matrix<DataType, -1, -1>& Idiff,
+    const std::vector<int>& indexOfPixels,
+    const int width,
+    const int height,
+    const int color,
+    const std::string strSave,
+    const std::vector<std::string>& formats = std::vector<std::string>(1, "PNG")
 )
 {
-    return I - Shat*L;
+    cimg_library::CImg<DataType> img = buildReprojectionErrorImage(Idiff, indexOfPixels, width, height, color);
+    saveImageFormats( img, strSave, formats );
+
+    return img;
 }
 
+
+//! returns per-pixel RMS residual \c rmsPixel (pxc vector, e.g., \c ResidualStatistics::rmsPixel()) as an image of \c color channels.
 template <typename DataType>
-inline cimg_library::CImg<DataType> saveReprojectionError(
-    const Eigen::Matrix<DataType, -1, -1>& Idiff,
+inline cimg_library::CImg<DataType> buildResidualImage(
+    const Eigen::Matrix<DataType, -1, 1>& rmsPixel,
     const std::vector<int>& indexOfPixels,
     const int width,
     const int height,
-    const int color,
-    const std::string strSave
+    const int color
 )
 {
     int numberOfPixels = indexOfPixels.size();
@@ -290,14 +848,13 @@ inline cimg_library::CImg<DataType> saveReprojectionError(
         y = indexOfPixels[p] / width;
         for(int c = 0; c < color; ++c)
         {
-            img(x, y, 0, c) = std::abs(Idiff(c*numberOfPixels+p,c));
+            img(x, y, 0, c) = rmsPixel(c*numberOfPixels+p);
         }
     }
-    img.save( strSave.c_str() );
 
     return img;
 }
 
 
 
-#endif
+#endif
\ No newline at end of file
@@ -0,0 +1,1467 @@
+#ifndef __REFLECTANCEMODEL_H__
+#define __REFLECTANCEMODEL_H__
+
+/*!
+ * \file ReflectanceModel.hpp
+ *
+ * \date 2026/10/18
+ * \brief This file contains reflectance models listed in configurationCPS.xsd and non-linear solvers for them, per pixel and per batch of pixels.
+ *
+ * All models share the form \c I = e * ( rho * d(n,l,v) + ks * s(n,l,v) ),
+ * where \c rho is the per-channel diffuse albedo, \c ks is the (white) specular coefficient, and
+ * \c d and \c s are the diffuse and specular shading terms of the model.
+ * \c rho and \c ks enter linearly and are solved in closed form,
+ * while the normal and the model specific shape parameters (shininess, roughness) are refined by Levenberg-Marquardt.
+ * The refinement runs on batches of pixels in lockstep, whose shading is evaluated by array operations over the pixels.
+ *
+ */
+
+// STL
+#include <vector>
+#include <string>
+#include <iostream>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+// Eigen
+#include <Eigen/Core>
+#include <Eigen/Dense>
+
+// Boost
+#include <boost/shared_ptr.hpp>
+
+namespace CPS
+{
+
+/*!
+ * \class ReflectanceModel
+ *
+ * \brief is the interface of a reflectance model, which returns diffuse and specular shading for a single light.
+ *
+ * \date 2026/10/18
+ *
+ */
+template <typename DataType = float>
+class ReflectanceModel
+{
+public:
+    //--------------------------------------------------------
+    //
+    //! \name Public Types
+    //@{
+    //--------------------------------------------------------
+    typedef Eigen::Matrix<DataType, 3, 1> Vector3;
+    typedef Eigen::Array<DataType, -1, 1> Array;
+    typedef Eigen::Map<const Array> ConstMapArray;
+    typedef Eigen::Map<Array> MapArray;
+    //@}
+
+    //! Destructor.
+    virtual ~ReflectanceModel(){}
+
+    //! returns name of the model as written in configuration file.
+    virtual std::string name(void) const = 0;
+    //! returns \c true if the model has a specular term.
+    virtual bool hasSpecular(void) const {return true;}
+    //! returns the number of shape parameters, e.g., shininess or roughness.
+    virtual int numberOfShapeParameters(void) const {return 1;}
+    //! returns initial value of \c k-th shape parameter.
+    virtual DataType initialShape(const int k) const = 0;
+    //! returns lower bound of \c k-th shape parameter.
+    virtual DataType lowerBound(const int k) const = 0;
+    //! returns upper bound of \c k-th shape parameter.
+    virtual DataType upperBound(const int k) const = 0;
+    //! computes diffuse and specular shading given unit normal \c n, unit light direction \c l and unit view direction \c v.
+    virtual void shade(
+        const Vector3& n,
+        const Vector3& l,
+        const Vector3& v,
+        const DataType* shape,
+        DataType& diffuse,
+        DataType& specular
+    ) const = 0;
+    //! computes diffuse and specular shading of \c count pixels for a single light, given their unit normals (\c nx, \c ny, \c nz) and shape parameters \c shape, whose \c k-th parameter of pixel \c i is shape[k*strideShape+i].
+    //! The models evaluate the pixels by array operations, so that they are vectorized. The default calls \c shade() for each pixel.
+    virtual void shadeBatch(
+        const int count,
+        const DataType* nx,
+        const DataType* ny,
+        const DataType* nz,
+        const DataType* shape,
+        const int strideShape,
+        const Vector3& l,
+        const Vector3& v,
+        DataType* diffuse,
+        DataType* specular
+    ) const
+    {
+        std::vector<DataType> shapePixel( numberOfShapeParameters() );
+        for(int i = 0; i < count; ++i)
+        {
+            for(int k = 0; k < (int)shapePixel.size(); ++k)
+            {
+                shapePixel[k] = shape[k*strideShape+i];
+            }
+            shade( Vector3(nx[i], ny[i], nz[i]), l, v, shapePixel.empty() ? NULL : &shapePixel[0], diffuse[i], specular[i] );
+        }
+    }
+
+protected:
+    //! returns the smallest exponent of a specular lobe evaluated by \c shadeBatch(), below which the lobe is negligible.
+    static DataType minExponent(void) {return (DataType)-40;}
+    //! returns exp(\c x) of the pixels of \c mask, or zero if the exponent is below \c minExponent(), so that no denormal value slows down the arithmetic.
+    template <typename MaskType, typename ExponentType>
+    static Array expLobe(
+        const Eigen::ArrayBase<MaskType>& mask,
+        const Eigen::ArrayBase<ExponentType>& x
+    )
+    {
+        Array exponent = x;
+        return ( mask && exponent >= minExponent() ).select( exponent.max( minExponent() ).exp(), (DataType)0 );
+    }
+    //! returns acos(\c x) of \c x in [-1, 1] by the polynomial approximation of Abramowitz and Stegun 4.4.46, whose error is below 2e-8, since acos() of arrays is not vectorized.
+    template <typename ArrayType>
+    static Array acosPolynomial(
+        const Eigen::ArrayBase<ArrayType>& x
+    )
+    {
+        Array ax = x.abs();
+        Array r = ( (DataType)1 - ax ).sqrt() * ( (DataType)1.5707963050 + ax * ( (DataType)-0.2145988016 + ax * ( (DataType)0.0889789874 + ax * ( (DataType)-0.0501743046
+            + ax * ( (DataType)0.0308918810 + ax * ( (DataType)-0.0170881256 + ax * ( (DataType)0.0066700901 + ax * (DataType)-0.0012624911 ) ) ) ) ) ) );
+        return ( x < (DataType)0 ).select( (DataType)M_PI - r, r );
+    }
+};
+
+/*!
+ * \class ReflectanceLambertian
+ *
+ * \brief is the Lambertian model, rho * max(0, n.l).
+ *
+ */
+template <typename DataType = float>
+class ReflectanceLambertian : public ReflectanceModel<DataType>
+{
+public:
+    typedef typename ReflectanceModel<DataType>::Vector3 Vector3;
+    typedef typename ReflectanceModel<DataType>::Array Array;
+    typedef typename ReflectanceModel<DataType>::ConstMapArray ConstMapArray;
+    typedef typename ReflectanceModel<DataType>::MapArray MapArray;
+    std::string name(void) const {return "Lambertian";}
+    bool hasSpecular(void) const {return false;}
+    int numberOfShapeParameters(void) const {return 0;}
+    DataType initialShape(const int /*k*/) const {return (DataType)0;}
+    DataType lowerBound(const int /*k*/) const {return (DataType)0;}
+    DataType upperBound(const int /*k*/) const {return (DataType)0;}
+    void shade(
+        const Vector3& n,
+        const Vector3& l,
+        const Vector3& /*v*/,
+        const DataType* /*shape*/,
+        DataType& diffuse,
+        DataType& specular
+    ) const
+    {
+        diffuse = std::max( n.dot(l), (DataType)0 );
+        specular = (DataType)0;
+    }
+    void shadeBatch(
+        const int count,
+        const DataType* nx,
+        const DataType* ny,
+        const DataType* nz,
+        const DataType* /*shape*/,
+        const int /*strideShape*/,
+        const Vector3& l,
+        const Vector3& /*v*/,
+        DataType* diffuse,
+        DataType* specular
+    ) const
+    {
+        ConstMapArray Nx(nx, count), Ny(ny, count), Nz(nz, count);
+        MapArray(diffuse, count) = ( Nx*l(0) + Ny*l(1) + Nz*l(2) ).max( (DataType)0 );
+        MapArray(specular, count).setZero();
+    }
+};
+
+/*!
+ * \class ReflectancePhong
+ *
+ * \brief is the Phong model, whose specular lobe is max(0, r.v)^alpha with mirror direction r.
+ *
+ */
+template <typename DataType = float>
+class ReflectancePhong : public ReflectanceModel<DataType>
+{
+public:
+    typedef typename ReflectanceModel<DataType>::Vector3 Vector3;
+    typedef typename ReflectanceModel<DataType>::Array Array;
+    typedef typename ReflectanceModel<DataType>::ConstMapArray ConstMapArray;
+    typedef typename ReflectanceModel<DataType>::MapArray MapArray;
+    std::string name(void) const {return "Phong";}
+    DataType initialShape(const int /*k*/) const {return (DataType)20;}
+    DataType lowerBound(const int /*k*/) const {return (DataType)1;}
+    DataType upperBound(const int /*k*/) const {return (DataType)500;}
+    void shade(
+        const Vector3& n,
+        const Vector3& l,
+        const Vector3& v,
+        const DataType* shape,
+        DataType& diffuse,
+        DataType& specular
+    ) const
+    {
+        DataType nl = n.dot(l);
+        diffuse = std::max( nl, (DataType)0 );
+        specular = (DataType)0;
+        if( nl > (DataType)0 )
+        {
+            Vector3 r = (DataType)2 * nl * n - l;
+            DataType rv = r.dot(v);
+            if( rv > (DataType)0 )
+            {
+                specular = std::pow( rv, shape[0] );
+            }
+        }
+    }
+    void shadeBatch(
+        const int count,
+        const DataType* nx,
+        const DataType* ny,
+        const DataType* nz,
+        const DataType* shape,
+        const int /*strideShape*/,
+        const Vector3& l,
+        const Vector3& v,
+        DataType* diffuse,
+        DataType* specular
+    ) const
+    {
+        ConstMapArray Nx(nx, count), Ny(ny, count), Nz(nz, count), alpha(shape, count);
+        Array nl = Nx*l(0) + Ny*l(1) + Nz*l(2);
+        // r.v of the mirror direction r = 2(n.l)n - l.
+        Array rv = (DataType)2 * nl * ( Nx*v(0) + Ny*v(1) + Nz*v(2) ) - l.dot(v);
+        MapArray(diffuse, count) = nl.max( (DataType)0 );
+        MapArray(specular, count) = ReflectanceModel<DataType>::expLobe( nl > (DataType)0 && rv > (DataType)0, alpha * rv.log() );
+    }
+};
+
+/*!
+ * \class ReflectanceBlinnPhong
+ *
+ * \brief is the Blinn-Phong model, whose specular lobe is max(0, n.h)^alpha with half vector h.
+ *
+ */
+template <typename DataType = float>
+class ReflectanceBlinnPhong : public ReflectanceModel<DataType>
+{
+public:
+    typedef typename ReflectanceModel<DataType>::Vector3 Vector3;
+    typedef typename ReflectanceModel<DataType>::Array Array;
+    typedef typename ReflectanceModel<DataType>::ConstMapArray ConstMapArray;
+    typedef typename ReflectanceModel<DataType>::MapArray MapArray;
+    std::string name(void) const {return "Blinn-Phong";}
+    DataType initialShape(const int /*k*/) const {return (DataType)40;}
+    DataType lowerBound(const int /*k*/) const {return (DataType)1;}
+    DataType upperBound(const int /*k*/) const {return (DataType)1000;}
+    void shade(
+        const Vector3& n,
+        const Vector3& l,
+        const Vector3& v,
+        const DataType* shape,
+        DataType& diffuse,
+        DataType& specular
+    ) const
+    {
+        DataType nl = n.dot(l);
+        diffuse = std::max( nl, (DataType)0 );
+        specular = (DataType)0;
+        if( nl > (DataType)0 )
+        {
+            DataType nh = n.dot( (l + v).normalized() );
+            if( nh > (DataType)0 )
+            {
+                specular = std::pow( nh, shape[0] );
+            }
+        }
+    }
+    void shadeBatch(
+        const int count,
+        const DataType* nx,
+        const DataType* ny,
+        const DataType* nz,
+        const DataType* shape,
+        const int /*strideShape*/,
+        const Vector3& l,
+        const Vector3& v,
+        DataType* diffuse,
+        DataType* specular
+    ) const
+    {
+        ConstMapArray Nx(nx, count), Ny(ny, count), Nz(nz, count), alpha(shape, count);
+        Vector3 h = (l + v).normalized();
+        Array nl = Nx*l(0) + Ny*l(1) + Nz*l(2);
+        Array nh = Nx*h(0) + Ny*h(1) + Nz*h(2);
+        MapArray(diffuse, count) = nl.max( (DataType)0 );
+        MapArray(specular, count) = ReflectanceModel<DataType>::expLobe( nl > (DataType)0 && nh > (DataType)0, alpha * nh.log() );
+    }
+};
+
+/*!
+ * \class ReflectanceOrenNayar
+ *
+ * \brief is the qualitative Oren-Nayar model for rough diffuse surfaces, whose shape parameter is the roughness sigma [rad].
+ *
+ */
+template <typename DataType = float>
+class ReflectanceOrenNayar : public ReflectanceModel<DataType>
+{
+public:
+    typedef typename ReflectanceModel<DataType>::Vector3 Vector3;
+    typedef typename ReflectanceModel<DataType>::Array Array;
+    typedef typename ReflectanceModel<DataType>::ConstMapArray ConstMapArray;
+    typedef typename ReflectanceModel<DataType>::MapArray MapArray;
+    std::string name(void) const {return "Oren–Nayar";}
+    bool hasSpecular(void) const {return false;}
+    DataType initialShape(const int /*k*/) const {return (DataType)0.3;}
+    DataType lowerBound(const int /*k*/) const {return (DataType)0;}
+    DataType upperBound(const int /*k*/) const {return (DataType)1.5;}
+    void shade(
+        const Vector3& n,
+        const Vector3& l,
+        const Vector3& v,
+        const DataType* shape,
+        DataType& diffuse,
+        DataType& specular
+    ) const
+    {
+        specular = (DataType)0;
+        DataType nl = n.dot(l);
+        if( nl <= (DataType)0 )
+        {
+            diffuse = (DataType)0;
+            return;
+        }
+        DataType nv = std::max( n.dot(v), std::numeric_limits<DataType>::epsilon() );
+        DataType sigma2 = shape[0] * shape[0];
+        DataType A = (DataType)1 - (DataType)0.5 * sigma2 / (sigma2 + (DataType)0.33);
+        DataType B = (DataType)0.45 * sigma2 / (sigma2 + (DataType)0.09);
+        // cos(phi_i - phi_r) from the projections of l and v onto the tangent plane.
+        Vector3 lt = l - nl * n;
+        Vector3 vt = v - nv * n;
+        DataType denom = lt.norm() * vt.norm();
+        DataType cosPhi = denom > std::numeric_limits<DataType>::epsilon() ? lt.dot(vt) / denom : (DataType)0;
+        // sin(alpha) * tan(beta) with alpha = max(theta_i, theta_r), beta = min(theta_i, theta_r).
+        DataType cosAlpha = std::min( nl, nv );
+        DataType cosBeta = std::max( nl, nv );
+        DataType sinAlpha = std::sqrt( std::max( (DataType)1 - cosAlpha*cosAlpha, (DataType)0 ) );
+        DataType tanBeta = std::sqrt( std::max( (DataType)1 - cosBeta*cosBeta, (DataType)0 ) ) / cosBeta;
+        diffuse = nl * ( A + B * std::max( cosPhi, (DataType)0 ) * sinAlpha * tanBeta );
+    }
+    void shadeBatch(
+        const int count,
+        const DataType* nx,
+        const DataType* ny,
+        const DataType* nz,
+        const DataType* shape,
+        const int /*strideShape*/,
+        const Vector3& l,
+        const Vector3& v,
+        DataType* diffuse,
+        DataType* specular
+    ) const
+    {
+        const DataType eps = std::numeric_limits<DataType>::epsilon();
+        ConstMapArray Nx(nx, count), Ny(ny, count), Nz(nz, count), sigma(shape, count);
+        Array nl = Nx*l(0) + Ny*l(1) + Nz*l(2);
+        Array nv = ( Nx*v(0) + Ny*v(1) + Nz*v(2) ).max( eps );
+        Array sigma2 = sigma.square();
+        Array A = (DataType)1 - (DataType)0.5 * sigma2 / (sigma2 + (DataType)0.33);
+        Array B = (DataType)0.45 * sigma2 / (sigma2 + (DataType)0.09);
+        // cos(phi_i - phi_r) from the projections lt = l - (n.l)n and vt = v - (n.v)n onto the tangent plane.
+        Array ltx = l(0) - nl * Nx, lty = l(1) - nl * Ny, ltz = l(2) - nl * Nz;
+        Array vtx = v(0) - nv * Nx, vty = v(1) - nv * Ny, vtz = v(2) - nv * Nz;
+        Array denom = ( ltx.square() + lty.square() + ltz.square() ).sqrt() * ( vtx.square() + vty.square() + vtz.square() ).sqrt();
+        Array cosPhi = ( denom > eps ).select( ( ltx*vtx + lty*vty + ltz*vtz ) / denom, (DataType)0 );
+        // sin(alpha) * tan(beta) with alpha = max(theta_i, theta_r), beta = min(theta_i, theta_r).
+        Array cosAlpha = nl.min( nv );
+        Array cosBeta = nl.max( nv );
+        Array sinAlpha = ( (DataType)1 - cosAlpha.square() ).max( (DataType)0 ).sqrt();
+        Array tanBeta = ( (DataType)1 - cosBeta.square() ).max( (DataType)0 ).sqrt() / cosBeta;
+        MapArray(diffuse, count) = ( nl > (DataType)0 ).select( nl * ( A + B * cosPhi.max( (DataType)0 ) * sinAlpha * tanBeta ), (DataType)0 );
+        MapArray(specular, count).setZero();
+    }
+};
+
+/*!
+ * \class ReflectanceTorranceSparrow
+ *
+ * \brief is the simplified Torrance-Sparrow model, whose specular lobe is exp(-delta^2/m^2)/(n.v) with delta = angle(n,h).
+ *
+ */
+template <typename DataType = float>
+class ReflectanceTorranceSparrow : public ReflectanceModel<DataType>
+{
+public:
+    typedef typename ReflectanceModel<DataType>::Vector3 Vector3;
+    typedef typename ReflectanceModel<DataType>::Array Array;
+    typedef typename ReflectanceModel<DataType>::ConstMapArray ConstMapArray;
+    typedef typename ReflectanceModel<DataType>::MapArray MapArray;
+    std::string name(void) const {return "Torrance-Sparrow";}
+    DataType initialShape(const int /*k*/) const {return (DataType)0.3;}
+    DataType lowerBound(const int /*k*/) const {return (DataType)0.02;}
+    DataType upperBound(const int /*k*/) const {return (DataType)1;}
+    void shade(
+        const Vector3& n,
+        const Vector3& l,
+        const Vector3& v,
+        const DataType* shape,
+        DataType& diffuse,
+        DataType& specular
+    ) const
+    {
+        DataType nl = n.dot(l);
+        diffuse = std::max( nl, (DataType)0 );
+        specular = (DataType)0;
+        if( nl > (DataType)0 )
+        {
+            DataType nv = std::max( n.dot(v), std::numeric_limits<DataType>::epsilon() );
+            DataType nh = std::min( std::max( n.dot( (l + v).normalized() ), (DataType)-1 ), (DataType)1 );
+            DataType delta = std::acos( nh );
+            specular = std::exp( -delta*delta / (shape[0]*shape[0]) ) / nv;
+        }
+    }
+    void shadeBatch(
+        const int count,
+        const DataType* nx,
+        const DataType* ny,
+        const DataType* nz,
+        const DataType* shape,
+        const int /*strideShape*/,
+        const Vector3& l,
+        const Vector3& v,
+        DataType* diffuse,
+        DataType* specular
+    ) const
+    {
+        ConstMapArray Nx(nx, count), Ny(ny, count), Nz(nz, count), m(shape, count);
+        Vector3 h = (l + v).normalized();
+        Array nl = Nx*l(0) + Ny*l(1) + Nz*l(2);
+        Array nv = ( Nx*v(0) + Ny*v(1) + Nz*v(2) ).max( std::numeric_limits<DataType>::epsilon() );
+        Array delta = ReflectanceModel<DataType>::acosPolynomial( ( Nx*h(0) + Ny*h(1) + Nz*h(2) ).max( (DataType)-1 ).min( (DataType)1 ) );
+        MapArray(diffuse, count) = nl.max( (DataType)0 );
+        MapArray(specular, count) = ReflectanceModel<DataType>::expLobe( nl > (DataType)0, -delta.square() / m.square() ) / nv;
+    }
+};
+
+/*!
+ * \class ReflectanceCookTorrance
+ *
+ * \brief is the Cook-Torrance model with Beckmann distribution, geometric attenuation and Schlick's Fresnel term.
+ *
+ */
+template <typename DataType = float>
+class ReflectanceCookTorrance : public ReflectanceModel<DataType>
+{
+public:
+    typedef typename ReflectanceModel<DataType>::Vector3 Vector3;
+    typedef typename ReflectanceModel<DataType>::Array Array;
+    typedef typename ReflectanceModel<DataType>::ConstMapArray ConstMapArray;
+    typedef typename ReflectanceModel<DataType>::MapArray MapArray;
+    std::string name(void) const {return "Cook–Torrance";}
+    DataType initialShape(const int /*k*/) const {return (DataType)0.3;}
+    DataType lowerBound(const int /*k*/) const {return (DataType)0.02;}
+    DataType upperBound(const int /*k*/) const {return (DataType)1;}
+    void shade(
+        const Vector3& n,
+        const Vector3& l,
+        const Vector3& v,
+        const DataType* shape,
+        DataType& diffuse,
+        DataType& specular
+    ) const
+    {
+        DataType nl = n.dot(l);
+        diffuse = std::max( nl, (DataType)0 );
+        specular = (DataType)0;
+        DataType nv = n.dot(v);
+        if( nl > (DataType)0 && nv > (DataType)0 )
+        {
+            Vector3 h = (l + v).normalized();
+            DataType nh = std::max( n.dot(h), std::numeric_limits<DataType>::epsilon() );
+            DataType vh = std::max( v.dot(h), std::numeric_limits<DataType>::epsilon() );
+            DataType m2 = shape[0] * shape[0];
+            DataType nh2 = nh * nh;
+            // Beckmann distribution.
+            DataType D = std::exp( (nh2 - (DataType)1) / (m2 * nh2) ) / ( (DataType)M_PI * m2 * nh2 * nh2 );
+            // geometric attenuation.
+            DataType G = std::min( (DataType)1, std::min( (DataType)2 * nh * nv / vh, (DataType)2 * nh * nl / vh ) );
+            // Schlick's approximation of Fresnel term with the reflectance at normal incidence 0.04.
+            DataType F0 = (DataType)0.04;
+            DataType F = F0 + ((DataType)1 - F0) * std::pow( (DataType)1 - vh, (DataType)5 );
+            specular = D * G * F / ( (DataType)4 * nv );
+        }
+    }
+    void shadeBatch(
+        const int count,
+        const DataType* nx,
+        const DataType* ny,
+        const DataType* nz,
+        const DataType* shape,
+        const int /*strideShape*/,
+        const Vector3& l,
+        const Vector3& v,
+        DataType* diffuse,
+        DataType* specular
+    ) const
+    {
+        const DataType eps = std::numeric_limits<DataType>::epsilon();
+        ConstMapArray Nx(nx, count), Ny(ny, count), Nz(nz, count), m(shape, count);
+        // h, v.h and the Fresnel term depend only on the light.
+        Vector3 h = (l + v).normalized();
+        DataType vh = std::max( v.dot(h), eps );
+        DataType F0 = (DataType)0.04;
+        DataType F = F0 + ((DataType)1 - F0) * std::pow( (DataType)1 - vh, (DataType)5 );
+        Array nl = Nx*l(0) + Ny*l(1) + Nz*l(2);
+        Array nv = Nx*v(0) + Ny*v(1) + Nz*v(2);
+        Array nh = ( Nx*h(0) + Ny*h(1) + Nz*h(2) ).max( eps );
+        Array m2 = m.square();
+        Array nh2 = nh.square();
+        Array D = ReflectanceModel<DataType>::expLobe( nl > (DataType)0 && nv > (DataType)0, (nh2 - (DataType)1) / (m2 * nh2) ) / ( (DataType)M_PI * m2 * nh2 * nh2 );
+        Array G = ( (DataType)2 * nh * nv.min( nl ) / vh ).min( (DataType)1 );
+        MapArray(diffuse, count) = nl.max( (DataType)0 );
+        MapArray(specular, count) = ( nl > (DataType)0 && nv > (DataType)0 ).select( D * G * F / ( (DataType)4 * nv ), (DataType)0 );
+    }
+};
+
+//! returns the reflectance model specified by \c strReflection, i.e., \c CpsConfig::strReflection(), or an empty pointer if it is unknown.
+template <typename DataType>
+inline boost::shared_ptr< ReflectanceModel<DataType> > createReflectanceModel(
+    const std::string strReflection
+)
+{
+    // configurationCPS.xsd spells Oren–Nayar and Cook–Torrance with an en dash, but a hyphen is also accepted.
+    if( strReflection == "Lambertian" )
+    {
+        return boost::shared_ptr< ReflectanceModel<DataType> >( new ReflectanceLambertian<DataType>() );
+    }
+    else if( strReflection == "Phong" )
+    {
+        return boost::shared_ptr< ReflectanceModel<DataType> >( new ReflectancePhong<DataType>() );
+    }
+    else if( strReflection == "Blinn-Phong" )
+    {
+        return boost::shared_ptr< ReflectanceModel<DataType> >( new ReflectanceBlinnPhong<DataType>() );
+    }
+    else if( strReflection == "Oren–Nayar" || strReflection == "Oren-Nayar" )
+    {
+        return boost::shared_ptr< ReflectanceModel<DataType> >( new ReflectanceOrenNayar<DataType>() );
+    }
+    else if( strReflection == "Torrance-Sparrow" )
+    {
+        return boost::shared_ptr< ReflectanceModel<DataType> >( new ReflectanceTorranceSparrow<DataType>() );
+    }
+    else if( strReflection == "Cook–Torrance" || strReflection == "Cook-Torrance" )
+    {
+        return boost::shared_ptr< ReflectanceModel<DataType> >( new ReflectanceCookTorrance<DataType>() );
+    }
+    return boost::shared_ptr< ReflectanceModel<DataType> >();
+}
+
+/*!
+ * \class ReflectanceFitter
+ *
+ * \brief fits a reflectance model to the observation of a single pixel.
+ *
+ * The normal is updated on the tangent plane of the current estimate, i.e., n = normalize(n + a*t1 + b*t2),
+ * and the linear parameters (rho for each channel and ks) are eliminated by solving their least squares problem
+ * for every evaluation of the non-linear parameters.
+ * An object holds its work buffers so that one object per thread is reused over all pixels of a tile.
+ *
+ */
+template <typename DataType = float>
+class ReflectanceFitter
+{
+public:
+    //--------------------------------------------------------
+    //
+    //! \name Public Types
+    //@{
+    //--------------------------------------------------------
+    typedef Eigen::Matrix<DataType, 3, 1> Vector3;
+    typedef Eigen::Matrix<DataType, -1, 1> Vector;
+    typedef Eigen::Matrix<DataType, -1, -1> Matrix;
+    //@}
+
+    //! Constructor given the model, unit light directions \c D (3xf), light intensities \c E (f) and the number of color channels.
+    ReflectanceFitter(
+        const ReflectanceModel<DataType>& model,
+        const Matrix& D,
+        const Vector& E,
+        const int color,
+        const int maxIterations = 20
+    ):
+        model_(model),
+        D_(D),
+        E_(E),
+        color_(color),
+        maxIterations_(maxIterations),
+        numberOfImages_(D.cols()),
+        numberOfShape_(model.numberOfShapeParameters()),
+        numberOfLinear_(color + (model.hasSpecular() ? 1 : 0)),
+        v_(0, 0, 1),
+        diffuse_(D.cols()),
+        specular_(D.cols()),
+        residual_(color*D.cols()),
+        residualTrial_(color*D.cols()),
+        J_(color*D.cols(), 2 + model.numberOfShapeParameters())
+    {}
+
+    //! fits the model given observation \c obs (color x f), and updates \c n, \c shape, \c rho and \c ks. returns the sum of squared residual.
+    DataType fit(
+        const Matrix& obs,
+        Vector3& n,
+        Vector& shape,
+        Vector& rho,
+        DataType& ks
+    )
+    {
+        int numberOfParams = 2 + numberOfShape_;
+        DataType cost = evaluate(obs, n, shape, rho, ks, residual_);
+        DataType lambda = (DataType)1e-3;
+        Vector3 t1, t2;
+        Vector3 nTrial;
+        Vector shapeTrial(numberOfShape_);
+        Vector rhoTrial(color_);
+        DataType ksTrial;
+        Matrix JTJ(numberOfParams, numberOfParams);
+        Vector JTr(numberOfParams);
+        Vector delta(numberOfParams);
+
+        for(int it = 0; it < maxIterations_; ++it)
+        {
+            tangentBasis(n, t1, t2);
+            // Jacobian of the residual by forward difference.
+            for(int k = 0; k < numberOfParams; ++k)
+            {
+                DataType h;
+                perturb(n, shape, t1, t2, k, nTrial, shapeTrial, h);
+                evaluate(obs, nTrial, shapeTrial, rhoTrial, ksTrial, residualTrial_);
+                J_.col(k) = (residualTrial_ - residual_) / h;
+            }
+            JTJ.noalias() = J_.transpose() * J_;
+            JTr.noalias() = J_.transpose() * residual_;
+
+            bool flagAccepted = false;
+            while( !flagAccepted && lambda < (DataType)1e6 )
+            {
+                Matrix A = JTJ;
+                A.diagonal() += lambda * ( JTJ.diagonal().array() + (DataType)1e-9 ).matrix();
+                delta = -A.ldlt().solve(JTr);
+                nTrial = (n + delta(0)*t1 + delta(1)*t2).normalized();
+                for(int k = 0; k < numberOfShape_; ++k)
+                {
+                    shapeTrial(k) = clampShape(k, shape(k) + delta(2+k));
+                }
+                DataType costTrial = evaluate(obs, nTrial, shapeTrial, rhoTrial, ksTrial, residualTrial_);
+                if( costTrial < cost )
+                {
+                    flagAccepted = (cost - costTrial) > (DataType)1e-7 * cost;
+                    n = nTrial;
+                    shape = shapeTrial;
+                    rho = rhoTrial;
+                    ks = ksTrial;
+                    residual_ = residualTrial_;
+                    cost = costTrial;
+                    lambda = std::max( lambda * (DataType)0.1, (DataType)1e-7 );
+                    if( !flagAccepted )
+                    { // converged.
+                        return cost;
+                    }
+                }
+                else
+                {
+                    lambda *= (DataType)10;
+                }
+            }
+            if( !flagAccepted )
+            {
+                break;
+            }
+        }
+        return cost;
+    }
+
+    //! computes the residual \c obs - model given non-linear parameters, and returns linear parameters \c rho and \c ks and the sum of squared residual.
+    DataType evaluate(
+        const Matrix& obs,
+        const Vector3& n,
+        const Vector& shape,
+        Vector& rho,
+        DataType& ks,
+        Vector& residual
+    )
+    {
+        const DataType* ptrShape = numberOfShape_ > 0 ? shape.data() : NULL;
+        for(int f = 0; f < numberOfImages_; ++f)
+        {
+            model_.shade(n, D_.col(f), v_, ptrShape, diffuse_(f), specular_(f));
+            diffuse_(f) *= E_(f);
+            specular_(f) *= E_(f);
+        }
+        solveLinear(obs, rho, ks);
+        for(int c = 0; c < color_; ++c)
+        {
+            residual.segment(c*numberOfImages_, numberOfImages_) = obs.row(c).transpose() - rho(c) * diffuse_ - ks * specular_;
+        }
+        return residual.squaredNorm();
+    }
+
+    //! predicts observation (color x f) given all parameters.
+    void predict(
+        const Vector3& n,
+        const Vector& shape,
+        const Vector& rho,
+        const DataType ks,
+        Matrix& obs
+    )
+    {
+        const DataType* ptrShape = numberOfShape_ > 0 ? shape.data() : NULL;
+        for(int f = 0; f < numberOfImages_; ++f)
+        {
+            model_.shade(n, D_.col(f), v_, ptrShape, diffuse_(f), specular_(f));
+            for(int c = 0; c < color_; ++c)
+            {
+                obs(c,f) = E_(f) * ( rho(c) * diffuse_(f) + ks * specular_(f) );
+            }
+        }
+    }
+
+private:
+    //! solves the linear least squares of \c rho (each channel) and \c ks (shared by all channels).
+    void solveLinear(
+        const Matrix& obs,
+        Vector& rho,
+        DataType& ks
+    )
+    {
+        DataType dd = diffuse_.squaredNorm();
+        ks = (DataType)0;
+        if( numberOfLinear_ > color_ )
+        {
+            DataType ds = diffuse_.dot(specular_);
+            DataType ss = specular_.squaredNorm();
+            // eliminates rho_c = (d.I_c - ks d.s)/d.d and solves ks first.
+            DataType num = (DataType)0;
+            DataType den = (DataType)0;
+            for(int c = 0; c < color_; ++c)
+            {
+                DataType dI = diffuse_.dot(obs.row(c).transpose());
+                DataType sI = specular_.dot(obs.row(c).transpose());
+                num += dd * sI - ds * dI;
+                den += dd * ss - ds * ds;
+            }
+            if( den > std::numeric_limits<DataType>::epsilon() )
+            {
+                ks = std::max( num / den, (DataType)0 );
+            }
+        }
+        for(int c = 0; c < color_; ++c)
+        {
+            rho(c) = (DataType)0;
+            if( dd > std::numeric_limits<DataType>::epsilon() )
+            {
+                rho(c) = std::max( ( diffuse_.dot(obs.row(c).transpose()) - ks * diffuse_.dot(specular_) ) / dd, (DataType)0 );
+            }
+        }
+    }
+
+    //! computes an orthonormal basis (t1, t2) of the tangent plane of \c n.
+    void tangentBasis(
+        const Vector3& n,
+        Vector3& t1,
+        Vector3& t2
+    ) const
+    {
+        Vector3 a = std::abs(n(0)) < (DataType)0.9 ? Vector3(1, 0, 0) : Vector3(0, 1, 0);
+        t1 = n.cross(a).normalized();
+        t2 = n.cross(t1);
+    }
+
+    //! perturbs \c k-th non-linear parameter for the finite difference, and returns the step \c h.
+    void perturb(
+        const Vector3& n,
+        const Vector& shape,
+        const Vector3& t1,
+        const Vector3& t2,
+        const int k,
+        Vector3& nTrial,
+        Vector& shapeTrial,
+        DataType& h
+    ) const
+    {
+        nTrial = n;
+        shapeTrial = shape;
+        if( k < 2 )
+        {
+            h = (DataType)1e-3;
+            nTrial = (n + h * (k == 0 ? t1 : t2)).normalized();
+        }
+        else
+        {
+            int s = k - 2;
+            h = (DataType)1e-3 * std::max( std::abs(shape(s)), (DataType)1e-2 );
+            if( shape(s) + h > model_.upperBound(s) )
+            {
+                h = -h;
+            }
+            shapeTrial(s) = shape(s) + h;
+        }
+    }
+
+    //! clamps \c k-th shape parameter into its bounds.
+    DataType clampShape(const int k, const DataType val) const
+    {
+        return std::min( std::max( val, model_.lowerBound(k) ), model_.upperBound(k) );
+    }
+
+    //! The reflectance model.
+    const ReflectanceModel<DataType>& model_;
+    //! Unit light directions (3xf).
+    Matrix D_;
+    //! Light intensities (f).
+    Vector E_;
+    //! The number of color channels.
+    int color_;
+    //! The maximum number of iterations.
+    int maxIterations_;
+    //! The number of images.
+    int numberOfImages_;
+    //! The number of shape parameters.
+    int numberOfShape_;
+    //! The number of linear parameters.
+    int numberOfLinear_;
+    //! View direction, orthographic camera looking at -z.
+    Vector3 v_;
+    //! Work buffer of diffuse shading.
+    Vector diffuse_;
+    //! Work buffer of specular shading.
+    Vector specular_;
+    //! Work buffer of residual.
+    Vector residual_;
+    //! Work buffer of residual at trial parameters.
+    Vector residualTrial_;
+    //! Work buffer of Jacobian.
+    Matrix J_;
+};
+
+/*!
+ * \class ReflectanceBatchFitter
+ *
+ * \brief fits a reflectance model to a batch of pixels, i.e., runs the iterations of \c ReflectanceFitter on all pixels of the batch in lockstep.
+ *
+ * The parameters, observations and residuals are stored as structure of arrays, i.e., a row per pixel,
+ * so that the shading of a light is evaluated for all pixels by \c ReflectanceModel::shadeBatch(), and the linear parameters and the residuals by array operations.
+ * Each pixel keeps its own damping. A step evaluates the Jacobian of the pixels whose last trial was accepted, and a trial of all pixels.
+ * Converged pixels are swapped out of the first rows, so that only the remaining pixels are evaluated.
+ * The result of a pixel depends only on the pixels of its batch, so that a batch of the same pixels gives the same results.
+ */
+template <typename DataType = float>
+class ReflectanceBatchFitter
+{
+public:
+    //--------------------------------------------------------
+    //
+    //! \name Public Types
+    //@{
+    //--------------------------------------------------------
+    typedef Eigen::Matrix<DataType, 3, 1> Vector3;
+    typedef Eigen::Matrix<DataType, -1, 1> Vector;
+    typedef Eigen::Matrix<DataType, -1, -1> Matrix;
+    typedef Eigen::Array<DataType, -1, 1> Array;
+    typedef Eigen::Array<DataType, -1, -1> Array2D;
+    //@}
+
+    //! Constructor given the model, unit light directions \c D (3xf), light intensities \c E (f), the number of color channels and the maximum number of pixels of a batch.
+    ReflectanceBatchFitter(
+        const ReflectanceModel<DataType>& model,
+        const Matrix& D,
+        const Vector& E,
+        const int color,
+        const int sizeBatch,
+        const int maxIterations = 20
+    ):
+        model_(model),
+        D_(D),
+        E_(E.transpose().array()),
+        color_(color),
+        maxIterations_(maxIterations),
+        numberOfImages_(D.cols()),
+        numberOfShape_(model.numberOfShapeParameters()),
+        numberOfParams_(2 + model.numberOfShapeParameters()),
+        v_(0, 0, 1),
+        index_(sizeBatch),
+        iteration_(sizeBatch),
+        flagJacobian_(sizeBatch),
+        flagDone_(sizeBatch),
+        n_(sizeBatch, 3),
+        shape_(sizeBatch, model.numberOfShapeParameters()),
+        rho_(sizeBatch, color),
+        ks_(sizeBatch),
+        cost_(sizeBatch),
+        lambda_(sizeBatch),
+        obs_(sizeBatch, color*D.cols()),
+        residual_(sizeBatch, color*D.cols()),
+        t1_(sizeBatch, 3),
+        t2_(sizeBatch, 3),
+        JTJ_(sizeBatch, (2 + model.numberOfShapeParameters())*(2 + model.numberOfShapeParameters())),
+        JTr_(sizeBatch, 2 + model.numberOfShapeParameters()),
+        nTrial_(sizeBatch, 3),
+        shapeTrial_(sizeBatch, model.numberOfShapeParameters()),
+        rhoTrial_(sizeBatch, color),
+        ksTrial_(sizeBatch),
+        costTrial_(sizeBatch),
+        residualTrial_(sizeBatch, color*D.cols()),
+        step_(sizeBatch),
+        norm_(sizeBatch),
+        J_(2 + model.numberOfShapeParameters(), Array2D(sizeBatch, color*D.cols())),
+        diffuse_(sizeBatch, D.cols()),
+        specular_(sizeBatch, D.cols()),
+        dI_(sizeBatch, color),
+        A_(sizeBatch, (2 + model.numberOfShapeParameters())*(2 + model.numberOfShapeParameters())),
+        delta_(sizeBatch, 2 + model.numberOfShapeParameters())
+    {}
+
+    //! fits the model to pixels [\c pBegin, \c pEnd), at most \c sizeBatch pixels, of \c I (pc x f) of \c numberOfPixels pixels given their initial normals in \c N (p x 3), and updates \c N, albedo \c R (1 x pc) and reflectance parameters \c Theta (p x (1+e)) of them. Pixels of zero normals, i.e., unreliable in the Lambertian solution, are skipped.
+    void fit(
+        const Matrix& I,
+        const int numberOfPixels,
+        const int pBegin,
+        const int pEnd,
+        Matrix& N,
+        Matrix& R,
+        Matrix& Theta
+    )
+    {
+        int numberOfActive = 0;
+        for(int p = pBegin; p < pEnd; ++p)
+        { // p means "p"ixel
+            Vector3 n = N.row(p).transpose();
+            if( n.norm() < std::numeric_limits<DataType>::epsilon() )
+            {
+                continue;
+            }
+            int i = numberOfActive++;
+            index_[i] = p;
+            n_.row(i) = n.normalized().transpose().array();
+            for(int k = 0; k < numberOfShape_; ++k)
+            {
+                shape_(i, k) = model_.initialShape(k);
+            }
+            for(int c = 0; c < color_; ++c)
+            {
+                obs_.row(i).segment(c*numberOfImages_, numberOfImages_) = I.row(c*numberOfPixels+p).array();
+            }
+            lambda_(i) = (DataType)1e-3;
+            iteration_[i] = 0;
+            flagJacobian_[i] = 1;
+        }
+        evaluate( numberOfActive, n_, shape_, rho_, ks_, residual_, cost_ );
+
+        while( numberOfActive > 0 && maxIterations_ > 0 )
+        {
+            // the pixels whose last trial was accepted come first, and get their Jacobian.
+            int numberOfJacobian = 0;
+            for(int i = 0; i < numberOfActive; ++i)
+            {
+                if( flagJacobian_[i] )
+                {
+                    swapPixels( i, numberOfJacobian++ );
+                }
+            }
+            computeJacobian( numberOfJacobian );
+
+            // a trial of each pixel given its own damping.
+            tangentBasis( numberOfActive );
+            solveDamped( numberOfActive );
+            nTrial_.topRows(numberOfActive) = n_.topRows(numberOfActive)
+                + t1_.topRows(numberOfActive).colwise() * delta_.col(0).head(numberOfActive)
+                + t2_.topRows(numberOfActive).colwise() * delta_.col(1).head(numberOfActive);
+            normalizeRows( numberOfActive, nTrial_ );
+            for(int k = 0; k < numberOfShape_; ++k)
+            {
+                shapeTrial_.col(k).head(numberOfActive) = ( shape_.col(k).head(numberOfActive) + delta_.col(2+k).head(numberOfActive) ).max( model_.lowerBound(k) ).min( model_.upperBound(k) );
+            }
+            evaluate( numberOfActive, nTrial_, shapeTrial_, rhoTrial_, ksTrial_, residualTrial_, costTrial_ );
+
+            for(int i = 0; i < numberOfActive; ++i)
+            {
+                flagDone_[i] = 0;
+                if( costTrial_(i) < cost_(i) )
+                {
+                    bool flagAccepted = ( cost_(i) - costTrial_(i) ) > (DataType)1e-7 * cost_(i);
+                    n_.row(i) = nTrial_.row(i);
+                    shape_.row(i) = shapeTrial_.row(i);
+                    rho_.row(i) = rhoTrial_.row(i);
+                    ks_(i) = ksTrial_(i);
+                    residual_.row(i) = residualTrial_.row(i);
+                    cost_(i) = costTrial_(i);
+                    lambda_(i) = std::max( lambda_(i) * (DataType)0.1, (DataType)1e-7 );
+                    // converged, or the last iteration.
+                    flagDone_[i] = !flagAccepted || iteration_[i] >= maxIterations_;
+                    flagJacobian_[i] = 1;
+                }
+                else
+                {
+                    lambda_(i) *= (DataType)10;
+                    flagDone_[i] = lambda_(i) >= (DataType)1e6;
+                }
+            }
+
+            // store the converged pixels, and swap them out of the active rows.
+            for(int i = numberOfActive - 1; i >= 0; --i)
+            {
+                if( flagDone_[i] )
+                {
+                    store( i, numberOfPixels, N, R, Theta );
+                    swapPixels( i, --numberOfActive );
+                }
+            }
+        }
+        for(int i = 0; i < numberOfActive; ++i)
+        {
+            store( i, numberOfPixels, N, R, Theta );
+        }
+    }
+
+private:
+    //! computes the residual of the first \c count pixels given non-linear parameters \c n and \c shape, and returns linear parameters \c rho and \c ks and the sum of squared residual \c cost of each pixel.
+    void evaluate(
+        const int count,
+        const Array2D& n,
+        const Array2D& shape,
+        Array2D& rho,
+        Array& ks,
+        Array2D& residual,
+        Array& cost
+    )
+    {
+        if( count == 0 )
+        {
+            return;
+        }
+        const DataType eps = std::numeric_limits<DataType>::epsilon();
+        const int stride = n.rows();
+        const DataType* ptrShape = numberOfShape_ > 0 ? shape.data() : NULL;
+        for(int f = 0; f < numberOfImages_; ++f)
+        {
+            model_.shadeBatch( count, n.data(), n.data() + stride, n.data() + 2*stride, ptrShape, shape.rows(), D_.col(f), v_, &diffuse_(0, f), &specular_(0, f) );
+        }
+        diffuse_.topRows(count).rowwise() *= E_;
+        specular_.topRows(count).rowwise() *= E_;
+
+        // solves the linear least squares of rho (each channel) and ks (shared by all channels) of each pixel, as ReflectanceFitter does.
+        Array dd = diffuse_.topRows(count).square().rowwise().sum();
+        for(int c = 0; c < color_; ++c)
+        {
+            dI_.col(c).head(count) = ( diffuse_.topRows(count) * obs_.block(0, c*numberOfImages_, count, numberOfImages_) ).rowwise().sum();
+        }
+        ks.head(count).setZero();
+        Array ds;
+        if( model_.hasSpecular() )
+        {
+            ds = ( diffuse_.topRows(count) * specular_.topRows(count) ).rowwise().sum();
+            Array ss = specular_.topRows(count).square().rowwise().sum();
+            Array num = Array::Zero(count);
+            for(int c = 0; c < color_; ++c)
+            {
+                num += dd * ( specular_.topRows(count) * obs_.block(0, c*numberOfImages_, count, numberOfImages_) ).rowwise().sum() - ds * dI_.col(c).head(count);
+            }
+            Array den = (DataType)color_ * ( dd * ss - ds * ds );
+            ks.head(count) = ( den > eps ).select( ( num / den ).max( (DataType)0 ), (DataType)0 );
+        }
+        else
+        {
+            ds = Array::Zero(count);
+        }
+        cost.head(count).setZero();
+        for(int c = 0; c < color_; ++c)
+        {
+            rho.col(c).head(count) = ( dd > eps ).select( ( ( dI_.col(c).head(count) - ks.head(count) * ds ) / dd ).max( (DataType)0 ), (DataType)0 );
+            residual.block(0, c*numberOfImages_, count, numberOfImages_) = obs_.block(0, c*numberOfImages_, count, numberOfImages_)
+                - diffuse_.topRows(count).colwise() * rho.col(c).head(count)
+                - specular_.topRows(count).colwise() * ks.head(count);
+            cost.head(count) += residual.block(0, c*numberOfImages_, count, numberOfImages_).square().rowwise().sum();
+        }
+    }
+
+    //! computes the tangent basis, and J^T J and J^T r of the Jacobian of the residual by forward difference, of the first \c count pixels.
+    void computeJacobian(
+        const int count
+    )
+    {
+        if( count == 0 )
+        {
+            return;
+        }
+        for(int i = 0; i < count; ++i)
+        {
+            ++iteration_[i];
+            flagJacobian_[i] = 0;
+        }
+        tangentBasis( count );
+
+        const DataType h = (DataType)1e-3;
+        for(int k = 0; k < numberOfParams_; ++k)
+        {
+            shapeTrial_.topRows(count) = shape_.topRows(count);
+            if( k < 2 )
+            {
+                const Array2D& t = ( k == 0 ) ? t1_ : t2_;
+                nTrial_.topRows(count) = n_.topRows(count) + h * t.topRows(count);
+                normalizeRows( count, nTrial_ );
+                step_.head(count).setConstant( h );
+            }
+            else
+            {
+                int s = k - 2;
+                nTrial_.topRows(count) = n_.topRows(count);
+                step_.head(count) = (DataType)1e-3 * shape_.col(s).head(count).abs().max( (DataType)1e-2 );
+                step_.head(count) = ( shape_.col(s).head(count) + step_.head(count) > model_.upperBound(s) ).select( -step_.head(count), step_.head(count) );
+                shapeTrial_.col(s).head(count) = shape_.col(s).head(count) + step_.head(count);
+            }
+            evaluate( count, nTrial_, shapeTrial_, rhoTrial_, ksTrial_, residualTrial_, costTrial_ );
+            J_[k].topRows(count) = ( residualTrial_.topRows(count) - residual_.topRows(count) ).colwise() / step_.head(count);
+        }
+        for(int a = 0; a < numberOfParams_; ++a)
+        {
+            for(int b = 0; b <= a; ++b)
+            {
+                JTJ_.col(a*numberOfParams_+b).head(count) = ( J_[a].topRows(count) * J_[b].topRows(count) ).rowwise().sum();
+                JTJ_.col(b*numberOfParams_+a).head(count) = JTJ_.col(a*numberOfParams_+b).head(count);
+            }
+            JTr_.col(a).head(count) = ( J_[a].topRows(count) * residual_.topRows(count) ).rowwise().sum();
+        }
+    }
+
+    //! solves the damped normal equations (J^T J + lambda diag(J^T J)) delta = -J^T r of the first \c count pixels for \c delta_ by the Cholesky decomposition of all pixels at once.
+    void solveDamped(
+        const int count
+    )
+    {
+        const int np = numberOfParams_;
+        for(int a = 0; a < np; ++a)
+        {
+            for(int b = 0; b < np; ++b)
+            {
+                A_.col(a*np+b).head(count) = JTJ_.col(a*np+b).head(count);
+            }
+            A_.col(a*np+a).head(count) += lambda_.head(count) * ( JTJ_.col(a*np+a).head(count) + (DataType)1e-9 );
+        }
+        // A = C C^T, whose lower triangle C overwrites A.
+        for(int j = 0; j < np; ++j)
+        {
+            for(int k = 0; k < j; ++k)
+            {
+                A_.col(j*np+j).head(count) -= A_.col(j*np+k).head(count).square();
+            }
+            A_.col(j*np+j).head(count) = A_.col(j*np+j).head(count).max( std::numeric_limits<DataType>::min() ).sqrt();
+            for(int i = j+1; i < np; ++i)
+            {
+                for(int k = 0; k < j; ++k)
+                {
+                    A_.col(i*np+j).head(count) -= A_.col(i*np+k).head(count) * A_.col(j*np+k).head(count);
+                }
+                A_.col(i*np+j).head(count) /= A_.col(j*np+j).head(count);
+            }
+        }
+        // C y = -J^T r and C^T delta = y.
+        for(int i = 0; i < np; ++i)
+        {
+            delta_.col(i).head(count) = -JTr_.col(i).head(count);
+            for(int k = 0; k < i; ++k)
+            {
+                delta_.col(i).head(count) -= A_.col(i*np+k).head(count) * delta_.col(k).head(count);
+            }
+            delta_.col(i).head(count) /= A_.col(i*np+i).head(count);
+        }
+        for(int i = np-1; i >= 0; --i)
+        {
+            for(int k = i+1; k < np; ++k)
+            {
+                delta_.col(i).head(count) -= A_.col(k*np+i).head(count) * delta_.col(k).head(count);
+            }
+            delta_.col(i).head(count) /= A_.col(i*np+i).head(count);
+        }
+    }
+
+    //! computes an orthonormal basis (t1, t2) of the tangent plane of the normals of the first \c count pixels, as \c ReflectanceFitter does.
+    void tangentBasis(
+        const int count
+    )
+    {
+        // t1 = n x a of a = (1, 0, 0) if |nx| < 0.9, otherwise a = (0, 1, 0).
+        Eigen::Array<bool, -1, 1> flagX = n_.col(0).head(count).abs() < (DataType)0.9;
+        t1_.col(0).head(count) = flagX.select( (DataType)0, -n_.col(2).head(count) );
+        t1_.col(1).head(count) = flagX.select( n_.col(2).head(count), (DataType)0 );
+        t1_.col(2).head(count) = flagX.select( -n_.col(1).head(count), n_.col(0).head(count) );
+        normalizeRows( count, t1_ );
+        t2_.col(0).head(count) = n_.col(1).head(count) * t1_.col(2).head(count) - n_.col(2).head(count) * t1_.col(1).head(count);
+        t2_.col(1).head(count) = n_.col(2).head(count) * t1_.col(0).head(count) - n_.col(0).head(count) * t1_.col(2).head(count);
+        t2_.col(2).head(count) = n_.col(0).head(count) * t1_.col(1).head(count) - n_.col(1).head(count) * t1_.col(0).head(count);
+    }
+
+    //! normalizes the first \c count rows of \c n (batch x 3).
+    void normalizeRows(
+        const int count,
+        Array2D& n
+    )
+    {
+        norm_.head(count) = n.topRows(count).square().rowwise().sum().sqrt();
+        n.topRows(count).colwise() /= norm_.head(count);
+    }
+
+    //! swaps the state of pixels in rows \c i and \c j.
+    void swapPixels(
+        const int i,
+        const int j
+    )
+    {
+        if( i == j )
+        {
+            return;
+        }
+        std::swap( index_[i], index_[j] );
+        std::swap( iteration_[i], iteration_[j] );
+        std::swap( flagJacobian_[i], flagJacobian_[j] );
+        std::swap( flagDone_[i], flagDone_[j] );
+        n_.row(i).swap( n_.row(j) );
+        shape_.row(i).swap( shape_.row(j) );
+        rho_.row(i).swap( rho_.row(j) );
+        std::swap( ks_(i), ks_(j) );
+        std::swap( cost_(i), cost_(j) );
+        std::swap( lambda_(i), lambda_(j) );
+        obs_.row(i).swap( obs_.row(j) );
+        residual_.row(i).swap( residual_.row(j) );
+        JTJ_.row(i).swap( JTJ_.row(j) );
+        JTr_.row(i).swap( JTr_.row(j) );
+    }
+
+    //! stores the parameters of the pixel in row \c i into \c N, \c R and \c Theta.
+    void store(
+        const int i,
+        const int numberOfPixels,
+        Matrix& N,
+        Matrix& R,
+        Matrix& Theta
+    ) const
+    {
+        int p = index_[i];
+        N.row(p) = n_.row(i).matrix();
+        for(int c = 0; c < color_; ++c)
+        {
+            R(c*numberOfPixels+p) = rho_(i, c);
+        }
+        Theta(p, 0) = ks_(i);
+        for(int k = 0; k < numberOfShape_; ++k)
+        {
+            Theta(p, 1+k) = shape_(i, k);
+        }
+    }
+
+    //! The reflectance model.
+    const ReflectanceModel<DataType>& model_;
+    //! Unit light directions (3xf).
+    Matrix D_;
+    //! Light intensities (1xf).
+    Eigen::Array<DataType, 1, -1> E_;
+    //! The number of color channels.
+    int color_;
+    //! The maximum number of iterations.
+    int maxIterations_;
+    //! The number of images.
+    int numberOfImages_;
+    //! The number of shape parameters.
+    int numberOfShape_;
+    //! The number of non-linear parameters, i.e., two of the normal and the shape parameters.
+    int numberOfParams_;
+    //! View direction, orthographic camera looking at -z.
+    Vector3 v_;
+    //! The pixel of each row.
+    std::vector<int> index_;
+    //! The number of iterations of each pixel.
+    std::vector<int> iteration_;
+    //! Whether each pixel needs its Jacobian at the current parameters.
+    std::vector<char> flagJacobian_;
+    //! Whether each pixel has converged at the current step.
+    std::vector<char> flagDone_;
+    //! Unit normals (batch x 3).
+    Array2D n_;
+    //! Shape parameters (batch x e).
+    Array2D shape_;
+    //! Albedo (batch x c).
+    Array2D rho_;
+    //! Specular coefficients (batch).
+    Array ks_;
+    //! Sum of squared residual (batch).
+    Array cost_;
+    //! Damping (batch).
+    Array lambda_;
+    //! Observations (batch x cf), whose channel c is columns [cf, (c+1)f).
+    Array2D obs_;
+    //! Residual (batch x cf).
+    Array2D residual_;
+    //! Work buffers of the tangent basis of the normals (batch x 3).
+    Array2D t1_, t2_;
+    //! J^T J (batch x (2+e)^2), row-major for each pixel.
+    Array2D JTJ_;
+    //! J^T r (batch x (2+e)).
+    Array2D JTr_;
+    //! Work buffers of parameters, linear parameters, cost and residual at trial parameters.
+    Array2D nTrial_, shapeTrial_, rhoTrial_;
+    Array ksTrial_, costTrial_;
+    Array2D residualTrial_;
+    //! Work buffer of the steps of the finite difference (batch).
+    Array step_;
+    //! Work buffer of the norms of the normals (batch).
+    Array norm_;
+    //! Work buffer of the columns of the Jacobian, each (batch x cf).
+    std::vector<Array2D> J_;
+    //! Work buffers of diffuse and specular shading (batch x f).
+    Array2D diffuse_, specular_;
+    //! Work buffer of the correlation of diffuse shading and observation (batch x c).
+    Array2D dI_;
+    //! Work buffer of the damped J^T J and its Cholesky decomposition (batch x (2+e)^2).
+    Array2D A_;
+    //! Work buffer of the steps of the non-linear parameters (batch x (2+e)).
+    Array2D delta_;
+};
+
+//! splits light source matrix \c L (3xf) into unit directions \c D (3xf) and intensities \c E (f).
+template <typename DataType>
+inline void splitLightSourceMatrix(
+    const Eigen::Matrix<DataType, -1, -1>& L,
+    Eigen::Matrix<DataType, -1, -1>& D,
+    Eigen::Matrix<DataType, -1, 1>& E
+)
+{
+    D = L;
+    E = L.colwise().norm().transpose();
+    for(int f = 0; f < L.cols(); ++f)
+    {
+        if( E(f) > (DataType)0 )
+        {
+            D.col(f) /= E(f);
+        }
+    }
+}
+
+/*!
+ * \brief refines surface normal \c N (px3) and albedo \c R (pcx1) by fitting \c model to \c I, and returns reflectance parameters \c Theta (px(1+e)), i.e., ks and shape parameters.
+ *
+ * \c N and \c R must hold the Lambertian solution as the initial guess.
+ * Pixels are fitted in batches of \c sizeTile pixels by \c ReflectanceBatchFitter, which are distributed over OpenMP threads.
+ * A batch starts at a multiple of \c sizeTile, so that a pixel gets the same result in any tile or shard aligned to it.
+ */
+template <typename DataType>
+inline Eigen::Matrix<DataType, -1, -1> estimateSurfaceReflectance(
+    const Eigen::Matrix<DataType, -1, -1>& I,
+    const Eigen::Matrix<DataType, -1, -1>& L,
+    const ReflectanceModel<DataType>& model,
+    const int numberOfPixels,
+    const int color,
+    Eigen::Matrix<DataType, -1, -1>& N,
+    Eigen::Matrix<DataType, -1, -1>& R,
+    const int sizeTile = 256
+)
+{
+    typedef typename ReflectanceFitter<DataType>::Vector Vector;
+
+    int numberOfShape = model.numberOfShapeParameters();
+    int numberOfTiles = (numberOfPixels + sizeTile - 1) / sizeTile;
+
+    Eigen::Matrix<DataType, -1, -1> D;
+    Vector E;
+    splitLightSourceMatrix(L, D, E);
+
+    Eigen::Matrix<DataType, -1, -1> Theta = Eigen::Matrix<DataType, -1, -1>::Zero(numberOfPixels, 1 + numberOfShape);
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        ReflectanceBatchFitter<DataType> fitter(model, D, E, color, sizeTile);
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+        for(int t = 0; t < numberOfTiles; ++t)
+        { // t means "t"ile
+            fitter.fit( I, numberOfPixels, t*sizeTile, std::min( (t+1)*sizeTile, numberOfPixels ), N, R, Theta );
+        }
+    }
+
+    return Theta;
+}
+
+//! computes reprojection error \c I - model(N, R, Theta, L) for a non-Lambertian model.
+template <typename DataType>
+inline Eigen::Matrix<DataType, -1, -1> computeErrorReflectance(
+    const Eigen::Matrix<DataType, -1, -1>& I,
+    const Eigen::Matrix<DataType, -1, -1>& L,
+    const ReflectanceModel<DataType>& model,
+    const Eigen::Matrix<DataType, -1, -1>& N,
+    const Eigen::Matrix<DataType, -1, -1>& R,
+    const Eigen::Matrix<DataType, -1, -1>& Theta,
+    const int numberOfPixels,
+    const int color
+)
+{
+    typedef typename ReflectanceFitter<DataType>::Vector Vector;
+    typedef typename ReflectanceFitter<DataType>::Vector3 Vector3;
+
+    int numberOfImages = L.cols();
+    int numberOfShape = model.numberOfShapeParameters();
+
+    Eigen::Matrix<DataType, -1, -1> D;
+    Vector E;
+    splitLightSourceMatrix(L, D, E);
+
+    Eigen::Matrix<DataType, -1, -1> Idiff = I;
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        ReflectanceFitter<DataType> fitter(model, D, E, color);
+        Eigen::Matrix<DataType, -1, -1> obs(color, numberOfImages);
+        Vector shape(numberOfShape);
+        Vector rho(color);
+        Vector3 n;
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+        for(int p = 0; p < numberOfPixels; ++p)
+        {
+            n = N.row(p).transpose();
+            for(int c = 0; c < color; ++c)
+            {
+                rho(c) = R(c*numberOfPixels+p);
+            }
+            for(int k = 0; k < numberOfShape; ++k)
+            {
+                shape(k) = Theta(p, 1+k);
+            }
+            fitter.predict(n, shape, rho, Theta(p, 0), obs);
+            for(int c = 0; c < color; ++c)
+            {
+                Idiff.row(c*numberOfPixels+p) -= obs.row(c);
+            }
+        }
+    }
+
+    return Idiff;
+}
+
+} // end of namespace CPS
+
+#endif
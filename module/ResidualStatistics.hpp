@@ -0,0 +1,512 @@
+#ifndef __RESIDUALSTATISTICS_H__
+#define __RESIDUALSTATISTICS_H__
+
+/*!
+ * \file ResidualStatistics.hpp
+ *
+ * \date 2026/10/18
+ * \brief This file contains residual analysis of photometric stereo, computed in a single streaming pass without materializing \c Idiff = I - SL.
+ *
+ */
+
+// STL
+#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+
+// Eigen
+#include <Eigen/Core>
+
+// internal headers
+#include "DataStructure.hpp"
+#include "ReflectanceModel.hpp"
+
+namespace CPS
+{
+
+/*!
+ * \class ResidualStatistics
+ *
+ * \brief holds per-pixel RMS over all lights, per-image RMS over all pixels, and a histogram of absolute residuals.
+ *
+ * The histogram has \c numberOfBins bins over [0, \c maxValue) and one more bin for larger residuals.
+ * Samples excluded from the solve, e.g., saturated or dark ones, are excluded from all of them.
+ * Squared residuals are summed per block of \c sizeBlock consecutive pixels, and the block sums are summed in pixel order.
+ * Therefore the results do not depend on the number of threads, and are identical for tiles and shards starting at multiples of \c sizeBlock.
+ *
+ */
+template <typename DataType = float>
+class ResidualStatistics
+{
+public:
+    //! The number of pixels summed in a block.
+    static const int sizeBlock = 256;
+
+    //--------------------------------------------------------
+    //
+    //! \name Constructors / Destructor / Instance Management
+    //@{
+    //--------------------------------------------------------
+    //! Destructor.
+    ~ResidualStatistics(){}
+    //! Default constructor.
+    ResidualStatistics(
+        const int numberOfRows = 0,
+        const int numberOfImages = 0,
+        const DataType maxValue = (DataType)256,
+        const int numberOfBins = 1024
+    ):
+        rmsPixel_( Eigen::Matrix<DataType, -1, 1>::Zero(numberOfRows) ),
+        numberOfImages_( numberOfImages ),
+        histogram_( numberOfBins+1, 0 ),
+        numberOfSamplesImage_( numberOfImages, 0 ),
+        maxValue_( maxValue ),
+        numberOfSamples_( 0 ),
+        numberOfRows_( 0 )
+    {}
+    //@}
+
+    //------------------------------------------
+    //
+    //! \name Accumulation
+    //@{
+    //------------------------------------------
+    //! adds a row of residual \c r (1xf) of pixel \c p to the histogram and to \c sumSquare (f) of its block, and returns its RMS over all lights. Only the samples valid in \c validity, if given and not empty, are added.
+    template <typename Derived>
+    DataType addRow(
+        const Eigen::MatrixBase<Derived>& r,
+        double* sumSquare,
+        const ValidityMask* validity = NULL,
+        const int p = 0
+    )
+    {
+        bool flagValidity = ( validity != NULL && validity->numberOfPixels() > 0 );
+        int numberOfImages = r.size();
+        int numberOfBins = histogram_.size() - 1;
+        DataType scale = numberOfBins / maxValue_;
+        double sumSquareRow = 0.0;
+        int numberOfValid = 0;
+        for(int f = 0; f < numberOfImages; ++f)
+        {
+            if( flagValidity && !validity->isValid(p, f) )
+            {
+                continue;
+            }
+            double e = (double)r(f);
+            sumSquareRow += e*e;
+            sumSquare[f] += e*e;
+            int bin = std::min( (int)(std::abs(r(f)) * scale), numberOfBins );
+            ++histogram_[bin];
+            ++numberOfSamplesImage_[f];
+            ++numberOfValid;
+        }
+        numberOfSamples_ += numberOfValid;
+        ++numberOfRows_;
+        return (DataType)std::sqrt( sumSquareRow / std::max(numberOfValid, 1) );
+    }
+    //! appends \c sumSquare (f x blocks), sums of squared residual of the next blocks.
+    void appendBlocks(
+        const Eigen::Matrix<double, -1, -1>& sumSquare
+    )
+    {
+        sumSquareBlock_.insert( sumSquareBlock_.end(), sumSquare.data(), sumSquare.data() + sumSquare.size() );
+    }
+    //! merges \c stats, which covers the pixels following this object.
+    void merge(
+        const ResidualStatistics& stats
+    )
+    {
+        assert(
+            stats.histogram_.size() == histogram_.size() &&
+            stats.numberOfImages_ == numberOfImages_ &&
+            "Residual statistics to merge must have the same bins and images."
+        );
+        sumSquareBlock_.insert( sumSquareBlock_.end(), stats.sumSquareBlock_.begin(), stats.sumSquareBlock_.end() );
+        mergeHistogram( stats );
+    }
+    //! merges the histogram and the counts of \c stats, whose order does not matter.
+    void mergeHistogram(
+        const ResidualStatistics& stats
+    )
+    {
+        for(size_t b = 0; b < histogram_.size(); ++b)
+        {
+            histogram_[b] += stats.histogram_[b];
+        }
+        for(size_t f = 0; f < numberOfSamplesImage_.size(); ++f)
+        {
+            numberOfSamplesImage_[f] += stats.numberOfSamplesImage_[f];
+        }
+        numberOfSamples_ += stats.numberOfSamples_;
+        numberOfRows_ += stats.numberOfRows_;
+    }
+    //@}
+
+    //------------------------------------------
+    //
+    //! \name Get results
+    //@{
+    //------------------------------------------
+    //! returns \c rmsPixel_, RMS of each row of \c I over all lights.
+    const Eigen::Matrix<DataType, -1, 1>& rmsPixel(void) const {return rmsPixel_;}
+    //! returns \c rmsPixel_ to be filled by the caller of \c addRow().
+    Eigen::Matrix<DataType, -1, 1>& rmsPixel(void) {return rmsPixel_;}
+    //! returns sum of squared residual of \c f-th image over all pixels and channels.
+    double sumSquareImage(const int f) const
+    {
+        double sumSquare = 0.0;
+        for(size_t i = f; i < sumSquareBlock_.size(); i += numberOfImages_)
+        {
+            sumSquare += sumSquareBlock_[i];
+        }
+        return sumSquare;
+    }
+    //! returns RMS of \c f-th image over all pixels and channels.
+    DataType rmsImage(const int f) const {return numberOfSamplesImage_[f] > 0 ? (DataType)std::sqrt( sumSquareImage(f) / numberOfSamplesImage_[f] ) : (DataType)0;}
+    //! returns RMS over all samples.
+    DataType rmsAll(void) const
+    {
+        double sumSquare = 0.0;
+        for(int f = 0; f < numberOfImages_; ++f)
+        {
+            sumSquare += sumSquareImage(f);
+        }
+        return numberOfSamples_ > 0 ? (DataType)std::sqrt( sumSquare / numberOfSamples_ ) : (DataType)0;
+    }
+    //! returns \c q-th percentile (0 <= q <= 100) of absolute residual, interpolated in the histogram bin.
+    DataType percentile(const double q) const
+    {
+        int numberOfBins = histogram_.size() - 1;
+        double binWidth = maxValue_ / numberOfBins;
+        double target = q / 100.0 * numberOfSamples_;
+        double count = 0.0;
+        for(int b = 0; b <= numberOfBins; ++b)
+        {
+            if( count + histogram_[b] >= target && histogram_[b] > 0 )
+            {
+                if( b == numberOfBins )
+                { // overflow bin
+                    return maxValue_;
+                }
+                return (DataType)( binWidth * ( b + (target - count) / histogram_[b] ) );
+            }
+            count += histogram_[b];
+        }
+        return maxValue_;
+    }
+    //! returns the number of images.
+    int numberOfImages(void) const {return numberOfImages_;}
+    //! returns \c histogram_, counts of absolute residual.
+    const std::vector<long long>& histogram(void) const {return histogram_;}
+    //! returns the upper bound of the histogram.
+    DataType maxValue(void) const {return maxValue_;}
+    //@}
+
+    //------------------------------------------
+    //
+    //! \name Serialization
+    //@{
+    //------------------------------------------
+    //! writes all members but \c rmsPixel_ to \c os in binary, e.g., to merge shards.
+    void write(
+        std::ostream& os
+    ) const
+    {
+        long long sizes[5] = {numberOfImages_, (long long)histogram_.size(), (long long)sumSquareBlock_.size(), numberOfSamples_, numberOfRows_};
+        os.write( (const char*)sizes, sizeof(sizes) );
+        os.write( (const char*)&maxValue_, sizeof(DataType) );
+        os.write( (const char*)&histogram_[0], histogram_.size()*sizeof(long long) );
+        if( !numberOfSamplesImage_.empty() )
+        {
+            os.write( (const char*)&numberOfSamplesImage_[0], numberOfSamplesImage_.size()*sizeof(long long) );
+        }
+        if( !sumSquareBlock_.empty() )
+        {
+            os.write( (const char*)&sumSquareBlock_[0], sumSquareBlock_.size()*sizeof(double) );
+        }
+    }
+    //! reads all members but \c rmsPixel_ from \c is written by \c write(). returns \c false if it fails.
+    bool read(
+        std::istream& is
+    )
+    {
+        long long sizes[5];
+        if( !is.read( (char*)sizes, sizeof(sizes) ) || sizes[0] < 0 || sizes[1] <= 0 || sizes[2] < 0 )
+        {
+            return false;
+        }
+        numberOfImages_ = (int)sizes[0];
+        histogram_.resize( sizes[1] );
+        numberOfSamplesImage_.resize( numberOfImages_ );
+        sumSquareBlock_.resize( sizes[2] );
+        numberOfSamples_ = sizes[3];
+        numberOfRows_ = sizes[4];
+        is.read( (char*)&maxValue_, sizeof(DataType) );
+        is.read( (char*)&histogram_[0], histogram_.size()*sizeof(long long) );
+        if( !numberOfSamplesImage_.empty() )
+        {
+            is.read( (char*)&numberOfSamplesImage_[0], numberOfSamplesImage_.size()*sizeof(long long) );
+        }
+        if( !sumSquareBlock_.empty() )
+        {
+            is.read( (char*)&sumSquareBlock_[0], sumSquareBlock_.size()*sizeof(double) );
+        }
+        return is.good();
+    }
+    //@}
+
+    //! saves global RMS, percentiles, per-image RMS and histogram as a text file.
+    bool save(
+        const std::string strSave
+    ) const
+    {
+        std::ofstream ofs( strSave.c_str() );
+        if( !ofs.good() )
+        {
+            return false;
+        }
+        ofs << "# residual statistics of " << numberOfRows_ << " rows x " << numberOfImages() << " images" << std::endl;
+        ofs << "rms " << rmsAll() << std::endl;
+        const double q[] = {50.0, 90.0, 95.0, 99.0};
+        for(int i = 0; i < 4; ++i)
+        {
+            ofs << "percentile" << q[i] << " " << percentile(q[i]) << std::endl;
+        }
+        for(int f = 0; f < numberOfImages(); ++f)
+        {
+            ofs << "rmsImage" << f << " " << rmsImage(f) << std::endl;
+        }
+        int numberOfBins = histogram_.size() - 1;
+        ofs << "# histogram: lower bound of bin, count" << std::endl;
+        for(int b = 0; b <= numberOfBins; ++b)
+        {
+            if( histogram_[b] > 0 )
+            {
+                ofs << "bin " << maxValue_ * b / numberOfBins << " " << histogram_[b] << std::endl;
+            }
+        }
+        return ofs.good();
+    }
+
+    //! shows the summary.
+    void show(void) const
+    {
+        std::cout << "reprojection error: rms " << rmsAll()
+                  << ", median " << percentile(50.0)
+                  << ", 95% " << percentile(95.0)
+                  << ", 99% " << percentile(99.0) << std::endl;
+    }
+
+private:
+    //! RMS of each row of \c I over all lights.
+    Eigen::Matrix<DataType, -1, 1> rmsPixel_;
+    //! The number of images.
+    int numberOfImages_;
+    //! Sum of squared residual of each image (fastest) and each block in pixel order.
+    std::vector<double> sumSquareBlock_;
+    //! Histogram of absolute residual.
+    std::vector<long long> histogram_;
+    //! The number of accumulated samples of each image.
+    std::vector<long long> numberOfSamplesImage_;
+    //! Upper bound of the histogram.
+    DataType maxValue_;
+    //! The number of accumulated samples.
+    long long numberOfSamples_;
+    //! The number of accumulated rows.
+    long long numberOfRows_;
+};
+
+/*!
+ * \class PredictorLambertian
+ *
+ * \brief predicts observation of a pixel by the Lambertian model, i.e., a row of \c SL.
+ *
+ */
+template <typename DataType = float>
+class PredictorLambertian
+{
+public:
+    PredictorLambertian(
+        const Eigen::Matrix<DataType, -1, -1>& S,
+        const Eigen::Matrix<DataType, -1, -1>& L,
+        const int numberOfPixels,
+        const int color
+    ):
+        S_(S),
+        L_(L),
+        numberOfPixels_(numberOfPixels),
+        color_(color)
+    {}
+    //! predicts observation \c obs (color x f) of pixel \c p.
+    void operator()(
+        const int p,
+        Eigen::Matrix<DataType, -1, -1>& obs
+    )
+    {
+        for(int c = 0; c < color_; ++c)
+        {
+            obs.row(c).noalias() = S_.row(c*numberOfPixels_+p) * L_;
+        }
+    }
+private:
+    const Eigen::Matrix<DataType, -1, -1>& S_;
+    const Eigen::Matrix<DataType, -1, -1>& L_;
+    int numberOfPixels_;
+    int color_;
+};
+
+/*!
+ * \class PredictorReflectance
+ *
+ * \brief predicts observation of a pixel by a non-Lambertian reflectance model, given the result of \c estimateSurfaceReflectance().
+ *
+ */
+template <typename DataType = float>
+class PredictorReflectance
+{
+public:
+    PredictorReflectance(
+        const ReflectanceModel<DataType>& model,
+        const Eigen::Matrix<DataType, -1, -1>& D,
+        const Eigen::Matrix<DataType, -1, 1>& E,
+        const Eigen::Matrix<DataType, -1, -1>& N,
+        const Eigen::Matrix<DataType, -1, -1>& R,
+        const Eigen::Matrix<DataType, -1, -1>& Theta,
+        const int numberOfPixels,
+        const int color
+    ):
+        fitter_(model, D, E, color),
+        N_(N),
+        R_(R),
+        Theta_(Theta),
+        numberOfPixels_(numberOfPixels),
+        color_(color),
+        shape_(model.numberOfShapeParameters()),
+        rho_(color)
+    {}
+    //! predicts observation \c obs (color x f) of pixel \c p.
+    void operator()(
+        const int p,
+        Eigen::Matrix<DataType, -1, -1>& obs
+    )
+    {
+        for(int c = 0; c < color_; ++c)
+        {
+            rho_(c) = R_(c*numberOfPixels_+p);
+        }
+        for(int k = 0; k < shape_.size(); ++k)
+        {
+            shape_(k) = Theta_(p, 1+k);
+        }
+        n_ = N_.row(p).transpose();
+        fitter_.predict(n_, shape_, rho_, Theta_(p, 0), obs);
+    }
+private:
+    ReflectanceFitter<DataType> fitter_;
+    const Eigen::Matrix<DataType, -1, -1>& N_;
+    const Eigen::Matrix<DataType, -1, -1>& R_;
+    const Eigen::Matrix<DataType, -1, -1>& Theta_;
+    int numberOfPixels_;
+    int color_;
+    Eigen::Matrix<DataType, 3, 1> n_;
+    Eigen::Matrix<DataType, -1, 1> shape_;
+    Eigen::Matrix<DataType, -1, 1> rho_;
+};
+
+//! returns RMS of row \c i (1 x f) of pixel \c p over its samples valid in \c validity, if given, otherwise over all lights.
+template <typename Derived>
+inline typename Derived::Scalar computeRmsObservation(
+    const Eigen::MatrixBase<Derived>& i,
+    const ValidityMask* validity,
+    const int p
+)
+{
+    typedef typename Derived::Scalar DataType;
+    if( validity == NULL )
+    {
+        return i.norm() / std::sqrt( (DataType)std::max( (int)i.size(), 1 ) );
+    }
+    DataType sumSquare = (DataType)0;
+    int numberOfValid = 0;
+    for(int f = 0; f < i.size(); ++f)
+    {
+        if( validity->isValid(p, f) )
+        {
+            sumSquare += i(f) * i(f);
+            ++numberOfValid;
+        }
+    }
+    return std::sqrt( sumSquare / (DataType)std::max( numberOfValid, 1 ) );
+}
+
+//! computes residual statistics of \c I against \c predictor in one pass over \c I. Each thread copies \c predictor and holds only a (color x f) prediction, instead of the (p*c x f) matrix \c Idiff.
+//! If \c rmsObservation is given, it gets the RMS of each row of \c I over all lights in the same pass, e.g., to normalize the residual.
+//! Samples invalid in \c validity, if given, i.e., excluded from the solve, are excluded from the statistics and from \c rmsObservation.
+template <typename DataType, typename Predictor>
+inline ResidualStatistics<DataType> computeResidualStatistics(
+    const Eigen::Matrix<DataType, -1, -1>& I,
+    const Predictor& predictor,
+    const int numberOfPixels,
+    const int color,
+    const DataType maxValue = (DataType)256,
+    Eigen::Matrix<DataType, -1, 1>* rmsObservation = NULL,
+    const ValidityMask* validity = NULL
+)
+{
+    bool flagValidity = ( validity != NULL && validity->numberOfPixels() > 0 );
+    if( rmsObservation != NULL )
+    {
+        rmsObservation->resize( I.rows() );
+    }
+    int numberOfImages = I.cols();
+    const int sizeBlock = ResidualStatistics<DataType>::sizeBlock;
+    int numberOfBlocks = (numberOfPixels + sizeBlock - 1) / sizeBlock;
+    ResidualStatistics<DataType> stats(numberOfPixels*color, numberOfImages, maxValue);
+    Eigen::Matrix<double, -1, -1> sumSquare = Eigen::Matrix<double, -1, -1>::Zero(numberOfImages, numberOfBlocks);
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        Predictor predictorLocal( predictor );
+        ResidualStatistics<DataType> statsLocal(0, numberOfImages, maxValue);
+        Eigen::Matrix<DataType, -1, -1> obs(color, numberOfImages);
+        Eigen::Matrix<DataType, 1, -1> r(numberOfImages);
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+        for(int b = 0; b < numberOfBlocks; ++b)
+        { // b means "b"lock, which is summed by one thread in pixel order.
+            int pEnd = std::min( (b+1)*sizeBlock, numberOfPixels );
+            for(int p = b*sizeBlock; p < pEnd; ++p)
+            {
+                predictorLocal(p, obs);
+                for(int c = 0; c < color; ++c)
+                {
+                    r = I.row(c*numberOfPixels+p) - obs.row(c);
+                    // each row is written by one thread only.
+                    stats.rmsPixel()(c*numberOfPixels+p) = statsLocal.addRow(r, sumSquare.col(b).data(), validity, p);
+                    if( rmsObservation != NULL )
+                    {
+                        (*rmsObservation)(c*numberOfPixels+p) = computeRmsObservation( I.row(c*numberOfPixels+p), flagValidity ? validity : NULL, p );
+                    }
+                }
+            }
+        }
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+        stats.mergeHistogram( statsLocal );
+    }
+    stats.appendBlocks( sumSquare );
+
+    return stats;
+}
+
+} // end of namespace CPS
+
+#endif
@@ -0,0 +1,251 @@
+#ifndef __SEMICALIBRATED_H__
+#define __SEMICALIBRATED_H__
+
+/*!
+ * \file SemiCalibrated.hpp
+ *
+ * \date 2026/10/18
+ * \brief This file contains semi-calibrated photometric stereo, which estimates unknown light intensities given light directions, e.g., of drifting LEDs.
+ *
+ * The observations are I = S D E, where D (3 x f) are the unit light directions and E = diag(e) are the unknown intensities.
+ * The intensities are estimated from the rows of a random subsample of the available pixels, which are lit by all lights, i.e., whose shading is linear in S;
+ * - e is initialized in closed form, i.e., w_f = 1 / e_f is the null vector of a f x f matrix accumulated from the rows
+ * - e is refined by alternating least squares, i.e., S given e by the shared normal equations of D E, and each e_f given S by e_f = (I_f . D_f^T S) / |D_f^T S|^2
+ * S and e are determined up to a scale, which is fixed so that the mean of e is the mean of the given intensities.
+ * The whole frame is then solved once by the light source matrix D E, so that the cost is close to that of a single solve.
+ */
+
+// STL
+#include <vector>
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+
+// Eigen
+#include <Eigen/Core>
+#include <Eigen/LU>
+#include <Eigen/Eigenvalues>
+
+// Boost
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+
+// internal headers
+#include "DataStructure.hpp"
+
+namespace CPS
+{
+
+//! returns \c numberOfSamples pixels sampled without replacement from \c numberOfPixels pixels in ascending order, or all pixels if they are not more than \c numberOfSamples. The same \c seed gives the same samples.
+inline std::vector<int> sampleIndexOfPixels(
+    const int numberOfPixels,
+    const int numberOfSamples,
+    const unsigned int seed = 5489u
+)
+{
+    std::vector<int> indexOfPixels( numberOfPixels );
+    for(int p = 0; p < numberOfPixels; ++p)
+    {
+        indexOfPixels[p] = p;
+    }
+    if( numberOfSamples >= numberOfPixels )
+    {
+        return indexOfPixels;
+    }
+
+    // a partial Fisher-Yates shuffle of the first numberOfSamples pixels.
+    boost::random::mt19937 generator( seed );
+    for(int k = 0; k < numberOfSamples; ++k)
+    {
+        boost::random::uniform_int_distribution<int> distribution( k, numberOfPixels-1 );
+        std::swap( indexOfPixels[k], indexOfPixels[distribution( generator )] );
+    }
+    indexOfPixels.resize( numberOfSamples );
+    std::sort( indexOfPixels.begin(), indexOfPixels.end() );
+
+    return indexOfPixels;
+}
+
+/*!
+ * \class SemiCalibration
+ *
+ * \brief represents light intensities estimated by semi-calibrated photometric stereo.
+ *
+ */
+template <typename DataType = float>
+struct SemiCalibration
+{
+    SemiCalibration(): numberOfRows(0), numberOfIterations(0), change(0.0){}
+
+    //! returns \c true if the intensities are estimated, or \c false if the given ones are kept.
+    bool isEstimated(void) const {return numberOfRows > 0;}
+
+    //! The estimated intensities (1 x f).
+    Eigen::Matrix<DataType, -1, -1> intensity;
+    //! The number of rows lit by all lights, from which the intensities are estimated.
+    int numberOfRows;
+    //! The number of iterations until convergence.
+    int numberOfIterations;
+    //! The largest relative change of an intensity at the last iteration.
+    double change;
+};
+
+//! initializes the intensities \c e (1 x f) of the unit light directions \c D (3 x f) in closed form from the rows of \c Isub (k x f), which are lit by all lights. returns \c false if they are too few, or the intensities are not positive.
+//! A lit row i satisfies I(i,f) w_f = s_i . d_f of w_f = 1 / e_f, i.e., diag(i) w is in the row space of D, so that w is the null vector of sum_i diag(i) P diag(i) = P .* (Isub^T Isub) of the projection P onto the null space of D.
+template <typename DataType>
+inline bool initializeLightIntensity(
+    const Eigen::Matrix<DataType, -1, -1>& Isub,
+    const Eigen::Matrix<DataType, -1, -1>& D,
+    Eigen::Matrix<DataType, -1, -1>& e
+)
+{
+    int numberOfImages = D.cols();
+    if( Isub.rows() < numberOfImages )
+    {
+        return false;
+    }
+
+    Eigen::MatrixXd Dd = D.template cast<double>();
+    Eigen::MatrixXd Id = Isub.template cast<double>();
+    Eigen::MatrixXd P = Eigen::MatrixXd::Identity( numberOfImages, numberOfImages ) - Dd.transpose() * ( Dd * Dd.transpose() ).inverse() * Dd;
+    Eigen::MatrixXd A = P.cwiseProduct( Id.transpose() * Id );
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eigen( A );
+    Eigen::VectorXd w = eigen.eigenvectors().col(0);
+    if( w.sum() < 0.0 )
+    {
+        w = -w;
+    }
+    if( !( w.minCoeff() > 0.0 ) )
+    {
+        return false;
+    }
+    e = w.cwiseInverse().transpose().template cast<DataType>();
+
+    return true;
+}
+
+//! estimates the intensities of the lights of \c L (3 x f) from the rows of \c numberOfSamples pixels \c indexOfSamples in \c I (pc x f, e.g., mapped from a file) of \c numberOfPixels pixels. The rows lit by all lights, i.e., whose samples are all positive and valid in \c validity, if given, initialize the intensities by \c initializeLightIntensity(), which are refined by at most \c maxIterations iterations until they change by less than \c tolerance.
+//! The given intensities are kept if the rows are too few.
+template <typename DataType, typename MatrixType>
+inline SemiCalibration<DataType> estimateLightIntensity(
+    const MatrixType& I,
+    const Eigen::Matrix<DataType, -1, -1>& L,
+    const int numberOfPixels,
+    const int color,
+    const std::vector<int>& indexOfSamples,
+    const ValidityMask* validity = NULL,
+    const int maxIterations = 10,
+    const double tolerance = 1e-4
+)
+{
+    typedef Eigen::Matrix<DataType, 3, 1> Vector3;
+    bool flagValidity = ( validity != NULL && validity->numberOfPixels() > 0 );
+    int numberOfImages = L.cols();
+    int numberOfSamples = indexOfSamples.size();
+
+    // gather the lit rows of the samples, whose shading is linear in S, so that the iterations run on a small matrix.
+    std::vector<char> flagLit( (size_t)numberOfSamples*color, 0 );
+    int numberOfRows = 0;
+    for(int c = 0; c < color; ++c)
+    { // c means "c"olor
+        for(int k = 0; k < numberOfSamples; ++k)
+        { // k means sample
+            int p = indexOfSamples[k];
+            if( I.row(c*numberOfPixels+p).minCoeff() > (DataType)0 && ( !flagValidity || validity->numberOfValid(p) == numberOfImages ) )
+            {
+                flagLit[c*numberOfSamples+k] = 1;
+                ++numberOfRows;
+            }
+        }
+    }
+    Eigen::Matrix<DataType, -1, -1> Isub( numberOfRows, numberOfImages );
+    for(int i = 0, r = 0; i < (int)flagLit.size(); ++i)
+    {
+        if( flagLit[i] )
+        {
+            int c = i / numberOfSamples;
+            Isub.row(r++) = I.row(c*numberOfPixels+indexOfSamples[i%numberOfSamples]);
+        }
+    }
+
+    // split L into unit directions D and the given intensities.
+    Eigen::Matrix<DataType, -1, -1> D( 3, numberOfImages );
+    SemiCalibration<DataType> result;
+    result.intensity.resize( 1, numberOfImages );
+    for(int f = 0; f < numberOfImages; ++f)
+    { // f means "f"rame
+        DataType norm = L.col(f).norm();
+        result.intensity(f) = norm;
+        D.col(f) = norm > (DataType)0 ? Vector3( L.col(f) / norm ) : Vector3::Zero();
+    }
+    Eigen::Matrix<DataType, -1, -1>& e = result.intensity;
+    double meanGiven = e.template cast<double>().mean();
+    Eigen::Matrix<DataType, -1, -1> eInitial;
+    if( !initializeLightIntensity( Isub, D, eInitial ) )
+    {
+        std::cerr << "Only " << numberOfRows << " sampled rows are lit by all lights, which are too few to estimate the light intensities" << std::endl;
+        return result;
+    }
+    result.numberOfRows = numberOfRows;
+    e = eInitial * (DataType)( meanGiven / eInitial.template cast<double>().mean() );
+
+    Eigen::Matrix<DataType, -1, -1> S, shading;
+    for(int iteration = 0; iteration < maxIterations; ++iteration)
+    {
+        // solve S given e, which is shared by all rows, and e given S, each light by its own least squares.
+        Eigen::Matrix<DataType, -1, -1> Le = D * e.asDiagonal();
+        S.noalias() = Isub * Le.transpose() * ( Le * Le.transpose() ).inverse();
+        shading.noalias() = S * D;
+        Eigen::Matrix<DataType, -1, -1> eNext( 1, numberOfImages );
+        for(int f = 0; f < numberOfImages; ++f)
+        { // f means "f"rame
+            double denominator = shading.col(f).template cast<double>().squaredNorm();
+            eNext(f) = denominator > 0.0 ? (DataType)( Isub.col(f).template cast<double>().dot( shading.col(f).template cast<double>() ) / denominator ) : e(f);
+        }
+
+        // fix the scale of e, which is shared with S.
+        double meanNext = eNext.template cast<double>().mean();
+        if( !( meanNext > 0.0 ) )
+        {
+            break;
+        }
+        eNext *= (DataType)( meanGiven / meanNext );
+
+        result.change = 0.0;
+        for(int f = 0; f < numberOfImages; ++f)
+        { // f means "f"rame
+            result.change = std::max( result.change, std::abs( (double)eNext(f) - e(f) ) / std::max( (double)e(f), 1e-12 ) );
+        }
+        e = eNext;
+        result.numberOfIterations = iteration + 1;
+        if( result.change < tolerance )
+        {
+            break;
+        }
+    }
+
+    return result;
+}
+
+//! returns the light source matrix of the light directions of \c L (3 x f) scaled by \c intensity (1 x f).
+template <typename DataType>
+inline Eigen::Matrix<DataType, -1, -1> scaleLightSourceMatrix(
+    const Eigen::Matrix<DataType, -1, -1>& L,
+    const Eigen::Matrix<DataType, -1, -1>& intensity
+)
+{
+    Eigen::Matrix<DataType, -1, -1> Lscaled( L );
+    for(int f = 0; f < L.cols(); ++f)
+    { // f means "f"rame
+        DataType norm = L.col(f).norm();
+        if( norm > (DataType)0 )
+        {
+            Lscaled.col(f) *= intensity(f) / norm;
+        }
+    }
+    return Lscaled;
+}
+
+} // end of namespace CPS
+
+#endif
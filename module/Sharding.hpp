@@ -0,0 +1,197 @@
+#ifndef __SHARDING_H__
+#define __SHARDING_H__
+
+/*!
+ * \file Sharding.hpp
+ *
+ * \date 2026/10/18
+ * \brief This file contains splitting of the available pixels into shards, which are solved by separate processes, and the shard result files merged into the final outputs.
+ *
+ * A shard result file (.bin) in the output directory is:
+ * \code
+ * char[8]  magic "CPSSHD02"
+ * int32    bytes per value, shard, the number of shards, first pixel, end pixel, the number of all pixels, color channels, the number of images
+ * matrix   R (1 x pc), N (p x 3), Theta (p x (1+e)), confidence (p x 3) and per-pixel RMS (pc x 1) of the shard, each as int32 rows, int32 cols and column-major values
+ * stats    ResidualStatistics::write()
+ * \endcode
+ *
+ */
+
+// STL
+#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <algorithm>
+
+// Eigen
+#include <Eigen/Core>
+
+// internal headers
+#include "utilString.hpp"
+#include "ImageFloat.hpp"
+#include "ResidualStatistics.hpp"
+
+namespace CPS
+{
+
+//! parses \c strShard given as "i/N" (0 <= i < N). returns \c false if it is invalid.
+inline bool parseShard(
+    const std::string& strShard,
+    int& shard,
+    int& numberOfShards
+)
+{
+    std::string::size_type pos = strShard.find('/');
+    if( pos == std::string::npos )
+    {
+        return false;
+    }
+    shard = std::atoi( strShard.substr(0, pos).c_str() );
+    numberOfShards = std::atoi( strShard.substr(pos+1).c_str() );
+    return numberOfShards > 0 && shard >= 0 && shard < numberOfShards;
+}
+
+//! computes the range [\c pixelBegin, \c pixelEnd) of \c shard out of \c numberOfShards contiguous shards, whose boundaries are multiples of \c sizeAlignment. The aligned blocks are distributed evenly, so that a shard is empty only if there are fewer blocks than shards.
+inline void computeShardRange(
+    const int numberOfPixels,
+    const int shard,
+    const int numberOfShards,
+    const int sizeAlignment,
+    int& pixelBegin,
+    int& pixelEnd
+)
+{
+    int numberOfAligned = (numberOfPixels + sizeAlignment - 1) / sizeAlignment;
+    pixelBegin = std::min( numberOfPixels, (int)( (long long)numberOfAligned * shard / numberOfShards ) * sizeAlignment );
+    pixelEnd = std::min( numberOfPixels, (int)( (long long)numberOfAligned * (shard+1) / numberOfShards ) * sizeAlignment );
+}
+
+//! returns the filename of the result of \c shard in \c strDirOutput.
+inline std::string shardFileName(
+    const std::string& strDirOutput,
+    const int shard,
+    const int numberOfShards
+)
+{
+    return strDirOutput + "shard" + toString(shard) + "of" + toString(numberOfShards) + ".bin";
+}
+
+/*!
+ * \class ShardResult
+ *
+ * \brief represents results of the pixels of a shard.
+ *
+ */
+template <typename DataType = float>
+struct ShardResult
+{
+    typedef Eigen::Matrix<DataType, -1, -1> Matrix;
+
+    ShardResult(): shard(0), numberOfShards(1), pixelBegin(0), pixelEnd(0), numberOfPixels(0), color(0), numberOfImages(0){}
+
+    //! saves this result as \c strSave. returns \c false if it fails.
+    bool save(
+        const std::string& strSave
+    ) const
+    {
+        std::ofstream ofs( strSave.c_str(), std::ios::binary );
+        ofs.write( "CPSSHD02", 8 );
+        int fields[8] = {(int)sizeof(DataType), shard, numberOfShards, pixelBegin, pixelEnd, numberOfPixels, color, numberOfImages};
+        ofs.write( (const char*)fields, sizeof(fields) );
+        writeMatrix( ofs, R );
+        writeMatrix( ofs, N );
+        writeMatrix( ofs, Theta );
+        writeMatrix( ofs, confidence );
+        writeMatrix( ofs, Matrix(stats.rmsPixel()) );
+        stats.write( ofs );
+        ofs.close();
+
+        return !ofs.fail() && syncFile( strSave );
+    }
+
+    //! loads the result saved as \c strFile. returns \c false if it fails.
+    bool load(
+        const std::string& strFile
+    )
+    {
+        std::ifstream ifs( strFile.c_str(), std::ios::binary );
+        char magic[8];
+        int fields[8];
+        if( !ifs.read( magic, 8 ) || std::string(magic, 8) != "CPSSHD02" ||
+            !ifs.read( (char*)fields, sizeof(fields) ) || fields[0] != (int)sizeof(DataType) )
+        {
+            return false;
+        }
+        shard = fields[1];
+        numberOfShards = fields[2];
+        pixelBegin = fields[3];
+        pixelEnd = fields[4];
+        numberOfPixels = fields[5];
+        color = fields[6];
+        numberOfImages = fields[7];
+        Matrix rmsPixel;
+        if( !readMatrix( ifs, R ) || !readMatrix( ifs, N ) || !readMatrix( ifs, Theta ) || !readMatrix( ifs, confidence ) || !readMatrix( ifs, rmsPixel ) || !stats.read( ifs ) )
+        {
+            return false;
+        }
+        stats.rmsPixel() = rmsPixel;
+
+        return true;
+    }
+
+    //! writes \c mat as its size and values.
+    static void writeMatrix(
+        std::ostream& os,
+        const Matrix& mat
+    )
+    {
+        int size[2] = {(int)mat.rows(), (int)mat.cols()};
+        os.write( (const char*)size, sizeof(size) );
+        os.write( (const char*)mat.data(), mat.size()*sizeof(DataType) );
+    }
+    //! reads \c mat written by \c writeMatrix().
+    static bool readMatrix(
+        std::istream& is,
+        Matrix& mat
+    )
+    {
+        int size[2];
+        if( !is.read( (char*)size, sizeof(size) ) || size[0] < 0 || size[1] < 0 )
+        {
+            return false;
+        }
+        mat.resize( size[0], size[1] );
+        return (bool)is.read( (char*)mat.data(), mat.size()*sizeof(DataType) );
+    }
+
+    //! The index of the shard.
+    int shard;
+    //! The number of shards.
+    int numberOfShards;
+    //! The first pixel of the shard in all available pixels.
+    int pixelBegin;
+    //! The end (exclusive) pixel of the shard in all available pixels.
+    int pixelEnd;
+    //! The number of all available pixels.
+    int numberOfPixels;
+    //! The number of color channels.
+    int color;
+    //! The number of images.
+    int numberOfImages;
+    //! Surface albedo of the shard (1 x pc).
+    Matrix R;
+    //! Surface normal of the shard (p x 3).
+    Matrix N;
+    //! Reflectance parameters of the shard (p x (1+e)), or empty for Lambertian.
+    Matrix Theta;
+    //! Confidence map of the shard (p x 3).
+    Matrix confidence;
+    //! Residual statistics of the shard.
+    ResidualStatistics<DataType> stats;
+};
+
+} // end of namespace CPS
+
+#endif
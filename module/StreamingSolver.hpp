@@ -0,0 +1,249 @@
+#ifndef __STREAMINGSOLVER_H__
+#define __STREAMINGSOLVER_H__
+
+/*!
+ * \file StreamingSolver.hpp
+ *
+ * \date 2026/10/18
+ * \brief This file contains the sliding window solver of a stream of frames, e.g., of a camera under a cyclic sequence of lights, which solves the Lambertian surface of the most recent frames.
+ *
+ * The window is a ring buffer of the columns of the last \c sizeWindow frames and their lights.
+ * Each row i of S solves its normal equations M s_i = b_i, i.e., M = sum_f l_f l_f^T and b_i = sum_f I(i,f) l_f over the frames of the window.
+ * A new frame adds its light and its column to M and b, and removes those of the oldest frame it replaces, so that the cost of a frame does not grow with the window.
+ * M is shared by all pixels, and inverted once per frame, unless saturated or dark samples are excluded, in which case each pixel has its own M of its valid samples.
+ * The sums are accumulated again from the ring buffer once per \c sizeWindow frames, so that rounding errors of the updates do not drift.
+ *
+ */
+
+// STL
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+// Eigen
+#include <Eigen/Core>
+#include <Eigen/LU>
+
+// internal headers
+#include "DataStructure.hpp"
+#include "ConfidenceMap.hpp"
+
+namespace CPS
+{
+
+/*!
+ * \class SlidingWindowSolver
+ *
+ * \brief solves surface \c S (pc x 3) of the last frames of a stream by normal equations updated frame by frame.
+ *
+ */
+template <typename DataType = float>
+class SlidingWindowSolver
+{
+public:
+    typedef Eigen::Matrix<DataType, -1, -1> Matrix;
+    typedef Eigen::Matrix<DataType, 3, 1> Vector3;
+    typedef Eigen::Matrix<DataType, 3, 3> Matrix3;
+
+    //! Constructor of the window of \c sizeWindow frames of \c numberOfPixels pixels of \c color channels. Saturated and dark samples are excluded as \c validity, if it is enabled.
+    SlidingWindowSolver(
+        const int numberOfPixels,
+        const int color,
+        const int sizeWindow,
+        const ValidityMask& validity = ValidityMask()
+    ):
+        numberOfPixels_( numberOfPixels ),
+        color_( color ),
+        sizeWindow_( sizeWindow ),
+        numberOfFrames_( 0 ),
+        slot_( 0 ),
+        frames_( (size_t)numberOfPixels*color*sizeWindow ),
+        lights_( Matrix::Zero( 3, sizeWindow ) ),
+        validity_( validity ),
+        B_( Matrix::Zero( (size_t)numberOfPixels*color, 3 ) ),
+        sumSquare_( Eigen::VectorXd::Zero( (size_t)numberOfPixels*color ) ),
+        M_( Matrix3::Zero() )
+    {
+        if( validity_.isEnabled() )
+        {
+            validity_.resize( numberOfPixels_, sizeWindow_ );
+            Mpixel_ = Matrix::Zero( numberOfPixels_, 6 );
+            numberOfValid_.assign( numberOfPixels_, 0 );
+        }
+    }
+
+    //! removes the oldest frame if the window is full, and returns the column (pc) of the slot of the next frame to be gathered into, which is \c slot() of \c validity().
+    DataType* beginFrame(void)
+    {
+        if( isFull() )
+        {
+            accumulate( slot_, (DataType)-1 );
+        }
+        if( validity_.isEnabled() )
+        {
+            validity_.setValidImage( slot_ );
+        }
+        return column( slot_ );
+    }
+    //! adds the frame gathered into the slot, which is lit by \c light.
+    void endFrame(const Vector3& light)
+    {
+        lights_.col( slot_ ) = light;
+        numberOfFrames_ = std::min( numberOfFrames_ + 1, sizeWindow_ );
+        slot_ = ( slot_ + 1 ) % sizeWindow_;
+        // the sums are accumulated again once the ring buffer wraps around.
+        if( slot_ == 0 )
+        {
+            refresh();
+        }
+        else
+        {
+            accumulate( ( slot_ + sizeWindow_ - 1 ) % sizeWindow_, (DataType)1 );
+        }
+    }
+    //! accumulates the normal equations of all frames of the window again.
+    void refresh(void)
+    {
+        B_.setZero();
+        sumSquare_.setZero();
+        M_.setZero();
+        if( validity_.isEnabled() )
+        {
+            Mpixel_.setZero();
+            numberOfValid_.assign( numberOfPixels_, 0 );
+        }
+        for(int s = 0; s < numberOfFrames_; ++s)
+        { // s means "s"lot
+            accumulate( s, (DataType)1 );
+        }
+    }
+
+    //! solves surface \c S (pc x 3) of the frames of the window. A row of less than 3 valid samples, or of almost zero intensities, is set to zero. returns \c false if the lights of the window do not span 3 dimensions.
+    bool solve(Matrix& S) const
+    {
+        DataType tol = std::numeric_limits<DataType>::epsilon() * (DataType)255;
+        S.resize( B_.rows(), 3 );
+        if( !validity_.isEnabled() )
+        {
+            if( !isSolvable( M_, numberOfFrames_ ) )
+            {
+                S.setZero();
+                return false;
+            }
+            Matrix3 Minv = M_.inverse();
+            S.noalias() = B_ * Minv;
+        }
+        else
+        {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+            for(int p = 0; p < numberOfPixels_; ++p)
+            { // p means "p"ixel
+                Matrix3 M;
+                M << Mpixel_(p,0), Mpixel_(p,1), Mpixel_(p,2),
+                     Mpixel_(p,1), Mpixel_(p,3), Mpixel_(p,4),
+                     Mpixel_(p,2), Mpixel_(p,4), Mpixel_(p,5);
+                bool flagSolvable = isSolvable( M, numberOfValid_[p] );
+                Matrix3 Minv = flagSolvable ? Matrix3( M.inverse() ) : Matrix3::Zero();
+                for(int c = 0; c < color_; ++c)
+                { // c means "c"olor
+                    int i = c*numberOfPixels_+p;
+                    S.row(i) = B_.row(i) * Minv;
+                }
+            }
+        }
+        for(int i = 0; i < S.rows(); ++i)
+        {
+            if( sumSquare_(i) < (double)tol * tol )
+            {
+                // Pixel intensity is almost zero vector
+                // means that the obtained normal vector is unreliable.
+                S.row(i).setZero();
+            }
+        }
+        return true;
+    }
+
+    //! returns \c true if the window has \c sizeWindow frames.
+    bool isFull(void) const {return numberOfFrames_ == sizeWindow_;}
+    //! returns \c numberOfFrames_, The number of frames in the window.
+    int numberOfFrames(void) const {return numberOfFrames_;}
+    //! returns \c slot_, The slot of the ring buffer of the next frame.
+    int slot(void) const {return slot_;}
+    //! returns \c validity_, The validity of the samples of each slot of the ring buffer.
+    ValidityMask& validity(void) {return validity_;}
+
+private:
+    //! returns the column (pc) of slot \c s.
+    DataType* column(const int s) {return &frames_[(size_t)s*B_.rows()];}
+    //! adds the frame of slot \c s to the normal equations with \c sign, i.e., 1 to add it and -1 to remove it.
+    void accumulate(const int s, const DataType sign)
+    {
+        const DataType* ptrColumn = column( s );
+        Vector3 l = lights_.col( s );
+        Vector3 lSigned = sign * l;
+        Eigen::Map< const Eigen::Matrix<DataType, -1, 1> > I( ptrColumn, B_.rows() );
+        if( !validity_.isEnabled() )
+        {
+            B_.noalias() += I * lSigned.transpose();
+            sumSquare_.array() += (double)sign * I.array().template cast<double>().square();
+            M_.noalias() += lSigned * l.transpose();
+            return;
+        }
+        DataType m[6] = {l(0)*l(0), l(0)*l(1), l(0)*l(2), l(1)*l(1), l(1)*l(2), l(2)*l(2)};
+        int increment = sign > (DataType)0 ? 1 : -1;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+        for(int p = 0; p < numberOfPixels_; ++p)
+        { // p means "p"ixel
+            if( !validity_.isValid(p, s) )
+            {
+                continue;
+            }
+            for(int k = 0; k < 6; ++k)
+            {
+                Mpixel_(p,k) += sign * m[k];
+            }
+            numberOfValid_[p] += increment;
+            for(int c = 0; c < color_; ++c)
+            { // c means "c"olor
+                int i = c*numberOfPixels_+p;
+                B_.row(i) += I(i) * lSigned.transpose();
+                sumSquare_(i) += (double)sign * I(i) * I(i);
+            }
+        }
+    }
+
+    //! The number of pixels.
+    int numberOfPixels_;
+    //! The number of color channels.
+    int color_;
+    //! The number of frames of a full window.
+    int sizeWindow_;
+    //! The number of frames in the window.
+    int numberOfFrames_;
+    //! The slot of the ring buffer of the next frame.
+    int slot_;
+    //! The ring buffer of the columns (pc) of the frames.
+    std::vector<DataType> frames_;
+    //! The lights (3 x sizeWindow) of the frames of each slot.
+    Matrix lights_;
+    //! The validity of the samples of each slot.
+    ValidityMask validity_;
+    //! The right hand sides (pc x 3) of the normal equations.
+    Matrix B_;
+    //! The sum of squared intensities of each row (pc), in double precision, so that a row of zero intensities is still zero after its frames are removed.
+    Eigen::VectorXd sumSquare_;
+    //! The normal matrix shared by all pixels.
+    Matrix3 M_;
+    //! The upper triangles (p x 6) of the normal matrices of each pixel, if samples are excluded.
+    Matrix Mpixel_;
+    //! The number of valid samples of each pixel, if samples are excluded.
+    std::vector<int> numberOfValid_;
+};
+
+} // end of namespace CPS
+
+#endif
@@ -0,0 +1,312 @@
+#ifndef __SURFACESOLVER_H__
+#define __SURFACESOLVER_H__
+
+/*!
+ * \file SurfaceSolver.hpp
+ *
+ * \date 2026/10/18
+ * \brief This file contains the solve of surface normal, albedo, and reflectance parameters from observation and light source matrices, i.e., the core of photometric stereo.
+ *
+ * It depends only on Eigen, Boost smart pointers, and STL, so that libcps can solve buffers without the image, configuration, and file dependencies of the pipeline.
+ *
+ */
+
+// STL
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+// Eigen
+#include <Eigen/Core>
+#include <Eigen/Dense>
+
+// internal headers
+#include "utilEigen.hpp"
+#include "DataStructure.hpp"
+#include "ReflectanceModel.hpp"
+#include "ResidualStatistics.hpp"
+#include "ConfidenceMap.hpp"
+#include "Chromaticity.hpp"
+#include "NearLight.hpp"
+
+//! solves \c I = \c S \c L for \c S by least squares, where \c I has \c color channels of \c numberOfPixels pixels. A pixel having invalid samples in \c validity, if given, is solved from its valid samples only, or set to zero if less than 3 of them are valid.
+//! If \c conditioning is given, it gets the reciprocal condition number of the lights solving each row, i.e., of \c L or of the valid samples.
+//! Rows are solved by a product per block of \c ResidualStatistics::sizeBlock pixels of each channel, to which tiles and shards are aligned, so that a row gets the same result in any tile or shard.
+template <typename DataType>
+inline Eigen::Matrix<DataType, -1, -1> estimateSurface(
+    const Eigen::Matrix<DataType, -1, -1>& I,
+    const Eigen::Matrix<DataType, -1, -1>& L,
+    const int numberOfPixels,
+    const int color,
+    const CPS::ValidityMask* validity = NULL,
+    Eigen::Matrix<DataType, -1, 1>* conditioning = NULL
+)
+{
+    Eigen::Matrix<DataType, -1, -1> Linv = pinv(L);
+    Eigen::Matrix<DataType, -1, -1> Shat( I.rows(), Linv.cols() );
+    bool flagValidity = ( validity != NULL && validity->numberOfPixels() > 0 );
+    int numberOfImages = L.cols();
+    DataType conditioningAll = (DataType)0;
+    if( conditioning != NULL )
+    {
+        conditioning->resize( I.rows() );
+        conditioningAll = CPS::computeReciprocalCondition( Eigen::Matrix<DataType, 3, 3>( L * L.transpose() ) );
+    }
+
+    const int sizeBlock = CPS::ResidualStatistics<DataType>::sizeBlock;
+    int numberOfBlocks = (numberOfPixels + sizeBlock - 1) / sizeBlock;
+    DataType tol = std::numeric_limits<DataType>::epsilon() * (DataType)255;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for( int k = 0; k < numberOfBlocks*color; ++k )
+    {
+        int c = k / numberOfBlocks;
+        int p0 = (k % numberOfBlocks) * sizeBlock;
+        int numberOfPixelsBlock = std::min( sizeBlock, numberOfPixels - p0 );
+        int i0 = c*numberOfPixels + p0;
+        Shat.middleRows( i0, numberOfPixelsBlock ).noalias() = I.middleRows( i0, numberOfPixelsBlock ) * Linv;
+        Eigen::Matrix<DataType, -1, 1> norm2 = I.middleRows( i0, numberOfPixelsBlock ).rowwise().squaredNorm();
+        if( conditioning != NULL )
+        {
+            conditioning->segment( i0, numberOfPixelsBlock ).setConstant( conditioningAll );
+        }
+
+        for(int p = p0; p < p0 + numberOfPixelsBlock; ++p)
+        { // p means "p"ixel
+            int i = c*numberOfPixels + p;
+            int numberOfValid = flagValidity ? validity->numberOfValid(p) : numberOfImages;
+            if( numberOfValid < numberOfImages )
+            {
+                // normal equations of the valid samples only.
+                Eigen::Matrix<DataType, 3, 3> M = Eigen::Matrix<DataType, 3, 3>::Zero();
+                Eigen::Matrix<DataType, 3, 1> b = Eigen::Matrix<DataType, 3, 1>::Zero();
+                for(int f = 0; f < numberOfImages; ++f)
+                {
+                    if( validity->isValid(p, f) )
+                    {
+                        M.noalias() += L.col(f) * L.col(f).transpose();
+                        b.noalias() += I(i,f) * L.col(f);
+                    }
+                }
+                bool flagSolvable = CPS::isSolvable( M, numberOfValid );
+                if( flagSolvable )
+                {
+                    Shat.row(i) = ( M.inverse() * b ).transpose();
+                }
+                else
+                {
+                    Shat.row(i).setZero();
+                }
+                if( conditioning != NULL )
+                {
+                    (*conditioning)(i) = flagSolvable ? CPS::computeReciprocalCondition( M ) : (DataType)0;
+                }
+            }
+            if( norm2(i-i0) < tol*tol )
+            {
+                // Pixel intensity is almost zero vector
+                // means that the obtained normal vector is unreliable.
+                Shat.row(i) = Eigen::Matrix<DataType, 3, 1>::Zero();
+            }
+        }
+    }
+
+    return Shat;
+}
+
+template <typename DataType>
+inline Eigen::Matrix<DataType, -1, -1> estimateSurfaceAlbedo(
+    const Eigen::Matrix<DataType, -1, -1>& S
+)
+{
+    Eigen::Matrix<DataType, -1, -1> ST = S.transpose();
+
+    return ST.colwise().norm();
+}
+
+//! returns surface normal \c N (p x 3) given surface \c S (pc x 3) and albedo \c R (1 x pc), averaged over the color channels of nonzero albedo, or zero if none.
+template <typename DataType>
+inline Eigen::Matrix<DataType, -1, -1> estimateSurfaceNormal(
+    const Eigen::Matrix<DataType, -1, -1>& S,
+    const Eigen::Matrix<DataType, -1, -1>& R,
+    const int numberOfPixels,
+    const int color
+)
+{
+    Eigen::Matrix<DataType, -1, -1> N = Eigen::Matrix<DataType, -1, -1>::Zero( numberOfPixels, 3 );
+
+    Eigen::Matrix<DataType, 3, 3> Ssub = Eigen::Matrix<DataType, 3, 3>::Zero();
+    Eigen::Matrix<DataType, 1, 3> RsubInv = Eigen::Matrix<DataType, 1, 3>::Zero();
+
+    // the normal of a pixel is the mean of the unit normals of its color channels of nonzero albedo.
+    for( int p = 0; p < numberOfPixels; ++p )
+    {
+        int numberOfChannels = 0;
+        for(int c = 0; c < color; ++c)
+        {
+            Ssub.row(c) = S.row(c*numberOfPixels+p);
+            RsubInv(c) = 0.0;
+            if( R(c*numberOfPixels+p) > 0.0 )
+            {
+                RsubInv(c) = 1.0/R(c*numberOfPixels+p);
+                ++numberOfChannels;
+            }
+        }
+        if( numberOfChannels > 0 )
+        {
+            N.row( p ) = RsubInv * Ssub / (DataType)numberOfChannels;
+        }
+    }
+
+    return N;
+}
+
+namespace CPS
+{
+
+//! solves surface normal \c N, albedo \c R, surface \c S (Lambertian), reflectance parameters \c Theta (non-Lambertian), and residual statistics \c stats of the pixels observed in \c I. Invalid samples of \c validity, if given, are excluded from \c S. The residual histogram spans the \c whiteLevel of \c I.
+//! If \c nearLight is given, the pixels are lit by the near lights instead of \c L, and solved by the Lambertian model.
+//! If \c flagChromaticity is set and \c color > 1, \c S (p x 3) is solved once on the luminance of \c I, and \c R of each color channel is fitted to the shading of \c N.
+//! If \c confidence is given, it gets the confidence map (p x 3) of the pixels, built from the conditioning of the solve and the residuals of the statistics.
+template <typename DataType>
+inline void solveSurface(
+    const Eigen::Matrix<DataType, -1, -1>& I,
+    const Eigen::Matrix<DataType, -1, -1>& L,
+    const ReflectanceModel<DataType>& model,
+    const int numberOfPixels,
+    const int color,
+    Eigen::Matrix<DataType, -1, -1>& S,
+    Eigen::Matrix<DataType, -1, -1>& R,
+    Eigen::Matrix<DataType, -1, -1>& N,
+    Eigen::Matrix<DataType, -1, -1>& Theta,
+    ResidualStatistics<DataType>& stats,
+    const ValidityMask* validity = NULL,
+    const DataType whiteLevel = (DataType)255,
+    const NearLight<DataType>* nearLight = NULL,
+    const bool flagChromaticity = false,
+    Eigen::Matrix<DataType, -1, -1>* confidence = NULL
+)
+{
+    DataType maxResidual = whiteLevel * (DataType)256 / (DataType)255;
+    // by-products of the solve and the residuals, from which the confidence map is built.
+    Eigen::Matrix<DataType, -1, 1> conditioning, rmsObservation;
+    Eigen::Matrix<DataType, -1, 1>* ptrConditioning = ( confidence != NULL ) ? &conditioning : NULL;
+    Eigen::Matrix<DataType, -1, 1>* ptrObservation = ( confidence != NULL ) ? &rmsObservation : NULL;
+
+    if( flagChromaticity && color > 1 )
+    {
+        // solve S of the luminance, N given S, and R of each color channel given N.
+        Eigen::Matrix<DataType, -1, -1> Y = computeLuminance( I, numberOfPixels, color );
+        S = ( nearLight != NULL ) ? estimateSurfaceNear( Y, *nearLight, numberOfPixels, 1, validity, ptrConditioning ) : estimateSurface( Y, L, numberOfPixels, 1, validity, ptrConditioning );
+        Y.resize( 0, 0 );
+        N = estimateSurfaceNormal( S, estimateSurfaceAlbedo( S ), numberOfPixels, 1 );
+        if( nearLight != NULL )
+        {
+            PredictorNearLambertian<DataType> shading( N, *nearLight, numberOfPixels, 1 );
+            R = estimateSurfaceAlbedoShading( I, shading, numberOfPixels, color, validity );
+            stats = computeResidualStatistics(
+                I,
+                PredictorChromaticity< DataType, PredictorNearLambertian<DataType> >( shading, R, numberOfPixels, color ),
+                numberOfPixels,
+                color,
+                maxResidual,
+                ptrObservation,
+                validity
+            );
+            if( confidence != NULL )
+            {
+                *confidence = buildConfidence( conditioning, validity, I.cols(), stats.rmsPixel(), rmsObservation, numberOfPixels, color );
+            }
+            return;
+        }
+        PredictorLambertian<DataType> shading( N, L, numberOfPixels, 1 );
+        R = estimateSurfaceAlbedoShading( I, shading, numberOfPixels, color, validity );
+        if( model.name() == "Lambertian" )
+        {
+            stats = computeResidualStatistics(
+                I,
+                PredictorChromaticity< DataType, PredictorLambertian<DataType> >( shading, R, numberOfPixels, color ),
+                numberOfPixels,
+                color,
+                maxResidual,
+                ptrObservation,
+                validity
+            );
+            if( confidence != NULL )
+            {
+                *confidence = buildConfidence( conditioning, validity, I.cols(), stats.rmsPixel(), rmsObservation, numberOfPixels, color );
+            }
+            return;
+        }
+    }
+    else if( nearLight != NULL )
+    {
+        S = estimateSurfaceNear( I, *nearLight, numberOfPixels, color, validity, ptrConditioning );
+        R = estimateSurfaceAlbedo( S );
+        N = estimateSurfaceNormal( S, R, numberOfPixels, color );
+        stats = computeResidualStatistics(
+            I,
+            PredictorNearLambertian<DataType>( S, *nearLight, numberOfPixels, color ),
+            numberOfPixels,
+            color,
+            maxResidual,
+            ptrObservation,
+            validity
+        );
+        if( confidence != NULL )
+        {
+            *confidence = buildConfidence( conditioning, validity, I.cols(), stats.rmsPixel(), rmsObservation, numberOfPixels, color );
+        }
+        return;
+    }
+    else
+    {
+        // solve S given I and L, R given S, and N given S and R.
+        S = estimateSurface( I, L, numberOfPixels, color, validity, ptrConditioning );
+        R = estimateSurfaceAlbedo( S );
+        N = estimateSurfaceNormal( S, R, numberOfPixels, color );
+
+        if( model.name() == "Lambertian" )
+        {
+            stats = computeResidualStatistics(
+                I,
+                PredictorLambertian<DataType>( S, L, numberOfPixels, color ),
+                numberOfPixels,
+                color,
+                maxResidual,
+                ptrObservation,
+                validity
+            );
+            if( confidence != NULL )
+            {
+                *confidence = buildConfidence( conditioning, validity, I.cols(), stats.rmsPixel(), rmsObservation, numberOfPixels, color );
+            }
+            return;
+        }
+    }
+
+    // refine N and R by the reflectance model, initialized by the Lambertian solution.
+    Theta = estimateSurfaceReflectance( I, L, model, numberOfPixels, color, N, R );
+
+    Eigen::Matrix<DataType, -1, -1> D;
+    Eigen::Matrix<DataType, -1, 1> E;
+    splitLightSourceMatrix( L, D, E );
+    stats = computeResidualStatistics(
+        I,
+        PredictorReflectance<DataType>( model, D, E, N, R, Theta, numberOfPixels, color ),
+        numberOfPixels,
+        color,
+        maxResidual,
+        ptrObservation,
+        validity
+    );
+    if( confidence != NULL )
+    {
+        *confidence = buildConfidence( conditioning, validity, I.cols(), stats.rmsPixel(), rmsObservation, numberOfPixels, color );
+    }
+}
+
+} // end of namespace CPS
+
+#endif
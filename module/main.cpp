@@ -7,6 +7,9 @@
 #include <omp.h>
 #endif
 
+// Boost
+#include <boost/program_options.hpp>
+
 // Internal header files (utilities for handling data)
 #include "utilString.hpp"
 #include "utilFile.hpp"
@@ -14,128 +17,290 @@
 // Internal header files (modules for processing)
 #include "CpsConfiguration.hpp"
 #include "PhotometricStereoSolver.hpp"
+#include "LightCalibration.hpp"
+#include "CpsPipeline.hpp"
+#include "CpsDaemon.hpp"
 
-//! checks input arguments and returns the filename of configuration file as \c std::string.
-std::string checkInputArguments(
+//! checks input arguments and returns them as \c boost::program_options::variables_map, whose "config" is the filename of configuration file.
+boost::program_options::variables_map checkInputArguments(
     int argc,
     char* argv[]
 )
 {
+    namespace po = boost::program_options;
+
+    po::options_description desc("Usage: CPS config.xml [options]");
+    desc.add_options()
+        ("help,h", "shows this message.")
+        ("config", po::value<std::string>(), "xml file (or .cps file), which contains all configuration.")
+        ("calibrate-lights", "estimates light directions from the chrome sphere observed in config.xml instead of solving photometric stereo.")
+        ("calibration-target", po::value<std::string>(), "xml file whose light directions are replaced by the calibrated ones (default: config.xml).")
+        ("calibration-output", po::value<std::string>(), "xml file to save the calibrated configuration (default: DirectoryOutput/calibratedLights.xml).")
+        ("no-config-cache", "parses and validates the xml file without reading or writing its cache (config.xml.cache).")
+        ("compile-config", po::value<std::string>(), "saves the configuration as a plain text file (.cps), which is loaded without any xml parser, and exits.")
+        ("writer-threads", po::value<int>()->default_value(1), "the number of threads encoding and writing output images.")
+        ("daemon", po::value<std::string>(), "runs as a daemon, which solves jobs received on this Unix domain socket (see module/CpsDaemon.hpp for the protocol), instead of config.xml.")
+        ("daemon-workers", po::value<int>()->default_value(2), "the number of jobs solved concurrently by the daemon.")
+        ("shard", po::value<std::string>(), "solves only shard i of N contiguous shards of the masked pixels given as i/N, and saves its result in DirectoryOutput.")
+        ("merge", po::value<int>(), "merges the results of N shards in DirectoryOutput into the outputs, which are identical to the outputs solved at once.")
+        ("preview", po::value<int>(), "solves images decimated by the factor N in each axis, and writes the outputs in DirectoryOutput_previewN.")
+        ("preview-refine", "refines the preview by solving with the factors N, N/2, ..., 1 one after another.")
+        ("crop", "crops images to the bounding box of the mask, so that pixels out of it are neither gathered nor written. RAW outputs store the offset in the frame.")
+        ("roi", po::value<std::string>(), "crops images to the region given as x,y,width,height instead of the bounding box of the mask.")
+        ("lights", po::value<int>(), "loads and solves only the K lights (K >= 3) conditioning the solve best, and reports the speedup and the estimated accuracy loss.")
+        ("saturation", po::value<double>(), "excludes samples, any of whose channels is at or above the level, e.g. 255, from the solve.")
+        ("dark", po::value<double>(), "excludes samples, all of whose channels are at or below the level, e.g. 2, from the solve.")
+        ("near-lights", "treats lights as near point lights, whose positions are given as light directions (or the light table), and solves each pixel under its own light directions.")
+        ("pixel-size", po::value<double>()->default_value(1.0), "the size of a pixel on the reference plane z = 0 in the units of light positions of --near-lights, whose origin is the center of the frame.")
+        ("falloff", po::value<double>()->default_value(2.0), "the exponent of the distance, by which the irradiance of --near-lights falls off.")
+        ("chromaticity", "solves the geometry of colored observations once on their luminance and the albedo of each color channel in closed form, instead of solving each channel.")
+        ("multiplexed", po::value<std::string>(), "solves each RGB frame by itself, whose channels are lit by the 3 colored lights of this light table in the order of the channels, and writes the outputs of each frame, e.g., surfaceNormal_00012.")
+        ("crosstalk", po::value<std::string>(), "the light table of the crosstalk of --multiplexed, whose line of each light is the response \"r g b\" of the color channels to it.")
+        ("stream", po::value<int>(), "solves each frame by the sliding window of the last F frames (F >= 3), which is updated frame by frame, e.g., of a cyclic sequence of lights, and writes the outputs of each frame, e.g., surfaceNormal_00012.")
+        ("frame-rate", po::value<double>()->default_value(0.0), "the frame rate in fps at which frames of --stream arrive, which drops frames not processed in time, or 0 to process them as fast as possible.")
+        ("semi-calibrated", "estimates the light intensities, e.g., of drifting LEDs, from the observations given only the light directions, and writes them in DirectoryOutput/estimatedLights.txt.")
+        ("semi-calibrated-samples", po::value<int>()->default_value(4096), "the number of masked pixels randomly sampled to estimate the light intensities of --semi-calibrated.")
+        ("memory-limit", po::value<std::string>(), "memory available for solving, e.g. 512M or 4G, which chooses in-core, tiled or out-of-core execution (default: the cgroup limit or the physical memory).")
+    ;
+    po::positional_options_description pos;
+    pos.add("config", 1);
+
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv).options(desc).positional(pos).run(), vm);
+    po::notify(vm);
+
+    if( vm.count("help") )
+    {
+        std::cout << desc << std::endl;
+        exit(0);
+    }
+    if( vm.count("daemon") )
+    {
+        return vm;
+    }
     assert(
-        (argc > 1) &&
+        vm.count("config") &&
         "\n [Main] \n The input argument for this program must be larger than 1.\n The second argument is supposed to specify an xml file, which contains all configuration."
     );
-    std::string str = argv[1];
     assert(
-        UtilFile::checkFileExist(str) &&
+        UtilFile::checkFileExist(vm["config"].as<std::string>()) &&
         "Specified xml file does not exist!"
     );
 
-    return str;
+    return vm;
 }
 
-int main(int argc, char* argv[])
+//! estimates light directions from a chrome sphere given by \c strFileConfig, and saves a configuration with the calibrated lights.
+template <typename DataType>
+int runLightCalibration(
+    const std::string strFileConfig,
+    const boost::program_options::variables_map& vm
+)
 {
-    typedef float DataType;
-    srand(time(NULL));
-
-    std::string strFileConfig = checkInputArguments(argc, argv);
-
-    CPS::CalibratedPhotometricStereo<DataType> cps(
-        loadConfiguration(
-             strFileConfig
-         )
-    );
-    showConfiguration( cps.config() );
+    CPS::CpsConfig config = loadConfigurationCached( strFileConfig, !vm.count("no-config-cache") );
 
     int width;
     int height;
     std::vector<int> indexOfPixels;
     loadAvailablePixels(
-        cps.config().strImageMask(),
+        config.strImageMask(),
         width,
         height,
         indexOfPixels
     );
 
-    cps.width(width);
-    cps.height(height);
-    cps.color(cps.config().color());
-    cps.indexOfPixels(indexOfPixels);
-
-    // build observation matrix and light source matrix.
-    cps.I(
-        buildObservationMatrix<DataType>(
-            cps.indexOfPixels(),
-            cps.config().obsAll().observation(),
-            cps.color(),
-            cps.width()
-        )
-    );
-    cps.L(
-        buildLightSourceMatrix<DataType>(
-            cps.config().obsAll().observation()
-        )
+    Eigen::Matrix<DataType, -1, -1> D = CPS::calibrateLightDirection<DataType>(
+        config.obsAll().observation(),
+        indexOfPixels,
+        width,
+        height
     );
 
-    // solve S given I and L.
-    cps.S(
-        estimateSurface(
-            cps.I(),
-            cps.L()
-        )
+    CPS::CpsConfig configTarget = vm.count("calibration-target") ?
+        loadConfigurationCached( vm["calibration-target"].as<std::string>(), !vm.count("no-config-cache") ) :
+        config;
+    std::string strFileOutput = vm.count("calibration-output") ?
+        vm["calibration-output"].as<std::string>() :
+        config.strDirOutput() + "calibratedLights.xml";
+    saveConfiguration(
+        CPS::applyLightDirection( configTarget, D ),
+        strFileOutput
     );
 
-    // solve R given S.
-    cps.R(
-        estimateSurfaceAlbedo(
-            cps.S()
-        )
-    );
-    cimg_library::CImg<DataType> imgR = saveSurfaceAlbedoToImage(
-        cps.R(),
-        cps.indexOfPixels(),
-        cps.width(),
-        cps.height(),
-        cps.color(),
-        cps.config().strDirOutput() + "surfaceAlbedo.png"
-    );
+    return 0;
+}
 
-    // solve N given S and R.
-    cps.N(
-        estimateSurfaceNormal(
-            cps.S(),
-            cps.R(),
-            cps.numberOfPixels(),
-            cps.color()
-        )
-    );
-    cimg_library::CImg<DataType> imgN = saveSurfaceNormalToImage(
-        cps.N(),
-        cps.indexOfPixels(),
-        cps.width(),
-        cps.height(),
-        cps.config().strDirOutput() + "surfaceNormal.png"
-    );
+int main(int argc, char* argv[])
+{
+    typedef float DataType;
+    srand(time(NULL));
 
-    // compute reprojection error.
-    cps.Idiff(
-        computeErrorLambertian(
-            cps.I(),
-            cps.S(),
-            cps.L()
-        )
-    );
-    cimg_library::CImg<DataType> imgDiff = saveReprojectionError(
-        cps.Idiff(),
-        cps.indexOfPixels(),
-        cps.width(),
-        cps.height(),
-        cps.color(),
-        cps.config().strDirOutput() + "reprojectionError.png"
+    boost::program_options::variables_map vm = checkInputArguments(argc, argv);
+
+    CPS::PipelineOption option;
+    option.numberOfWriterThreads = vm["writer-threads"].as<int>();
+    if( vm.count("memory-limit") )
+    {
+        option.memoryLimit = CPS::parseMemorySize( vm["memory-limit"].as<std::string>() );
+        assert(
+            option.memoryLimit > 0 &&
+            "--memory-limit must be a size such as 512M or 4G."
+        );
+    }
+
+    if( vm.count("preview") )
+    {
+        option.previewFactor = vm["preview"].as<int>();
+        assert(
+            option.previewFactor >= 1 &&
+            "--preview must be a factor of at least 1."
+        );
+    }
+
+    if( vm.count("lights") )
+    {
+        option.numberOfLights = vm["lights"].as<int>();
+        assert(
+            option.numberOfLights >= 3 &&
+            "--lights must be at least 3."
+        );
+    }
+    if( vm.count("saturation") )
+    {
+        option.saturationLevel = vm["saturation"].as<double>();
+    }
+    if( vm.count("dark") )
+    {
+        option.darkLevel = vm["dark"].as<double>();
+    }
+    if( vm.count("near-lights") )
+    {
+        option.flagNearLight = true;
+        option.pixelSize = vm["pixel-size"].as<double>();
+        option.falloff = vm["falloff"].as<double>();
+        assert(
+            option.pixelSize > 0.0 &&
+            "--pixel-size must be positive."
+        );
+    }
+    if( vm.count("chromaticity") )
+    {
+        option.flagChromaticity = true;
+    }
+    if( vm.count("semi-calibrated") )
+    {
+        option.flagSemiCalibrated = true;
+        option.numberOfSemiCalibrationSamples = vm["semi-calibrated-samples"].as<int>();
+        assert(
+            option.numberOfSemiCalibrationSamples >= 1 &&
+            "--semi-calibrated-samples must be at least 1."
+        );
+    }
+    if( vm.count("crop") || vm.count("roi") )
+    {
+        option.flagCrop = true;
+    }
+    if( vm.count("roi") )
+    {
+        int numberOfRead = std::sscanf(
+            vm["roi"].as<std::string>().c_str(),
+            "%d,%d,%d,%d",
+            &option.region.x,
+            &option.region.y,
+            &option.region.width,
+            &option.region.height
+        );
+        assert(
+            numberOfRead == 4 && option.region.width > 0 && option.region.height > 0 &&
+            "--roi must be given as x,y,width,height."
+        );
+    }
+
+    if( vm.count("daemon") )
+    {
+        CPS::CpsDaemon<DataType> daemon(
+            vm["daemon"].as<std::string>(),
+            vm["daemon-workers"].as<int>(),
+            option
+        );
+        return daemon.run();
+    }
+
+    std::string strFileConfig = vm["config"].as<std::string>();
+
+    if( vm.count("compile-config") )
+    {
+        return saveConfigurationText(
+            loadConfigurationCached( strFileConfig, !vm.count("no-config-cache") ),
+            vm["compile-config"].as<std::string>()
+        ) ? 0 : 1;
+    }
+    if( vm.count("calibrate-lights") )
+    {
+        return runLightCalibration<DataType>( strFileConfig, vm );
+    }
+    if( vm.count("merge") )
+    {
+        option.flagDisplay = false;
+        return CPS::mergeShards<DataType>(
+            loadConfigurationCached( strFileConfig, !vm.count("no-config-cache") ),
+            vm["merge"].as<int>(),
+            option
+        );
+    }
+    if( vm.count("shard") )
+    {
+        bool flagValid = CPS::parseShard( vm["shard"].as<std::string>(), option.shard, option.numberOfShards );
+        assert(
+            flagValid &&
+            "--shard must be given as i/N, where 0 <= i < N."
+        );
+    }
+
+    CPS::CpsConfig config = loadConfigurationCached(
+        strFileConfig,
+        !vm.count("no-config-cache")
     );
 
-    (imgR, imgN, imgDiff).display("Surface albedo, surface normal, and reprojection error");
+    if( vm.count("stream") )
+    {
+        option.sizeWindow = vm["stream"].as<int>();
+        option.frameRate = vm["frame-rate"].as<double>();
+        assert(
+            option.sizeWindow >= 3 &&
+            "--stream must be at least 3."
+        );
+        return CPS::runStreamingPhotometricStereo<DataType>( config, option );
+    }
+    if( vm.count("multiplexed") )
+    {
+        option.strMultiplexedLight = vm["multiplexed"].as<std::string>();
+        if( vm.count("crosstalk") )
+        {
+            option.strCrosstalk = vm["crosstalk"].as<std::string>();
+        }
+        return CPS::runMultiplexedPhotometricStereo<DataType>( config, option );
+    }
 
-    return 0;
+    // each coarser level of a refined preview is written without display, before the next finer one.
+    if( vm.count("preview-refine") )
+    {
+        CPS::PipelineOption optionCoarse( option );
+        optionCoarse.flagDisplay = false;
+        for( ; option.previewFactor > 1; option.previewFactor /= 2 )
+        {
+            optionCoarse.previewFactor = option.previewFactor;
+            int status = CPS::runPhotometricStereo<DataType>( config, optionCoarse );
+            if( status != 0 )
+            {
+                return status;
+            }
+        }
+    }
+
+    // exits after all outputs are written to the disk.
+    return CPS::runPhotometricStereo<DataType>(
+        config,
+        option
+    );
 }
@@ -92,7 +92,7 @@ private:
     //@}
 };
 
-void FileName::SetFileName(
+inline void FileName::SetFileName(
     const std::string fullname_
 )
 {
@@ -104,7 +104,7 @@ void FileName::SetFileName(
     dir = p.parent_path().c_str();
 }
 
-bool checkFileExist(
+inline bool checkFileExist(
     std::string strName
 )
 {
@@ -122,7 +122,7 @@ bool checkFileExist(
 // @param[in]	p				Path of the file containing both directory and file names.
 // @param[in]	strExt			Target file extension.
 // @param[out]	strFile			Obtained list of files of interest.
-void StoreFile(
+inline void StoreFile(
     const boost::filesystem::path& p,
     const std::string strExt,
     std::vector<std::string>& strFile
@@ -141,7 +141,7 @@ void StoreFile(
 // @param[in]	p				Path of the file containing both directory and file names.
 // @param[in]	strExt			Target file extension.
 // @param[out]	strFile			Obtained file of interest.
-void StoreFile(
+inline void StoreFile(
     const boost::filesystem::path& p,
     const std::string strExt,
     std::string& strFile
@@ -168,7 +168,7 @@ void StoreFile(
 //! @param[in]	strExt			Target file extension.
 //! @param[out]	strFile			Obtained list of files of interest.
 //! @param[in]	flagRecursive	Flag specifing whether file search is recursively executed or not.
-void GetFileList(
+inline void GetFileList(
     const std::string strDir,
     const std::string strExt,
     std::vector<std::string> &strFile,
@@ -217,7 +217,7 @@ void GetFileList(
 //! @param[in]	strExt			Target file extension.
 //! @param[out]	fileName		Obtained list of files of interest as \c std::vector<FileName>.
 //! @param[in]	flagRecursive	Flag specifing whether file search is recursively executed or not.
-void GetFileList(
+inline void GetFileList(
     const std::string strDir,
     const std::string strExt,
     std::vector<FileName>& fileName,
@@ -288,7 +288,7 @@ void GetFileList(
 //! @param[in]	strExt			Target file extension.
 //! @param[out]	strFile			Obtained list of files of interest as \c std::vector<std::string>.
 //! @param[in]	flagRecursive	Flag specifing whether file search is recursively executed or not.
-void GetFileList(
+inline void GetFileList(
     const std::string strDir,
     const std::string strBase,
     const std::string strExt,
@@ -345,7 +345,7 @@ void GetFileList(
 //! @param[in]	strExt			Target file extension.
 //! @param[out]	fileName		Obtained list of files of interest as \c std::vector<FileName>.
 //! @param[in]	flagRecursive	Flag specifing whether file search is recursively executed or not.
-void GetFileList(
+inline void GetFileList(
     const std::string strDir,
     const std::string strBase,
     const std::string strExt,
@@ -422,7 +422,7 @@ void GetFileList(
 //! @param[in]	strBase			part of string of interests.
 //! @param[in]	strExt			Target file extension.
 //! @return 	strFile			Obtained list of files of interest as \c std::vector<std::string>.
-std::vector<std::string> getFilesFromDirectory(
+inline std::vector<std::string> getFilesFromDirectory(
     const std::string strDir,
     const std::string strBase,
     const std::string strExt
@@ -458,7 +458,7 @@ std::vector<std::string> getFilesFromDirectory(
 //! @param[out]	fileName		Obtained list of files of interest as \c std::vector<FileName>.
 //! @param[out] fileIndex       Index of the obtained filename list as \c std::vector<int>.
 //! @param[in]	flagRecursive	Flag specifing whether file search is recursively executed or not.
-void GetFileList(
+inline void GetFileList(
     const std::string strDir,
     const std::string strBase,
     const std::string strExt,
@@ -20,7 +20,7 @@
 #include <Eigen/StdVector>
 
 //! replaces \c std::string from \c strBefore to \c strAfter.
-std::string strReplace(
+inline std::string strReplace(
     std::string &str,
     const std::string &strBefore,
     const std::string &strAfter
@@ -91,7 +91,7 @@ inline std::string toString(
 }
 
 //! converts \c Eigen::MatrixXd data to \c std::string, which delimits consective rows by \c delimeRow and consective columns by \c delimeCol.
-std::string toString(
+inline std::string toString(
     const Eigen::MatrixXd& vec,
     const std::string delimRow = " ",
     const std::string delimCol = ";"
@@ -112,7 +112,7 @@ std::string toString(
 }
 
 //! converts \c Eigen::Vector3d data to \c std::string, which delimits consective rows by \c delimeRow and consective columns by \c delimeCol.
-std::string toString(
+inline std::string toString(
     const std::vector< Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> >& vec,
     const std::string delimRow = " ",
     const std::string delimCol = ";"
@@ -132,7 +132,7 @@ std::string toString(
 }
 
 //! converts \c Eigen::Vector2d data to \c std::string, which delimits consective rows by \c delimeRow and consective columns by \c delimeCol.
-std::string toString(
+inline std::string toString(
     const std::vector< Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> >& vec,
     const std::string delimRow = " ",
     const std::string delimCol = ";"
@@ -181,7 +181,7 @@ inline std::string toString(
 //------------------------------------------
 
 //! splits \c std::string data, using \c delim as separator, to a set of \c std::string data as \c std::vector<std::string> data.
-std::vector< std::string > splitString(
+inline std::vector< std::string > splitString(
     const std::string &str,
     const std::string &delim
 )
@@ -201,7 +201,7 @@ std::vector< std::string > splitString(
 }
 
 //! splits \c std::string data, using \c delimCol and \c delimRow as separators, to a set of \c std::vector< std::vector< std::string > > data.
-std::vector< std::vector< std::string > > splitString(
+inline std::vector< std::vector< std::string > > splitString(
     const std::string &str,
     const std::string &delimCol,
     const std::string &delimRow
@@ -506,7 +506,7 @@ inline void str2eigen(
 }
 
 //! converts \c std::string data to \c Eigen::Matrix3d data.
-void str2eigenMatrix(
+inline void str2eigenMatrix(
     std::string str,
     Eigen::Matrix3d& result
 )
@@ -528,7 +528,7 @@ void str2eigenMatrix(
 }
 
 //! converts \c std::string data to \c std::vector<Eigen::Vector3d> data using \c delimRow and \c delimCol as separators.
-void str2eigenVector(
+inline void str2eigenVector(
     std::string str,
     std::vector< Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> >& result,
     const std::string delimRow = " ",
@@ -552,7 +552,7 @@ void str2eigenVector(
 }
 
 //! converts \c std::string data to \c std::vector<Eigen::Vector2d> data using \c delimRow and \c delimCol as separators.
-void str2eigenVector(
+inline void str2eigenVector(
     std::string str,
     std::vector< Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> >& result,
     const std::string delimRow = " ",
@@ -581,7 +581,7 @@ void str2eigenVector(
 //@{
 //------------------------------------------
 //! matches to \c std::string data.
-bool matchString(
+inline bool matchString(
     const std::string str1,
     const std::string str2
 )
@@ -597,7 +597,7 @@ bool matchString(
 }
 
 //! matches \c std::string and \c std::vector<std::string> and returns the index of matched object or -1 if not matched.
-int matchString(
+inline int matchString(
     const std::string str1,
     const std::vector< std::string > str2
 )
@@ -650,7 +650,7 @@ inline void showVector(
 }
 
 //! outputs \c std::vector<T> data on console.
-int askInput( const int valDefault )
+inline int askInput( const int valDefault )
 {
     std::string strTmp;
 
@@ -666,7 +666,7 @@ int askInput( const int valDefault )
 }
 
 //! asks any input via console and returns the input as \c std::string.
-std::string askInput( const std::string valDefault )
+inline std::string askInput( const std::string valDefault )
 {
     std::string strTmp;
 
@@ -688,7 +688,7 @@ std::string askInput( const std::string valDefault )
 //@{
 //------------------------------------------
 //! splits \c std::string to \c std::vector<double> using \c delim as separator.
-std::vector<double> splitStringToDouble(
+inline std::vector<double> splitStringToDouble(
     const std::string &str,
     const std::string &delim
 )
@@ -708,7 +708,7 @@ std::vector<double> splitStringToDouble(
 }
 
 //! load \c strFile and convert the loaded data to \c std::vector<std::vector<std::string>> using \c delim as separator.
-void FiletoString(
+inline void FiletoString(
     const std::string strFile,
     std::vector< std::vector< std::string > >& strData,
     const std::string delim = ","